@@ -0,0 +1,298 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+/*
+*	Writer benchmark: records synthetic frames for every combination of resolution
+*	and I/O mode and reports throughput, gmav_add latency and gmav_finish time.
+*	One JSON object per case goes to stdout, a readable table to stderr.
+*
+*	Build on Linux from the repository root:
+*		gcc -std=c11 -D_GNU_SOURCE -O2 -Wno-multichar src/gmav_*.c src/libgmavi.c bench/gmav_bench.c -lpthread -o gmav_bench
+*
+*	Usage: gmav_bench [-d directory] [-r 720p,1080p,...] [-m sync,queue,...] [-n frames]
+*						[-s segmentSize] [-k]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/libgmavi.h"
+
+/*
+*	@param	name			- Name used on the command line and in the report
+*	@param	width			- Frame width
+*	@param	height			- Frame height
+*/
+typedef struct	s_bench_size
+{
+	const char	*name;
+	uint32_t	width;
+	uint32_t	height;
+}	t_bench_size;
+
+/*
+*	@param	name			- Name used on the command line and in the report
+*	@param	flags			- GMAV_FLAG_* of the recording
+*	@param	queueDepth		- Writer queue, 0 writes on the calling thread
+*	@param	ioEngine		- GMAV_ENGINE_*
+*	@param	acquire			- Frames go through gmav_acquire_frame / gmav_commit_frame
+*/
+typedef struct	s_bench_mode
+{
+	const char	*name;
+	uint32_t	flags;
+	uint32_t	queueDepth;
+	uint32_t	ioEngine;
+	bool		acquire;
+}	t_bench_mode;
+
+/*
+*	Measurements of one case, latencies in microseconds
+*/
+typedef struct	s_bench_result
+{
+	uint32_t	frames;
+	double		seconds;
+	double		finishMs;
+	double		p50;
+	double		p99;
+	double		max;
+}	t_bench_result;
+
+static const t_bench_size	g_sizes[] = {
+	{"720p", 1280, 720},
+	{"1080p", 1920, 1080},
+	{"1440p", 2560, 1440},
+	{"4k", 3840, 2160},
+	{"8k", 7680, 4320}
+};
+
+static const t_bench_mode	g_modes[] = {
+	{"sync", 0, 0, GMAV_ENGINE_SYNC, false},
+	{"queue", 0, 8, GMAV_ENGINE_SYNC, false},
+	{"uring", 0, 0, GMAV_ENGINE_URING, false},
+	{"direct", GMAV_FLAG_DIRECT, 0, GMAV_ENGINE_SYNC, false},
+	{"direct-uring", GMAV_FLAG_DIRECT, 0, GMAV_ENGINE_URING, false},
+	{"mapped", 0, 0, GMAV_ENGINE_SYNC, true}
+};
+
+/*	Default RIFF segment size, frames are added until well past the first AVIX rollover	*/
+#define BENCH_SEGMENT_SIZE		1999991696u
+#define BENCH_SEGMENTS			1.25
+
+static double	bench_now(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec + now.tv_nsec / 1e9);
+}
+
+static int	bench_compare(const void *a, const void *b)
+{
+	double	x = *(const double *)a;
+	double	y = *(const double *)b;
+
+	return ((x > y) - (x < y));
+}
+
+/*
+*	Whether @name is listed in the comma separated @list, NULL lists everything
+*/
+static bool	bench_selected(const char *list, const char *name)
+{
+	size_t	length = strlen(name);
+
+	if (list == NULL)
+		return (true);
+	for (const char *at = list; (at = strstr(at, name)) != NULL; at += length) {
+		if ((at == list || at[-1] == ',') && (at[length] == ',' || at[length] == '\0'))
+			return (true);
+	}
+	return (false);
+}
+
+/*
+*	Every frame differs from the one before, so nothing is skipped on the way
+*/
+static void	bench_stamp(uint8_t *frame, size_t size, uint32_t index)
+{
+	for (size_t i = 0; i < size; i += 4096)
+		frame[i] = (uint8_t)(index + i / 4096);
+}
+
+static bool	bench_run(const char *filePath, const t_bench_size *size, const t_bench_mode *mode,
+	uint32_t frames, uint32_t segmentSize, t_bench_result *result)
+{
+	gmavi_config_t	config;
+	size_t			frameSize = (size_t)size->width * size->height * 3;
+	uint8_t			*frame = (uint8_t *)malloc(frameSize);
+	double			*latency = (double *)malloc(sizeof(double) * frames);
+
+	gmav_config_default(&config);
+	config.flags = mode->flags;
+	config.queueDepth = mode->queueDepth;
+	config.ioEngine = mode->ioEngine;
+	config.segmentSize = segmentSize;
+
+	void	*gmav = frame && latency ? gmav_open_ex(filePath, size->width, size->height, 60, &config) : NULL;
+
+	if (gmav == NULL)
+	{
+		free(frame);
+		free(latency);
+		return (false);
+	}
+	for (size_t i = 0; i < frameSize; i++)
+		frame[i] = (uint8_t)(i * 2654435761u >> 24);
+
+	double	start = bench_now();
+	bool	added = true;
+
+	for (uint32_t i = 0; added && i < frames; i++) {
+		bench_stamp(frame, frameSize, i);
+
+		double	before = bench_now();
+
+		if (mode->acquire)
+		{
+			uint8_t	*target = gmav_acquire_frame(gmav);
+
+			if (target != NULL)
+				memcpy(target, frame, frameSize);
+			added = target != NULL && gmav_commit_frame(gmav);
+		}
+		else
+			added = gmav_add(gmav, frame);
+		latency[i] = (bench_now() - before) * 1e6;
+	}
+	free(frame);
+	if (!added)
+	{
+		/*	A failed add already released the instance	*/
+		free(latency);
+		return (false);
+	}
+
+	double	finishStart = bench_now();
+	bool	finished = gmav_finish(gmav);
+	double	end = bench_now();
+
+	qsort(latency, frames, sizeof(double), bench_compare);
+	*result = (t_bench_result){
+		frames,								/*	frames				*/
+		end - start,						/*	seconds				*/
+		(end - finishStart) * 1e3,			/*	finishMs			*/
+		latency[frames / 2],				/*	p50					*/
+		latency[(uint32_t)(frames * 0.99)],	/*	p99					*/
+		latency[frames - 1]					/*	max					*/
+	};
+	free(latency);
+	return (finished);
+}
+
+int	main(int argc, char **argv)
+{
+	const char	*directory = ".";
+	const char	*sizes = NULL;
+	const char	*modes = NULL;
+	uint32_t	frames = 0;
+	uint32_t	segmentSize = 0;
+	bool		keep = false;
+	int			option;
+	int			failures = 0;
+
+	while ((option = getopt(argc, argv, "d:r:m:n:s:k")) != -1)
+	{
+		if (option == 'd')
+			directory = optarg;
+		else if (option == 'r')
+			sizes = optarg;
+		else if (option == 'm')
+			modes = optarg;
+		else if (option == 'n')
+			frames = (uint32_t)strtoul(optarg, NULL, 0);
+		else if (option == 's')
+			segmentSize = (uint32_t)strtoul(optarg, NULL, 0);
+		else if (option == 'k')
+			keep = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [-d directory] [-r 720p,1080p,1440p,4k,8k] "
+				"[-m sync,queue,uring,direct,direct-uring,mapped] [-n frames] [-s segmentSize] [-k]\n", argv[0]);
+			return (2);
+		}
+	}
+
+	fprintf(stderr, "%-6s %-13s %7s %9s %9s %10s %10s %10s %11s\n",
+		"size", "mode", "frames", "MB/s", "frames/s", "p50 us", "p99 us", "max us", "finish ms");
+	for (size_t s = 0; s < sizeof(g_sizes) / sizeof(g_sizes[0]); s++) {
+		const t_bench_size	*size = &g_sizes[s];
+		size_t				frameSize = (size_t)size->width * size->height * 3;
+		/*	Enough frames to roll over into at least one AVIX segment	*/
+		uint32_t			count = frames ? frames : (uint32_t)((segmentSize ? segmentSize
+			: BENCH_SEGMENT_SIZE) * BENCH_SEGMENTS / frameSize) + 1;
+
+		if (!bench_selected(sizes, size->name))
+			continue;
+		for (size_t m = 0; m < sizeof(g_modes) / sizeof(g_modes[0]); m++) {
+			const t_bench_mode	*mode = &g_modes[m];
+			t_bench_result		result;
+			char				filePath[4096];
+
+			if (!bench_selected(modes, mode->name))
+				continue;
+			snprintf(filePath, sizeof(filePath), "%s/gmav_bench_%s_%s.avi", directory, size->name, mode->name);
+			if (!bench_run(filePath, size, mode, count, segmentSize, &result))
+			{
+				fprintf(stderr, "%-6s %-13s failed\n", size->name, mode->name);
+				printf("{\"size\":\"%s\",\"mode\":\"%s\",\"ok\":false}\n", size->name, mode->name);
+				failures += 1;
+			}
+			else
+			{
+				double	megabytes = (double)frameSize * result.frames / 1e6;
+
+				fprintf(stderr, "%-6s %-13s %7u %9.1f %9.1f %10.1f %10.1f %10.1f %11.1f\n",
+					size->name, mode->name, result.frames, megabytes / result.seconds,
+					result.frames / result.seconds, result.p50, result.p99, result.max, result.finishMs);
+				printf("{\"size\":\"%s\",\"mode\":\"%s\",\"ok\":true,\"width\":%u,\"height\":%u,"
+					"\"frames\":%u,\"bytes\":%.0f,\"seconds\":%.6f,\"mb_per_sec\":%.3f,\"frames_per_sec\":%.3f,"
+					"\"add_p50_us\":%.3f,\"add_p99_us\":%.3f,\"add_max_us\":%.3f,\"finish_ms\":%.3f}\n",
+					size->name, mode->name, size->width, size->height, result.frames,
+					megabytes * 1e6, result.seconds, megabytes / result.seconds, result.frames / result.seconds,
+					result.p50, result.p99, result.max, result.finishMs);
+			}
+			fflush(stdout);
+			if (!keep)
+				unlink(filePath);
+		}
+	}
+	return (failures != 0);
+}
@@ -27,10 +27,263 @@
 # define LIBGMAVI_H
 # include <stdint.h>
 # include <stdbool.h>
+# include <stddef.h>
 # ifdef __cplusplus
 extern "C" {
 # endif
 
+	/*
+	*	Recording flags (gmavi_config_t::flags)
+	*
+	*	GMAV_FLAG_ALIGNED		- Pad the stream with JUNK chunks so every frame payload
+	*							  starts on a 4096 byte boundary
+	*	GMAV_FLAG_DIRECT		- GMAV_FLAG_ALIGNED, and write frames around the page cache
+	*							  (O_DIRECT) where the platform and file system allow it
+	*	GMAV_FLAG_TOPDOWN		- Store the stream top row first (negative biHeight)
+	*	GMAV_FLAG_INPUT_TOPDOWN	- Frames passed to gmav_add are top row first, rows are
+	*							  reversed when the stream is stored bottom up
+	*	GMAV_FLAG_DEDUP			- A frame identical to the previous one is not written again,
+	*							  its index entry points at the previous frame's chunk
+	*	GMAV_FLAG_CHECKSUM		- Store a CRC32C of every frame in the file, gmav_verify
+	*							  checks them later
+	*/
+# define GMAV_FLAG_ALIGNED		0x00000001
+# define GMAV_FLAG_DIRECT		0x00000002
+# define GMAV_FLAG_TOPDOWN		0x00000004
+# define GMAV_FLAG_INPUT_TOPDOWN	0x00000008
+# define GMAV_FLAG_DEDUP		0x00000010
+# define GMAV_FLAG_CHECKSUM		0x00000020
+
+	/*
+	*	Pixel layout of the frames passed to gmav_add (gmavi_config_t::inputFormat),
+	*	named in memory byte order
+	*/
+# define GMAV_PIXEL_BGR24		0
+# define GMAV_PIXEL_RGB24		1
+# define GMAV_PIXEL_BGRA32		2
+# define GMAV_PIXEL_RGBA32		3
+
+	/*
+	*	Pixel layout stored in the file (gmavi_config_t::streamFormat)
+	*
+	*	GMAV_STREAM_BGR24		- 24bits per pixel DIB (default)
+	*	GMAV_STREAM_BGRA32		- 32bits per pixel DIB, alpha is kept but most players ignore it
+	*	GMAV_STREAM_UYVY		- 8 bit 4:2:2 YUV, U Y V Y byte order, 2 bytes per pixel
+	*	GMAV_STREAM_YUY2		- 8 bit 4:2:2 YUV, Y U Y V byte order, 2 bytes per pixel
+	*	GMAV_STREAM_V210		- 10 bit 4:2:2 YUV, 6 pixels per 16 bytes, rows padded to 48 pixels
+	*
+	*	YUV streams use BT.709 studio range, need an even width and are always stored
+	*	top row first (GMAV_FLAG_TOPDOWN has no effect on them)
+	*/
+# define GMAV_STREAM_BGR24		0
+# define GMAV_STREAM_BGRA32		1
+# define GMAV_STREAM_UYVY		2
+# define GMAV_STREAM_YUY2		3
+# define GMAV_STREAM_V210		4
+
+	/*
+	*	Layout of uncompressed frames in the file, constant expressions so the writer
+	*	and libgmavi.hpp share a single definition
+	*
+	*	GMAV_FRAME_SECTOR		- Payload alignment of GMAV_FLAG_ALIGNED
+	*	GMAV_CHUNK_HEADER		- '00db' fcc and cb in front of every frame
+	*	GMAV_V210_BLOCK			- Pixels per padded V210 row block
+	*	GMAV_PIXEL_SIZE			- Bytes per pixel of a GMAV_PIXEL_* format, 0 for an unknown one
+	*	GMAV_STREAM_ROW_SIZE	- Bytes of one stored row of a GMAV_STREAM_* format, 0 when the
+	*							  width does not fit it
+	*	GMAV_FRAME_STRIDE		- File bytes from one frame chunk to the next for a bitmap of
+	*							  @size bytes, including the JUNK padding of GMAV_FLAG_ALIGNED
+	*/
+# define GMAV_FRAME_SECTOR		4096
+# define GMAV_CHUNK_HEADER		8
+# define GMAV_V210_BLOCK		48
+# define GMAV_PIXEL_SIZE(format)	\
+	((format) == GMAV_PIXEL_BGR24 || (format) == GMAV_PIXEL_RGB24 ? 3u \
+	: (format) == GMAV_PIXEL_BGRA32 || (format) == GMAV_PIXEL_RGBA32 ? 4u : 0u)
+# define GMAV_STREAM_ROW_SIZE(format, width)	\
+	((format) == GMAV_STREAM_BGR24 ? (size_t)(width) * 3 \
+	: (format) == GMAV_STREAM_BGRA32 ? (size_t)(width) * 4 \
+	: ((width) & 1) ? (size_t)0 \
+	: (format) == GMAV_STREAM_UYVY || (format) == GMAV_STREAM_YUY2 ? (size_t)(width) * 2 \
+	: (format) == GMAV_STREAM_V210 ? ((size_t)(width) + GMAV_V210_BLOCK - 1) / GMAV_V210_BLOCK * 128 \
+	: (size_t)0)
+# define GMAV_FRAME_STRIDE(size, aligned)	\
+	((aligned) ? (((size) + 1) / 2 * 2 + 2 * GMAV_CHUNK_HEADER + GMAV_FRAME_SECTOR - 1) \
+		/ GMAV_FRAME_SECTOR * GMAV_FRAME_SECTOR \
+	: (size) + GMAV_CHUNK_HEADER)
+
+	/*
+	*	Compression (gmavi_config_t::codec)
+	*
+	*	GMAV_CODEC_NONE			- Uncompressed frames (default)
+	*	GMAV_CODEC_UTVIDEO		- Lossless Ut Video, 'ULRG' for GMAV_STREAM_BGR24 and 'ULRA'
+	*							  for GMAV_STREAM_BGRA32. Can not be combined with YUV streams
+	*							  or GMAV_FLAG_ALIGNED
+	*/
+# define GMAV_CODEC_NONE		0
+# define GMAV_CODEC_UTVIDEO		1
+
+	/*
+	*	Full queue behaviour in asynchronous mode (gmavi_config_t::queuePolicy)
+	*
+	*	GMAV_QUEUE_BLOCK		- gmav_add waits until the writer frees a slot
+	*	GMAV_QUEUE_DROP			- gmav_add returns immediately, the frame is not recorded
+	*/
+# define GMAV_QUEUE_BLOCK		0
+# define GMAV_QUEUE_DROP		1
+
+	/*
+	*	I/O engine (gmavi_config_t::ioEngine)
+	*
+	*	GMAV_ENGINE_SYNC		- One blocking write at a time (default)
+	*	GMAV_ENGINE_URING		- Linux io_uring, keeps ioDepth frame writes in flight. Falls
+	*							  back to GMAV_ENGINE_SYNC when io_uring is not available
+	*/
+# define GMAV_ENGINE_SYNC		0
+# define GMAV_ENGINE_URING		1
+
+	/*
+	*	Backing of the buffers handed out by gmav_alloc_frame (gmavi_config_t::hugePages)
+	*
+	*	GMAV_HUGE_NONE			- Regular pages (default)
+	*	GMAV_HUGE_TRANSPARENT	- Buffers are 2MB aligned and marked for transparent huge
+	*							  pages, which the kernel may or may not use
+	*	GMAV_HUGE_EXPLICIT		- Reserved huge pages (MAP_HUGETLB, or MEM_LARGE_PAGES with
+	*							  SeLockMemoryPrivilege on Windows). Falls back to
+	*							  GMAV_HUGE_TRANSPARENT when none are available
+	*/
+# define GMAV_HUGE_NONE			0
+# define GMAV_HUGE_TRANSPARENT	1
+# define GMAV_HUGE_EXPLICIT		2
+
+	/*
+	*	Buckets of gmavi_stats_t::writeLatency
+	*/
+# define GMAV_STATS_BUCKETS		24
+
+	/*
+	*	Counters of a recording, see gmav_get_stats
+	*
+	*	@param	bytesWritten	- Bytes written to the file: frames, audio, index and header updates
+	*	@param	framesWritten	- Frames that reached the file, repeated frames included
+	*	@param	framesRepeated	- Frames only indexed as a repeat of the previous one (GMAV_FLAG_DEDUP)
+	*	@param	framesDropped	- Frames skipped under GMAV_QUEUE_DROP because the queue was full
+	*	@param	queueStalls		- Times gmav_add had to wait for the writer thread (GMAV_QUEUE_BLOCK)
+	*	@param	queueUsed		- Frames waiting in the queue right now
+	*	@param	queueDepth		- Size of the queue, 0 without a writer thread
+	*	@param	segments		- RIFF segments started after the first (AVIX rollovers)
+	*	@param	headerWrites	- Writes outside the stream: header fields, super index entries
+	*	@param	headerNanos		- Time spent in those writes
+	*	@param	writeNanos		- Time spent writing frames (chunk, index entry, checkpoint)
+	*	@param	writeMaxNanos	- Slowest single frame write
+	*	@param	writeLatency	- Frame writes by duration: bucket i counts writes that took less than
+	*							  2^i microseconds (and at least 2^(i-1)), the last bucket everything slower
+	*	@param	proxyDropped	- Frames the proxy thread could not keep up with, the proxy repeats
+	*							  its previous frame in their place
+	*/
+	typedef struct	s_gmavi_stats
+	{
+		uint64_t	bytesWritten;
+		uint64_t	framesWritten;
+		uint64_t	framesRepeated;
+		uint64_t	framesDropped;
+		uint64_t	queueStalls;
+		uint32_t	queueUsed;
+		uint32_t	queueDepth;
+		uint64_t	segments;
+		uint64_t	headerWrites;
+		uint64_t	headerNanos;
+		uint64_t	writeNanos;
+		uint64_t	writeMaxNanos;
+		uint64_t	writeLatency[GMAV_STATS_BUCKETS];
+		uint64_t	proxyDropped;
+	}	gmavi_stats_t;
+
+	/*
+	*	Live telemetry (gmavi_config_t::statsCallback), called on the thread that writes
+	*	the frames. Keep it short, the next frame waits for it.
+	*
+	*	@param	ctx				- gmavi_config_t::statsContext
+	*	@param	stats			- Counters at this point
+	*/
+	typedef void	(*gmavi_telemetry_t)(void* ctx, const gmavi_stats_t* stats);
+
+	/*
+	*	Extended recording options, initialise with gmav_config_default
+	*
+	*	@param	flags			- GMAV_FLAG_* bitmask
+	*	@param	queueDepth		- Frames buffered for the writer thread, 0 writes on the
+	*							  calling thread (default)
+	*	@param	queuePolicy		- GMAV_QUEUE_BLOCK or GMAV_QUEUE_DROP
+	*	@param	writerCpu		- CPU the writer thread is pinned to, -1 for none (default)
+	*	@param	ioEngine		- GMAV_ENGINE_* write engine
+	*	@param	ioDepth			- Frame writes in flight for GMAV_ENGINE_URING, 0 for the default (4)
+	*	@param	inputFormat		- GMAV_PIXEL_* layout of the frames passed to gmav_add
+	*	@param	inputStride		- Bytes between two input rows, 0 when rows are tightly packed
+	*	@param	streamFormat	- GMAV_STREAM_* layout stored in the file
+	*	@param	codec			- GMAV_CODEC_* compression
+	*	@param	codecThreads	- Threads encoding each frame in parallel (one slice each),
+	*							  0 for one per CPU
+	*	@param	checkpointFrames- Every this many frames the header is updated so a crashed
+	*							  recording stays readable up to there, 0 for only at the
+	*							  end of every RIFF segment (default)
+	*	@param	segmentSize		- Largest RIFF segment in bytes, 0 for the default (just under 2GB).
+	*							  0x40000000 (1GB) suits tools that expect it, larger segments
+	*							  mean fewer segments but are not read by every player
+	*	@param	maxSegments		- RIFF segments the recording may grow to, 0 for the default (256).
+	*							  Room is reserved in the header, 16 bytes per segment, adding a
+	*							  frame fails once all are used
+	*	@param	audioChannels	- Channels of an interleaved PCM audio stream fed with
+	*							  gmav_add_audio, 0 for no audio (default). Can not be combined
+	*							  with GMAV_FLAG_ALIGNED
+	*	@param	audioSampleRate	- Audio samples per second (of every channel)
+	*	@param	audioBits		- Bits per sample of one channel (8, 16, 24 or 32), 0 for 16
+	*	@param	writerThreads	- Writer threads shared by the passes of a gmav_session_open,
+	*							  0 for one per pass up to the amount of CPUs
+	*	@param	statsCallback	- Called every statsInterval frames written and once more when
+	*							  the file is finished, NULL for none (default)
+	*	@param	statsContext	- Passed to statsCallback
+	*	@param	statsInterval	- Frames between two statsCallback calls, 0 for every frame
+	*	@param	expectedFrames	- Frames the recording is expected to last (seconds * framesPerSec),
+	*							  disk space for them is reserved up front and more is reserved
+	*							  in growing steps when the estimate runs out. What is left
+	*							  over is released by gmav_finish. 0 for none (default)
+	*	@param	proxyPath		- Second file receiving every frame at a fraction of the size,
+	*							  NULL for none (default). Not available for GMAV_STREAM_V210
+	*	@param	proxyScale		- Proxy width and height are the recording's divided by this,
+	*							  2 or 4, 0 for 2
+	*	@param	hugePages		- GMAV_HUGE_* backing of gmav_alloc_frame buffers, and of the
+	*							  queue slots they are swapped with
+	*/
+	typedef struct	s_gmavi_config
+	{
+		uint32_t	flags;
+		uint32_t	queueDepth;
+		uint32_t	queuePolicy;
+		int32_t		writerCpu;
+		uint32_t	ioEngine;
+		uint32_t	ioDepth;
+		uint32_t	inputFormat;
+		uint32_t	inputStride;
+		uint32_t	streamFormat;
+		uint32_t	codec;
+		uint32_t	codecThreads;
+		uint32_t	checkpointFrames;
+		uint32_t	segmentSize;
+		uint32_t	maxSegments;
+		uint32_t	audioChannels;
+		uint32_t	audioSampleRate;
+		uint32_t	audioBits;
+		uint32_t	writerThreads;
+		gmavi_telemetry_t	statsCallback;
+		void*		statsContext;
+		uint32_t	statsInterval;
+		uint32_t	expectedFrames;
+		const char*	proxyPath;
+		uint32_t	proxyScale;
+		uint32_t	hugePages;
+	}	gmavi_config_t;
+
 	/*
 	*	Open a (new) file ready to receive frame data
 	*
@@ -43,20 +296,429 @@ extern "C" {
 	void* gmav_open(const char* filePath, uint32_t width, uint32_t height, uint32_t framesPerSec);
 
 	/*
-	*	Add a frame to the current file stream
+	*	Fill a config with the options used by gmav_open
+	*
+	*	@param	config			- Config to initialise
+	*/
+	void		gmav_config_default(gmavi_config_t* config);
+
+	/*
+	*	gmav_open with extended options
+	*
+	*	@param	config			- Recording options, NULL for the defaults
+	*	@return gmavi instance (void *)
+	*/
+	void*		gmav_open_ex(const char* filePath, uint32_t width, uint32_t height, uint32_t framesPerSec, const gmavi_config_t* config);
+
+	/*
+	*	Add a frame to the current file stream. With a queue the frame is copied
+	*	and written by the writer thread, @buffer can be reused right away.
+	*	Frames are converted from the configured input format on the way.
+	*
+	*	A buffer from gmav_alloc_frame is taken over instead: it goes back to the
+	*	pool by itself and must not be touched after this call. When it needs no
+	*	conversion it is queued as is, without a copy.
 	*
 	*	@param	gmavi			- gmavi instance
-	*	@param	buffer			- 24bits per pixel bitmap array (bottom first)
+	*	@param	buffer			- Bitmap in the configured input format, 24bits per pixel
+	*							  BGR bottom first by default
 	*/
 	bool		gmav_add(void* gmavi, uint8_t* buffer);
 
 	/*
-	*	Finish and close file
+	*	Frame sizes of an open recording, see gmav_get_layout
+	*
+	*	@param	inputSize		- Bytes gmav_add reads from every frame (inputStride included)
+	*	@param	streamSize		- Bytes of one stored frame, what gmav_acquire_frame hands out
+	*							  and gmav_add_stream reads
+	*	@param	chunkSize		- File bytes of every uncompressed frame chunk
+	*	@param	passthrough		- Input frames already are in the stream layout, nothing is
+	*							  converted, reversed or repacked
+	*/
+	typedef struct	s_gmavi_layout
+	{
+		uint32_t	inputSize;
+		uint32_t	streamSize;
+		uint32_t	chunkSize;
+		bool		passthrough;
+	}	gmavi_layout_t;
+
+	/*
+	*	@param	gmavi			- gmavi instance
+	*	@param	layout			- Filled in with the frame sizes
+	*/
+	bool		gmav_get_layout(void* gmavi, gmavi_layout_t* layout);
+
+	/*
+	*	Add a frame that already is in the stream layout, like gmav_add but without
+	*	looking at the input format: the frame goes to the write path (or queue) as
+	*	is. Buffers from gmav_alloc_frame are taken over, like with gmav_add.
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@param	frame			- gmavi_layout_t::streamSize bytes in the stream format
+	*/
+	bool		gmav_add_stream(void* gmavi, uint8_t* frame);
+
+	/*
+	*	Get a buffer for one input frame from the instance's pool, page aligned
+	*	and backed as gmavi_config_t::hugePages asks. Hand it to gmav_add, or back
+	*	with gmav_release_frame when it is not used. The pool grows to the amount
+	*	of buffers in use at once and lives until the instance is finished.
+	*	May be called from any thread.
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@return	Buffer of at least one input frame, NULL when no memory could be
+	*			mapped (the instance stays valid)
+	*/
+	uint8_t*	gmav_alloc_frame(void* gmavi);
+
+	/*
+	*	Hand a buffer from gmav_alloc_frame back without recording it. May be
+	*	called from any thread.
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@param	frame			- Buffer to return
+	*	@return	false when @frame is not a buffer handed out by this instance
+	*/
+	bool		gmav_release_frame(void* gmavi, uint8_t* frame);
+
+	/*
+	*	Get the buffer for the next frame, to be filled by the caller and
+	*	published with gmav_commit_frame. When possible this points straight
+	*	into a mapping of the output file, so no copy is made at all. Calling
+	*	it again before committing returns the same buffer. The buffer holds the
+	*	stream format as is, input conversion does not apply.
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@return	bitmapSize bytes in the stream format (bottom first unless GMAV_FLAG_TOPDOWN),
+	*			NULL on failure (the instance is released, like gmav_add)
+	*/
+	uint8_t*	gmav_acquire_frame(void* gmavi);
+
+	/*
+	*	Add the frame returned by gmav_acquire_frame to the stream
+	*
+	*	@param	gmavi			- gmavi instance
+	*/
+	bool		gmav_commit_frame(void* gmavi);
+
+	/*
+	*	Add audio to the stream, may be called from any thread. Samples are only
+	*	copied here, everything added between two frames goes out as a single
+	*	'01wb' chunk right in front of the next frame. What is left at the end is
+	*	written by gmav_finish.
+	*
+	*	@param	gmavi			- gmavi instance, opened with gmavi_config_t::audioChannels
+	*	@param	samples			- Interleaved PCM samples, little endian (8 bit is unsigned)
+	*	@param	count			- Samples per channel in @samples
+	*	@return	false when the samples could not be stored, the instance stays valid
+	*/
+	bool		gmav_add_audio(void* gmavi, const void* samples, uint32_t count);
+
+	/*
+	*	Counters of a recording so far. Safe to call from any thread while frames
+	*	are added, every counter is read atomically (not all at the same instant).
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@param	stats			- Filled in with the counters
+	*/
+	bool		gmav_get_stats(void* gmavi, gmavi_stats_t* stats);
+
+	/*
+	*	Finish and close file, queued frames are written first
 	*
 	*	@param	gmavi			- gmavi instance
 	*/
 	bool		gmav_finish(void* gmavi);
 
+	/*
+	*	Completion of gmav_finish_async, called on the thread that finished the file
+	*
+	*	@param	ctx				- Passed through from gmav_finish_async
+	*	@param	success			- What gmav_finish returned
+	*/
+	typedef void	(*gmavi_finished_t)(void* ctx, bool success);
+
+	/*
+	*	Finish and close the file on a thread of its own and return right away, so
+	*	stopping a recording does not stall the caller. The instance must not be
+	*	used anymore. Completion is reported to @callback and can be polled with
+	*	gmav_finish_done, the returned handle is released with gmav_finish_wait
+	*
+	*	@param	gmavi			- gmavi instance
+	*	@param	callback		- Called once the file is finished, NULL for none
+	*	@param	ctx				- Passed to callback
+	*	@return	Finish handle, NULL when no thread could be started. The file is then
+	*			finished before returning and only callback receives the result
+	*/
+	void*		gmav_finish_async(void* gmavi, gmavi_finished_t callback, void* ctx);
+
+	/*
+	*	Whether an asynchronous finish is done, never waits
+	*
+	*	@param	finish			- Handle returned by gmav_finish_async
+	*/
+	bool		gmav_finish_done(void* finish);
+
+	/*
+	*	Wait for an asynchronous finish and release its handle
+	*
+	*	@param	finish			- Handle returned by gmav_finish_async
+	*	@return	What gmav_finish returned
+	*/
+	bool		gmav_finish_wait(void* finish);
+
+	/*
+	*	One pass of a recording session, see gmav_session_open
+	*
+	*	@param	filePath		- Output file of this pass
+	*	@param	width			- Width of the video
+	*	@param	height			- Height of the video
+	*	@param	config			- Recording options of this pass, NULL for the defaults. The
+	*							  queue options are taken from the session instead
+	*/
+	typedef struct	s_gmavi_pass
+	{
+		const char*				filePath;
+		uint32_t				width;
+		uint32_t				height;
+		const gmavi_config_t*	config;
+	}	gmavi_pass_t;
+
+	/*
+	*	Record several passes of the same frames (color, depth, greenscreen) into one
+	*	file each. The passes share the frame rate and frame number and are committed
+	*	together with gmav_session_add, the frames are written by writer threads
+	*	shared between all passes so the passes no longer wait on each other.
+	*
+	*	@param	passes			- Output of every pass
+	*	@param	passCount		- Amount of @passes
+	*	@param	framesPerSec	- Frames per second of all passes
+	*	@param	config			- Session options, NULL for the defaults. Only queueDepth (frames
+	*							  buffered per writer thread, 0 for 2), queuePolicy, writerCpu
+	*							  (first of consecutive CPUs) and writerThreads are used
+	*	@return	session instance (void *), NULL on failure
+	*/
+	void*		gmav_session_open(const gmavi_pass_t* passes, uint32_t passCount, uint32_t framesPerSec, const gmavi_config_t* config);
+
+	/*
+	*	Add the next frame of every pass as one batch. The frames are converted and
+	*	copied before returning, the buffers can be reused right away. Under
+	*	GMAV_QUEUE_DROP the whole batch is dropped when any writer is behind, the
+	*	passes never go out of step.
+	*
+	*	@param	session			- Session instance
+	*	@param	buffers			- One frame per pass, in the order of the passes and each
+	*							  in its pass's input format
+	*	@return	false on failure, the session is released with all passes unfinished
+	*/
+	bool		gmav_session_add(void* session, uint8_t** buffers);
+
+	/*
+	*	Frame number shared by the passes: the batches added so far
+	*
+	*	@param	session			- Session instance
+	*/
+	uint32_t	gmav_session_frame(void* session);
+
+	/*
+	*	Writer instance of a pass, only to be used with gmav_add_audio
+	*
+	*	@param	session			- Session instance
+	*	@param	pass			- Index into the passes given to gmav_session_open
+	*/
+	void*		gmav_session_pass(void* session, uint32_t pass);
+
+	/*
+	*	Write everything still queued, finish every pass and release the session
+	*
+	*	@param	session			- Session instance
+	*	@return	false when any pass failed, the others are finished regardless
+	*/
+	bool		gmav_session_finish(void* session);
+
+	/*
+	*	Record across several drives: frame n goes to the file in directory n % @count,
+	*	each file with a writer thread of its own. Every stripe is a valid AVI at
+	*	1 / @count of the frame rate, gmav_merge_stripes joins them back together.
+	*
+	*	@param	directories		- One directory per stripe, preferably each on its own drive
+	*	@param	count			- Amount of @directories
+	*	@param	fileName		- Name of the file created in every directory
+	*	@param	config			- Recording options of every stripe, NULL for the defaults.
+	*							  queueDepth 0 means 2 here, audio is not supported. Under
+	*							  GMAV_QUEUE_DROP a frame is dropped from the recording as a
+	*							  whole, the stripes stay in order. writerCpu is the CPU of the
+	*							  first stripe's thread, the others follow consecutively
+	*	@return	striped instance (void *), NULL on failure
+	*/
+	void*		gmav_stripe_open(const char* const* directories, uint32_t count, const char* fileName,
+					uint32_t width, uint32_t height, uint32_t framesPerSec, const gmavi_config_t* config);
+
+	/*
+	*	gmav_add for a striped recording
+	*
+	*	@param	striped			- Striped instance
+	*	@param	buffer			- Bitmap in the configured input format
+	*/
+	bool		gmav_stripe_add(void* striped, uint8_t* buffer);
+
+	/*
+	*	Finish every stripe and release the striped recording
+	*
+	*	@param	striped			- Striped instance
+	*	@return	false when any stripe failed, the others are finished regardless
+	*/
+	bool		gmav_stripe_finish(void* striped);
+
+	/*
+	*	Join the stripes of gmav_stripe_open into one OpenDML file with its own
+	*	index. Payloads are copied as they are, nothing is converted or coded again.
+	*	Stripes cut short (recovered after a crash) are merged up to the first
+	*	frame missing from any of them.
+	*
+	*	@param	stripePaths		- Stripe files, in the order of the directories they were recorded to
+	*	@param	count			- Amount of @stripePaths
+	*	@param	filePath		- Merged output file
+	*/
+	bool		gmav_merge_stripes(const char* const* stripePaths, uint32_t count, const char* filePath);
+
+	/*
+	*	Repair a recording that was never finished (crash, power loss) in place. The
+	*	frames after the last checkpoint are found by walking the chunk headers, the
+	*	missing index and header fields are written and the cut off tail is removed.
+	*	Repeated frames (GMAV_FLAG_DEDUP) after the last completed RIFF segment are lost.
+	*
+	*	@param	filePath		- File written by libgmavi
+	*/
+	bool		gmav_recover(const char* filePath);
+
+	/*
+	*	Video stream of a file opened with gmav_open_read
+	*
+	*	@param	width			- Width of the video
+	*	@param	height			- Height of the video, negative when the bitmaps are stored top row first
+	*	@param	rate			- Frames per second is @rate / @scale
+	*	@param	scale
+	*	@param	frameCount		- Frames gmav_get_frame can return
+	*	@param	compression		- biCompression FourCC, 0 for uncompressed RGB
+	*	@param	bitCount		- Bits per pixel
+	*/
+	typedef struct	s_gmavi_info
+	{
+		uint32_t	width;
+		int32_t		height;
+		uint32_t	rate;
+		uint32_t	scale;
+		uint32_t	frameCount;
+		uint32_t	compression;
+		uint32_t	bitCount;
+	}	gmavi_info_t;
+
+	/*
+	*	Open a finished (or recovered) AVI file for reading. The whole file is
+	*	mapped read only and its index is read once, frames are then looked up
+	*	in constant time and never copied. Files without a usable index are
+	*	refused, gmav_recover rebuilds one.
+	*
+	*	@param	filePath		- AVI file, libgmavi's own or any other with an idx1 or OpenDML index
+	*	@return	reader instance (void *), NULL on failure
+	*/
+	void*		gmav_open_read(const char* filePath);
+
+	/*
+	*	Describe the video stream of a reader
+	*
+	*	@param	reader			- Reader instance
+	*	@param	info			- Filled in with the stream properties
+	*/
+	bool		gmav_get_info(void* reader, gmavi_info_t* info);
+
+	/*
+	*	Frame @index of the video stream, straight from the mapping. Repeated frames
+	*	(GMAV_FLAG_DEDUP) return the chunk they point at. Safe to call from several
+	*	threads at once, the pointer stays valid until gmav_close_read.
+	*
+	*	@param	reader			- Reader instance
+	*	@param	index			- Frame number, from 0 up to gmavi_info_t::frameCount
+	*	@param	size			- Receives the payload size in bytes, may be NULL
+	*	@return	The frame as stored (bitmap or coded chunk payload), NULL when @index is out of range
+	*/
+	const uint8_t*	gmav_get_frame(void* reader, uint32_t index, uint32_t* size);
+
+	/*
+	*	Receives the frames of gmav_read_range one after the other, in order
+	*
+	*	@param	ctx				- Passed through from gmav_read_range
+	*	@param	index			- Frame number
+	*	@param	frame			- The frame as gmav_get_frame returns it, only valid during the call
+	*	@param	size			- Payload size in bytes
+	*	@return	false to stop reading
+	*/
+	typedef bool	(*gmavi_frame_t)(void* ctx, uint32_t index, const uint8_t* frame, uint32_t size);
+
+	/*
+	*	Read @count frames from @start on in order, for playback and export. The
+	*	frames ahead are prefetched while @callback works on the current one, and
+	*	the ones behind are dropped from the system cache so a long read does not
+	*	push everything else out of memory
+	*
+	*	@param	reader			- Reader instance
+	*	@param	start			- First frame
+	*	@param	count			- Frames to read
+	*	@param	callback		- Called for every frame
+	*	@param	ctx				- Passed to @callback
+	*	@return	false when the range is out of bounds or @callback stopped early
+	*/
+	bool		gmav_read_range(void* reader, uint32_t start, uint32_t count, gmavi_frame_t callback, void* ctx);
+
+	/*
+	*	Unmap the file and release the reader
+	*
+	*	@param	reader			- Reader instance
+	*/
+	void		gmav_close_read(void* reader);
+
+	/*
+	*	Outcome of gmav_verify
+	*
+	*	@param	frames			- Frames in the file
+	*	@param	checked			- Frames that have a checksum (GMAV_FLAG_CHECKSUM). Frames
+	*							  recovered after a crash or written without the flag have none
+	*	@param	corrupt			- Checked frames whose payload no longer matches its checksum
+	*/
+	typedef struct	s_gmavi_verify
+	{
+		uint32_t	frames;
+		uint32_t	checked;
+		uint32_t	corrupt;
+	}	gmavi_verify_t;
+
+	/*
+	*	Receives every corrupt frame gmav_verify found, in ascending order
+	*
+	*	@param	ctx				- Passed through from gmav_verify
+	*	@param	index			- Frame number, as gmav_get_frame takes it
+	*/
+	typedef void	(*gmavi_corrupt_t)(void* ctx, uint32_t index);
+
+	/*
+	*	Check every frame of a file recorded with GMAV_FLAG_CHECKSUM against the
+	*	checksum stored with it. The frames are spread over @threads threads, all
+	*	reading the same mapping, and the pages checked are dropped from the system
+	*	cache again. Repeated frames (GMAV_FLAG_DEDUP) check the chunk they point at.
+	*
+	*	@param	filePath		- AVI file, finished or recovered
+	*	@param	threads			- Threads to check with, the calling thread included. 0 for one per CPU
+	*	@param	callback		- Called for every corrupt frame once all are checked, may be NULL
+	*	@param	ctx				- Passed to @callback
+	*	@param	result			- Filled in with the frame counts, may be NULL
+	*	@return	false when the file can not be read, true otherwise. A corrupt frame
+	*			does not fail the call, @result tells
+	*/
+	bool		gmav_verify(const char* filePath, uint32_t threads, gmavi_corrupt_t callback, void* ctx,
+					gmavi_verify_t* result);
+
 # ifdef __cplusplus
 }
 # endif
@@ -0,0 +1,339 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef LIBGMAVI_HPP
+# define LIBGMAVI_HPP
+# include <cstddef>
+# include <cstdint>
+# include <utility>
+# if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#  include <span>
+#  define LIBGMAVI_SPAN
+# endif
+# include "libgmavi.h"
+
+/*
+*	Header-only C++ layer over the C interface. Formats and the write engine are
+*	template arguments, so everything that only depends on them is settled at
+*	compile time and checked with static_assert instead of at every call.
+*/
+namespace gmav
+{
+	/*
+	*	Bytes per pixel of a GMAV_PIXEL_* input format, 0 for an unknown one
+	*/
+	constexpr uint32_t	pixel_size(uint32_t pixelFormat)
+	{
+		return GMAV_PIXEL_SIZE(pixelFormat);
+	}
+
+	/*
+	*	Bytes of one stored row of a GMAV_STREAM_* format, 0 when @width does not fit it
+	*/
+	constexpr size_t	stream_row_size(uint32_t streamFormat, uint32_t width)
+	{
+		return GMAV_STREAM_ROW_SIZE(streamFormat, width);
+	}
+
+	/*
+	*	Whether frames of @pixelFormat are stored in @streamFormat as they are, so
+	*	only a top-down mismatch or a padded input stride still needs a pass over them
+	*/
+	constexpr bool		is_passthrough(uint32_t pixelFormat, uint32_t streamFormat)
+	{
+		return (pixelFormat == GMAV_PIXEL_BGR24 && streamFormat == GMAV_STREAM_BGR24)
+			|| (pixelFormat == GMAV_PIXEL_BGRA32 && streamFormat == GMAV_STREAM_BGRA32);
+	}
+
+	/*
+	*	File bytes from one frame chunk to the next, including the JUNK padding of
+	*	GMAV_FLAG_ALIGNED
+	*/
+	constexpr size_t	frame_stride(size_t payload, bool aligned)
+	{
+		return GMAV_FRAME_STRIDE(payload, aligned);
+	}
+
+	/*
+	*	One recording, finished when it goes out of scope. Move-only, the file has
+	*	a single owner.
+	*
+	*	@tparam	PixelFormat		- GMAV_PIXEL_* layout of the frames passed to add
+	*	@tparam	Backend			- GMAV_ENGINE_* write engine
+	*	@tparam	StreamFormat	- GMAV_STREAM_* layout stored in the file
+	*
+	*	Every call mirrors its gmav_* counterpart. A failure of add, acquire or
+	*	commit releases the recording like in C, the writer is empty afterwards.
+	*	For a passthrough pair of formats add is compiled down to gmav_add_stream,
+	*	which skips the input format dispatch, whenever the opened recording has no
+	*	input stride or row order of its own to apply.
+	*/
+	template <uint32_t PixelFormat = GMAV_PIXEL_BGR24, uint32_t Backend = GMAV_ENGINE_SYNC,
+		uint32_t StreamFormat = GMAV_STREAM_BGR24>
+	class Writer
+	{
+		static_assert(pixel_size(PixelFormat) != 0, "Unknown GMAV_PIXEL_* format");
+		static_assert(Backend == GMAV_ENGINE_SYNC || Backend == GMAV_ENGINE_URING, "Unknown GMAV_ENGINE_* backend");
+		static_assert(StreamFormat <= GMAV_STREAM_V210, "Unknown GMAV_STREAM_* format");
+
+	public:
+		static constexpr uint32_t	pixelFormat = PixelFormat;
+		static constexpr uint32_t	backend = Backend;
+		static constexpr uint32_t	streamFormat = StreamFormat;
+		static constexpr uint32_t	bytesPerPixel = pixel_size(PixelFormat);
+		static constexpr bool		passthrough = is_passthrough(PixelFormat, StreamFormat);
+
+		/*
+		*	Bytes of one tightly packed input frame
+		*/
+		static constexpr size_t	frame_size(uint32_t width, uint32_t height)
+		{
+			return (size_t)width * bytesPerPixel * height;
+		}
+
+		/*
+		*	Bytes of one stored frame, what gmav_acquire_frame hands out
+		*/
+		static constexpr size_t	stream_size(uint32_t width, uint32_t height)
+		{
+			return stream_row_size(StreamFormat, width) * height;
+		}
+
+		/*
+		*	File bytes taken by every uncompressed frame
+		*/
+		static constexpr size_t	chunk_size(uint32_t width, uint32_t height, bool aligned)
+		{
+			return frame_stride(stream_size(width, height), aligned);
+		}
+
+		/*
+		*	Options gmav_open would use, with the template's formats and engine
+		*/
+		static gmavi_config_t	defaults() noexcept
+		{
+			gmavi_config_t	config;
+
+			gmav_config_default(&config);
+			return apply(config);
+		}
+
+		Writer() noexcept = default;
+
+		/*
+		*	Open a recording, test the writer for success
+		*
+		*	@param	config			- Recording options, the formats and engine are
+		*							  overridden by the template arguments
+		*/
+		Writer(const char* filePath, uint32_t width, uint32_t height, uint32_t framesPerSec,
+			const gmavi_config_t& config = defaults()) noexcept
+		{
+			gmavi_config_t	options = apply(config);
+
+			gmavi_layout_t	layout;
+
+			gmavi = gmav_open_ex(filePath, width, height, framesPerSec, &options);
+			if (gmavi == nullptr || !gmav_get_layout(gmavi, &layout))
+				return;
+			frameBytes = layout.inputSize;
+			streamBytes = layout.streamSize;
+			direct = passthrough && layout.passthrough;
+		}
+
+		Writer(Writer&& other) noexcept
+			: gmavi(std::exchange(other.gmavi, nullptr)),
+			frameBytes(other.frameBytes),
+			streamBytes(other.streamBytes),
+			direct(other.direct)
+		{
+		}
+
+		Writer&	operator=(Writer&& other) noexcept
+		{
+			if (this != &other)
+			{
+				finish();
+				gmavi = std::exchange(other.gmavi, nullptr);
+				frameBytes = other.frameBytes;
+				streamBytes = other.streamBytes;
+				direct = other.direct;
+			}
+			return *this;
+		}
+
+		Writer(const Writer&) = delete;
+		Writer&	operator=(const Writer&) = delete;
+
+		~Writer()
+		{
+			finish();
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return gmavi != nullptr;
+		}
+
+		/*
+		*	gmavi instance for the C functions, still owned by the writer
+		*/
+		void*	get() const noexcept
+		{
+			return gmavi;
+		}
+
+		/*
+		*	Bytes add reads from every frame
+		*/
+		size_t	input_size() const noexcept
+		{
+			return frameBytes;
+		}
+
+		/*
+		*	Add one frame of input_size() bytes, see gmav_add
+		*/
+		bool	add(const uint8_t* frame) noexcept
+		{
+			/*	gmav_add only reads the frame, unless it came from alloc_frame	*/
+			uint8_t	*data = const_cast<uint8_t*>(frame);
+
+			if constexpr (passthrough)
+			{
+				/*	Already the stream layout, straight to the write path	*/
+				if (direct)
+					return check(gmavi != nullptr && gmav_add_stream(gmavi, data));
+			}
+			return check(gmavi != nullptr && gmav_add(gmavi, data));
+		}
+
+		/*
+		*	Frame to fill and publish with commit, see gmav_acquire_frame
+		*/
+		uint8_t*	acquire_data() noexcept
+		{
+			uint8_t	*frame = gmavi != nullptr ? gmav_acquire_frame(gmavi) : nullptr;
+
+			check(frame != nullptr);
+			return frame;
+		}
+
+		bool	commit() noexcept
+		{
+			return check(gmavi != nullptr && gmav_commit_frame(gmavi));
+		}
+
+		/*
+		*	Pool buffer of input_size() bytes, see gmav_alloc_frame. Add it or
+		*	hand it back with release_frame
+		*/
+		uint8_t*	alloc_data() noexcept
+		{
+			return gmavi != nullptr ? gmav_alloc_frame(gmavi) : nullptr;
+		}
+
+		bool	release_frame(uint8_t* frame) noexcept
+		{
+			return gmavi != nullptr && gmav_release_frame(gmavi, frame);
+		}
+
+# ifdef LIBGMAVI_SPAN
+		/*
+		*	Add @frame, false without touching the recording when it is too small
+		*/
+		bool	add(std::span<const uint8_t> frame) noexcept
+		{
+			return frame.size() >= frameBytes && add(frame.data());
+		}
+
+		std::span<uint8_t>	acquire() noexcept
+		{
+			uint8_t	*frame = acquire_data();
+
+			return frame != nullptr ? std::span<uint8_t>(frame, streamBytes) : std::span<uint8_t>();
+		}
+
+		std::span<uint8_t>	alloc_frame() noexcept
+		{
+			uint8_t	*frame = alloc_data();
+
+			return frame != nullptr ? std::span<uint8_t>(frame, frameBytes) : std::span<uint8_t>();
+		}
+
+		bool	release_frame(std::span<uint8_t> frame) noexcept
+		{
+			return release_frame(frame.data());
+		}
+# endif
+
+		/*
+		*	See gmav_add_audio, the recording stays valid on failure
+		*/
+		bool	add_audio(const void* samples, uint32_t count) noexcept
+		{
+			return gmavi != nullptr && gmav_add_audio(gmavi, samples, count);
+		}
+
+		bool	stats(gmavi_stats_t& out) const noexcept
+		{
+			return gmavi != nullptr && gmav_get_stats(gmavi, &out);
+		}
+
+		/*
+		*	Finish the file now instead of at destruction, the writer is empty after
+		*
+		*	@return	What gmav_finish returned, false when there was nothing to finish
+		*/
+		bool	finish() noexcept
+		{
+			return gmavi != nullptr && gmav_finish(std::exchange(gmavi, nullptr));
+		}
+
+	private:
+		static gmavi_config_t	apply(gmavi_config_t config) noexcept
+		{
+			config.inputFormat = PixelFormat;
+			config.ioEngine = Backend;
+			config.streamFormat = StreamFormat;
+			return config;
+		}
+
+		/*	The C functions release the instance when they fail	*/
+		bool	check(bool success) noexcept
+		{
+			if (!success)
+				gmavi = nullptr;
+			return success;
+		}
+
+		void	*gmavi = nullptr;
+		size_t	frameBytes = 0;
+		size_t	streamBytes = 0;
+		bool	direct = false;
+	};
+}
+
+#endif
@@ -26,22 +26,33 @@
 #ifndef AVISTRUCT_H
 # define AVISTRUCT_H
 # include "msaviriff.h"
-# include <pshpack2.h>
+# ifdef _WIN32
+#  include <pshpack2.h>
+# endif
 # include <stdint.h>
+# include "gmav_io.h"
+# include "gmav_queue.h"
+# include "gmav_pixel.h"
+# include "gmav_codec.h"
+# include "gmav_crc.h"
 # include <limits.h>
 
 # define TO_BE_DETERMINED				0x0
 # define RIFF_MAX_SIZE					1999991696
-# define STATIC_HEADER_LIST_SIZE		4588
 # define STATIC_AVI_HEADER_SIZE			56
-# define STATIC_STREAM_LIST_SIZE		4244
 # define STATIC_STREAM_HEADER_SIZE		56
 # define STATIC_STREAM_FORMAT_SIZE		40
 # define STATIC_BITMAP_HEADER_SIZE		40
-# define STATIC_SUPER_INDEX_SIZE		4120
 # define STATIC_EXTENDED_LIST_SIZE		260
 # define STATIC_EXTENDED_HEADER_SIZE	248
-# define STATIC_JUNKFILL_SIZE			0xDF8
+# define STATIC_FORMAT_EXTRA_SIZE		16
+
+/*	List and chunk sizes that grow with the super index room of @n segments	*/
+# define STATIC_SUPER_INDEX_SIZE(n)		(24 + 16 * (n))
+# define STATIC_STREAM_LIST_SIZE(n)		(164 + 16 * (n))
+# define STATIC_HEADER_LIST_SIZE(n)		(508 + 16 * (n))
+# define STATIC_AUDIO_LIST_SIZE(n)		(126 + 16 * (n))
+# define STATIC_WAVE_FORMAT_SIZE		18
 # define STATIC_SUPER_INDEX_OFFSET		0x10
 # define STATIC_OLD_INDEX_OFFSET		0x10
 
@@ -190,8 +201,8 @@ typedef struct	_aviStreamHeader
 typedef struct	_bitMapInfoHeader
 {
 	uint32_t		size;
-	uint32_t		width;
-	uint32_t		height;
+	int32_t			width;
+	int32_t			height;
 	uint16_t		planes;
 	uint16_t		bitCount;
 	uint32_t		compression;
@@ -202,6 +213,30 @@ typedef struct	_bitMapInfoHeader
 	uint32_t		clrImportant;
 }	BITMAPINFOHEADER;
 
+# define	WAVE_FORMAT_PCM				0x0001
+
+/*
+*	WAVEFORMATEX
+*
+*	@param		formatTag				-	@WAVE_FORMAT_PCM
+*	@param		channels				-	Interleaved channels per sample
+*	@param		samplesPerSec			-	Sample rate
+*	@param		avgBytesPerSec			-	@samplesPerSec * @blockAlign
+*	@param		blockAlign				-	Bytes per sample of all channels
+*	@param		bitsPerSample			-	Bits per sample of one channel
+*	@param		size					-	Extra format bytes, 0 for PCM
+*/
+typedef struct	_waveFormatEx
+{
+	uint16_t		formatTag;
+	uint16_t		channels;
+	uint32_t		samplesPerSec;
+	uint32_t		avgBytesPerSec;
+	uint16_t		blockAlign;
+	uint16_t		bitsPerSample;
+	uint16_t		size;
+}	WAVEFORMATEX;
+
 /*
 *	AVISUPERINDEX_ENTRY
 *
@@ -229,7 +264,9 @@ typedef struct	_aviSuperIndex_entry
 *	@param				entriesInUse	-	?
 *	@param				chunkId			-	Chunk ID of chunks being indexed ('DIB '?)
 *	@param				reserved		-	Reserved 12 Bytes
-*	@param				index			-	Index entries pointing to field index chunk (@AVISTDINDEX)
+*
+*	Followed by the index entries pointing to field index chunks (@AVISUPERINDEX_ENTRY),
+*	room is reserved for as many as the recording may have segments
 */
 typedef struct	_aviSuperIndex
 {
@@ -241,7 +278,6 @@ typedef struct	_aviSuperIndex
 	uint32_t			entriesInUse;
 	uint32_t			chunkId;
 	uint32_t			reserved[3];
-	AVISUPERINDEX_ENTRY	index[AVI_MASTER_INDEX_SIZE];
 }	AVISUPERINDEX;
 
 /*
@@ -350,10 +386,21 @@ typedef struct s_gmavi_fileAddr
 	uint64_t			grandFrames;
 	uint64_t			cbMovi;
 	uint64_t			moviStart;
+	uint64_t			audioLength;
+	uint64_t			audioSuperIndex;
+	uint64_t			audioSuperIndexEntries;
 }   gmavi_fileAddr_t;
 
 /*
-*	Initial header that can be written upon opening	
+*	Initial header that can be written upon opening, laid out as
+*
+*		[gmavi_static_t][super index entries][gmavi_odml_t][JUNK fill]['movi' list]
+*
+*	The super index has room for @maxSegments entries and the JUNK fill puts the
+*	movi list on the next @GMAV_IO_SECTOR boundary (0x2000 for the default 256)
+*
+*	@formatExtra holds the codec's stream format extension (strf grows to cover it),
+*	or an empty JUNK chunk for uncompressed streams
 */
 typedef struct	s_gmavi_static
 {
@@ -364,44 +411,227 @@ typedef struct	s_gmavi_static
 	AVISTREAMHEADER		streamHeader;
 	RIFFCHUNK			strf;
 	BITMAPINFOHEADER	bitmapHeader;
+	uint8_t				formatExtra[STATIC_FORMAT_EXTRA_SIZE];
 	AVISUPERINDEX		superIndex;
+}   gmavi_static_t;
+
+/*
+*	Audio stream list, only present when recording audio. It follows the video
+*	super index entries and is followed by room for as many audio entries:
+*
+*		[gmavi_static_t][entries][gmavi_audio_t][entries][gmavi_odml_t]..
+*/
+typedef struct	s_gmavi_audio
+{
+	RIFFLIST			strl;
+	AVISTREAMHEADER		streamHeader;
+	RIFFCHUNK			strf;
+	WAVEFORMATEX		format;
+	AVISUPERINDEX		superIndex;
+}   gmavi_audio_t;
+
+typedef struct	s_gmavi_odml
+{
 	RIFFLIST			odml;
 	AVIEXTHEADER		extendedHeader;
 	RIFFCHUNK			junk;
-	uint8_t				junkFill[0xDF8];
-	RIFFLIST			movi;
-}   gmavi_static_t;
+}   gmavi_odml_t;
+
+
+/*
+*	Frame checksums of one segment (GMAV_FLAG_CHECKSUM), a JUNK chunk so players
+*	skip it. It closes the segment's movi list, right after its index chunks:
+*
+*		[JUNK][cb]['gmcs'][frames][CRC32C per frame ..][cb]
+*
+*	One checksum for every index entry of the segment, in order. The size repeated
+*	at the end finds the chunk from the idx1 that follows it in the first segment
+*/
+typedef struct	s_gmavi_checksums
+{
+	FOURCC				fcc;
+	uint32_t			cb;
+	FOURCC				signature;
+	uint32_t			frames;
+}	gmavi_checksums_t;
+
+# define	GMAV_CHECKSUM_SIGNATURE	FCC('gmcs')
+
+/*
+*	Aligned recording
+*
+*	Every frame payload starts on a @GMAV_IO_SECTOR boundary. A segment opens with a
+*	JUNK chunk followed by the first '00db' header (@moviLead bytes after 'movi'),
+*	after that each frame occupies one @streamTickSize stride:
+*
+*		[bitmap][pad][JUNK .. fill][next '00db' header]
+*
+*	Whatever is appended after the last frame of a segment overwrites that header.
+*/
+# define	GMAV_ALIGN_UP(x, a)		(((x) + ((a) - 1)) / (a) * (a))
+
+/*
+*	Zero-copy frames (gmav_acquire_frame) are handed out from a shared mapping of
+*	the output file, this much of the file is mapped (and grown) at once
+*/
+# define	GMAV_MAP_WINDOW			0x10000000
+
+/*
+*	Bytes of upcoming frames gmav_read_range keeps prefetched
+*/
+# define	GMAV_READ_AHEAD			0x4000000
+
+/*
+*	Frames gmav_verify checks per job, few enough to spread a file over its threads
+*/
+# define	GMAV_VERIFY_BATCH		64
 
+/*
+*	Index entries are generated when a segment closes, into a stage that starts
+*	at this many bytes and grows to hold all index chunks of the segment
+*/
+# define	GMAV_INDEX_STAGE		0x40000
+
+/*
+*	Header fields are patched in memory and written in batches. Ranges closer than
+*	@GMAV_PATCH_GAP bytes go out as one write, at most @GMAV_PATCH_MAX are kept
+*/
+# define	GMAV_PATCH_MAX			8
+# define	GMAV_PATCH_GAP			512
 
+/*
+*	Frames buffered per writer thread of a recording session or striped recording
+*	when no queueDepth is set
+*/
+# define	GMAV_SESSION_DEPTH		2
+
+/*
+*	Full resolution frames buffered for the proxy thread. A frame that finds them
+*	all in use is left out of the proxy instead of holding up the main recording
+*/
+# define	GMAV_PROXY_DEPTH		4
+
+/*
+*	Smallest amount of disk space reserved at once when a recording outgrows its
+*	expectedFrames estimate
+*/
+# define	GMAV_ALLOCATE_STEP		0x10000000
+
+/*
+*	ix00 (or ix01) of the segment being written, entries are only kept when recorded
+*/
 typedef struct	s_idxList
 {
 	AVISTDINDEX			avixIndex;
 	AVISTDINDEX_ENTRY	*avixIndexEntries;
+	uint32_t			capacity;
 }	t_idxList;
 
+/*
+*	Byte range [start, end) of the header changed since the last batch
+*/
+typedef struct	s_gmavi_patch
+{
+	uint32_t			start;
+	uint32_t			end;
+}	gmavi_patch_t;
+
+/*	Only pack these structs		*/
+#pragma pack(pop)
+# ifdef _WIN32
+#  include <poppack.h>
+# endif
+
 /*
 *	Avi handler struct, do not modify
 */
 typedef struct	s_gmavi
 {
 	char				*filePath;
-	FILE				*fileHandler;
+	const gmavi_io_t	*io;
+	void				*ioHandle;
+	uint64_t			writeOffset;
 	gmavi_static_t		contents;
 	gmavi_fileAddr_t	fileAddr;
 	AVIOLDINDEX			mainIndex;
-	AVIOLDINDEX_ENTRY	*mainIndexEntries;
-	t_idxList			ix00[256];
+	t_idxList			ix00;
+	uint32_t			maxSegments;
+	uint32_t			segmentSize;
+	uint32_t			headerSize;
 	uint32_t			frameCount;
 	uint32_t			bitmapSize;
 	uint32_t			streamTickSize;
 	uint32_t			riffSize;
-	uint64_t			fileSize;
 	uint32_t			moviSize;
 	uint32_t			maxFrames;
 	uint32_t			riffChunks;
+	uint32_t			flags;
+	uint32_t			moviLead;
+	uint8_t				*alignBuffer;
+	uint32_t			queuePolicy;
+	gmavi_queue_t		queue;
+	uint8_t				*mapBase;
+	uint64_t			mapOffset;
+	size_t				mapSize;
+	uint8_t				*stageBuffer;
+	gmavi_frames_t		frames;
+	uint8_t				*holdable;
+	uint8_t				*acquired;
+	uint64_t			acquiredOffset;
+	bool				extended;
+	uint64_t			allocated;
+	gmavi_convert_t		convert;
+	uint8_t				*convertBuffer;
+	uint32_t			chunkId;
+	uint32_t			segmentFrames;
+	gmavi_codec_t		*codec;
+	uint8_t				*encodeBuffer;
+	bool				recordIndex;
+	uint8_t				*lastFrame;
+	bool				lastValid;
+	gmavi_diff_t		frameDiff;
+	gmavi_crc_t			crc;
+	uint32_t			*checksums;
+	uint32_t			checksumCapacity;
+	uint8_t				*indexStage;
+	size_t				indexUsed;
+	size_t				indexCapacity;
+	uint8_t				*headerImage;
+	gmavi_patch_t		patches[GMAV_PATCH_MAX];
+	uint32_t			patchCount;
+	uint32_t			checkpointFrames;
+	gmavi_audio_t		audio;
+	uint32_t			blockAlign;
+	gmavi_mutex_t		audioLock;
+	uint8_t				*audioPending;
+	uint32_t			audioPendingSize;
+	uint32_t			audioPendingCapacity;
+	uint8_t				*audioChunk;
+	uint32_t			audioChunkSize;
+	uint32_t			audioChunkCapacity;
+	uint32_t			audioBytes;
+	t_idxList			ix01;
+	uint32_t			segmentAudio;
+	uint32_t			segmentSamples;
+	uint32_t			audioSamples;
+	uint32_t			oldCursor;
+	gmavi_stats_t		stats;
+	gmavi_telemetry_t	telemetry;
+	void				*telemetryContext;
+	uint32_t			telemetryInterval;
+	struct s_gmavi		*proxy;
+	gmavi_downscale_t	downscale;
+	uint32_t			proxyIndex;
 }	gmavi_t;
 
-/*	Only pack these structs		*/
-#pragma pack(pop)
+/*
+*	Used by the recording session (gmav_session.c) and striped recordings
+*	(gmav_stripe.c) to drive their writers
+*/
+void	*gmav_open_scaled(const char *filePath, uint32_t width, uint32_t height,
+			uint32_t framesPerSec, uint32_t scale, const gmavi_config_t *config);
+void	gmav_release(gmavi_t *avi);
+bool	gmav_write_frame(gmavi_t *avi, const uint8_t *buffer);
+bool	gmav_write_payload(gmavi_t *avi, const uint8_t *payload, uint32_t size);
 
 #endif
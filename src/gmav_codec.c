@@ -0,0 +1,450 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "gmav_codec.h"
+
+/*	Ut Video frame info: median prediction	*/
+# define GMAV_CODEC_PRED_MEDIAN		3
+
+static void	gmav_put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t)value;
+	dst[1] = (uint8_t)(value >> 8);
+	dst[2] = (uint8_t)(value >> 16);
+	dst[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t	gmav_slice_start(const gmavi_codec_t *codec, uint32_t slice)
+{
+	return ((uint32_t)((uint64_t)codec->height * slice / codec->slices));
+}
+
+/*
+*	Coded data of @slice in @plane, room for the raw slice plus word padding
+*/
+static uint8_t	*gmav_slice_bits(const gmavi_codec_t *codec, uint32_t slice, uint32_t plane)
+{
+	size_t	planeSize = (size_t)codec->width * codec->height + 4 * codec->slices;
+
+	return (codec->bits + planeSize * plane
+		+ (size_t)gmav_slice_start(codec, slice) * codec->width + 4 * slice);
+}
+
+/*
+*	One row of plane samples. Blue and red are stored as their difference to green
+*/
+static void	gmav_plane_row(const gmavi_codec_t *codec, uint32_t plane, uint32_t y, uint8_t *row)
+{
+	const uint8_t	*src = codec->source + (size_t)y * codec->width * codec->pixelSize;
+	uint32_t		step = codec->pixelSize;
+
+	switch (plane)
+	{
+		case 0:
+			for (uint32_t x = 0; x < codec->width; x++)
+				row[x] = src[x * step + 1];
+			break ;
+		case 1:
+			for (uint32_t x = 0; x < codec->width; x++)
+				row[x] = (uint8_t)(src[x * step] - src[x * step + 1] + 0x80);
+			break ;
+		case 2:
+			for (uint32_t x = 0; x < codec->width; x++)
+				row[x] = (uint8_t)(src[x * step + 2] - src[x * step + 1] + 0x80);
+			break ;
+		default:
+			for (uint32_t x = 0; x < codec->width; x++)
+				row[x] = src[x * step + 3];
+	}
+}
+
+static uint8_t	gmav_median(uint8_t a, uint8_t b, uint8_t c)
+{
+	if (a > b)
+	{
+		uint8_t	swap = a;
+
+		a = b;
+		b = swap;
+	}
+	if (c <= a)
+		return (a);
+	if (c >= b)
+		return (b);
+	return (c);
+}
+
+/*
+*	Prediction of one slice, all planes. The first row is left predicted starting
+*	from 0x80, the rest is median predicted with the left and top-left neighbours
+*	carried over from the end of the previous row
+*/
+static void	gmav_predict_slice(void *ctx, uint32_t slice)
+{
+	gmavi_codec_t	*codec = (gmavi_codec_t *)ctx;
+	uint32_t		start = gmav_slice_start(codec, slice);
+	uint32_t		end = gmav_slice_start(codec, slice + 1);
+	uint32_t		width = codec->width;
+
+	for (uint32_t p = 0; p < codec->planes; p++) {
+		uint32_t	*count = codec->counts + ((size_t)slice * codec->planes + p) * 256;
+		uint8_t		*out = codec->residual + ((size_t)p * codec->height + start) * width;
+		uint8_t		*cur = codec->rows + (size_t)slice * 2 * width;
+		uint8_t		*above = cur + width;
+		uint8_t		left = 0;
+		uint8_t		leftTop = 0;
+
+		memset(count, 0, 256 * sizeof(uint32_t));
+		for (uint32_t y = start; y < end; y++) {
+			gmav_plane_row(codec, p, y, cur);
+			if (y == start)
+			{
+				uint8_t	prev = 0x80;
+
+				for (uint32_t x = 0; x < width; x++) {
+					out[x] = (uint8_t)(cur[x] - prev);
+					prev = cur[x];
+				}
+			}
+			else
+			{
+				for (uint32_t x = 0; x < width; x++) {
+					uint8_t	pred = gmav_median(left, above[x], (uint8_t)(left + above[x] - leftTop));
+
+					leftTop = above[x];
+					left = cur[x];
+					out[x] = (uint8_t)(cur[x] - pred);
+				}
+			}
+			for (uint32_t x = 0; x < width; x++)
+				count[out[x]] += 1;
+
+			uint8_t	*swap = cur;
+
+			cur = above;
+			above = swap;
+			out += width;
+		}
+	}
+}
+
+static int	gmav_leaf_cmp(const void *a, const void *b)
+{
+	const uint64_t	*left = (const uint64_t *)a;
+	const uint64_t	*right = (const uint64_t *)b;
+
+	return ((*left > *right) - (*left < *right));
+}
+
+/*
+*	Huffman code lengths of the used symbols in @weights
+*
+*	@return	longest code
+*/
+static uint32_t	gmav_huff_build(const uint64_t *weights, uint8_t *lengths)
+{
+	uint64_t	leaves[256];
+	uint64_t	weight[511];
+	uint32_t	parent[511];
+	uint32_t	n = 0;
+
+	/*	Weight in the high bits, symbol in the low byte keeps the sort stable	*/
+	for (uint32_t i = 0; i < 256; i++) {
+		if (weights[i])
+			leaves[n++] = (weights[i] << 8) | i;
+	}
+	qsort(leaves, n, sizeof(uint64_t), gmav_leaf_cmp);
+	for (uint32_t i = 0; i < n; i++)
+		weight[i] = leaves[i] >> 8;
+
+	/*	Two queues: sorted leaves and internal nodes, which are created in order	*/
+	uint32_t	leaf = 0;
+	uint32_t	node = n;
+
+	for (uint32_t next = n; next < 2 * n - 1; next++) {
+		uint32_t	pick[2];
+
+		for (int k = 0; k < 2; k++) {
+			if (leaf < n && (node >= next || weight[leaf] <= weight[node]))
+				pick[k] = leaf++;
+			else
+				pick[k] = node++;
+		}
+		weight[next] = weight[pick[0]] + weight[pick[1]];
+		parent[pick[0]] = next;
+		parent[pick[1]] = next;
+	}
+
+	uint32_t	depth[511];
+	uint32_t	longest = 0;
+
+	depth[2 * n - 2] = 0;
+	for (uint32_t i = 2 * n - 2; i-- > 0;)
+		depth[i] = depth[parent[i]] + 1;
+	memset(lengths, 0xFF, 256);
+	for (uint32_t i = 0; i < n; i++) {
+		lengths[leaves[i] & 0xFF] = (uint8_t)depth[i];
+		if (depth[i] > longest)
+			longest = depth[i];
+	}
+	return (longest);
+}
+
+/*
+*	Code lengths for one plane, flattened until no code exceeds @GMAV_CODEC_MAX_CODE
+*/
+static void	gmav_huff_lengths(const uint64_t *counts, uint8_t *lengths)
+{
+	uint64_t	weights[256];
+
+	memcpy(weights, counts, sizeof(weights));
+	while (gmav_huff_build(weights, lengths) > GMAV_CODEC_MAX_CODE) {
+		for (uint32_t i = 0; i < 256; i++) {
+			if (weights[i])
+				weights[i] = (weights[i] >> 1) | 1;
+		}
+	}
+}
+
+/*
+*	Every slice has to code into no more than its raw size
+*/
+static bool	gmav_huff_fits(const gmavi_codec_t *codec, uint32_t plane)
+{
+	for (uint32_t s = 0; s < codec->slices; s++) {
+		const uint32_t	*count = codec->counts + ((size_t)s * codec->planes + plane) * 256;
+		uint64_t		bits = 0;
+		uint64_t		samples = 0;
+
+		for (uint32_t i = 0; i < 256; i++) {
+			if (count[i])
+				bits += (uint64_t)count[i] * codec->lengths[plane][i];
+			samples += count[i];
+		}
+		if (bits > samples * 8)
+			return (false);
+	}
+	return (true);
+}
+
+/*
+*	Canonical codes in Ut Video order: longest codes first, and within one
+*	length the highest symbol first, counting up from zero
+*/
+static void	gmav_huff_codes(const uint8_t *lengths, uint32_t *codes)
+{
+	uint32_t	code = 0;
+
+	for (uint32_t len = GMAV_CODEC_MAX_CODE; len > 0; len--) {
+		for (uint32_t sym = 256; sym-- > 0;) {
+			if (lengths[sym] != len)
+				continue ;
+			codes[sym] = code >> (32 - len);
+			code += 0x80000000u >> (len - 1);
+		}
+	}
+}
+
+/*
+*	Huffman coding of one slice, all planes. Bits are packed MSB first into
+*	little endian 32 bit words
+*/
+static void	gmav_code_slice(void *ctx, uint32_t slice)
+{
+	gmavi_codec_t	*codec = (gmavi_codec_t *)ctx;
+	uint32_t		start = gmav_slice_start(codec, slice);
+	size_t			samples = (size_t)(gmav_slice_start(codec, slice + 1) - start) * codec->width;
+
+	for (uint32_t p = 0; p < codec->planes; p++) {
+		const uint8_t	*src = codec->residual + ((size_t)p * codec->height + start) * codec->width;
+		const uint8_t	*lengths = codec->lengths[p];
+		const uint32_t	*codes = codec->codes[p];
+		uint8_t			*begin = gmav_slice_bits(codec, slice, p);
+		uint8_t			*dst = begin;
+		uint64_t		acc = 0;
+		uint32_t		count = 0;
+
+		if (codec->single[p])
+		{
+			codec->bitSize[slice * codec->planes + p] = 0;
+			continue ;
+		}
+		for (size_t i = 0; i < samples; i++) {
+			acc = (acc << lengths[src[i]]) | codes[src[i]];
+			count += lengths[src[i]];
+			if (count >= 32)
+			{
+				count -= 32;
+				gmav_put_le32(dst, (uint32_t)(acc >> count));
+				dst += 4;
+			}
+		}
+		if (count)
+		{
+			gmav_put_le32(dst, (uint32_t)(acc << (32 - count)));
+			dst += 4;
+		}
+		codec->bitSize[slice * codec->planes + p] = (size_t)(dst - begin);
+	}
+}
+
+/*
+*	One Huffman table per plane from the counts of all slices
+*/
+static void	gmav_codec_tables(gmavi_codec_t *codec)
+{
+	for (uint32_t p = 0; p < codec->planes; p++) {
+		uint64_t	counts[256];
+		uint32_t	used = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t s = 0; s < codec->slices; s++) {
+			const uint32_t	*slice = codec->counts + ((size_t)s * codec->planes + p) * 256;
+
+			for (uint32_t i = 0; i < 256; i++)
+				counts[i] += slice[i];
+		}
+		for (uint32_t i = 0; i < 256; i++)
+			used += counts[i] != 0;
+
+		/*	A plane of one symbol is stored as that symbol with length 0 and no data	*/
+		codec->single[p] = used == 1;
+		if (codec->single[p])
+		{
+			memset(codec->lengths[p], 0xFF, 256);
+			for (uint32_t i = 0; i < 256; i++) {
+				if (counts[i])
+					codec->lengths[p][i] = 0;
+			}
+			continue ;
+		}
+		gmav_huff_lengths(counts, codec->lengths[p]);
+		/*	Plain 8 bit codes when the Huffman codes do not beat them	*/
+		if (!gmav_huff_fits(codec, p))
+			memset(codec->lengths[p], 8, 256);
+		gmav_huff_codes(codec->lengths[p], codec->codes[p]);
+	}
+}
+
+bool	gmav_codec_start(
+	gmavi_codec_t *codec,
+	uint32_t width,
+	uint32_t height,
+	uint32_t pixelSize,
+	uint32_t threads)
+{
+	memset(codec, 0, sizeof(gmavi_codec_t));
+	if (width == 0 || height == 0 || (pixelSize != 3 && pixelSize != 4))
+		return (false);
+	codec->fourcc = pixelSize == 4 ? 0x41524C55 : 0x47524C55;	/*	'ULRA' / 'ULRG'	*/
+	codec->width = width;
+	codec->height = height;
+	codec->pixelSize = pixelSize;
+	codec->planes = pixelSize == 4 ? 4 : 3;
+	codec->slices = threads ? threads : 1;
+	if (codec->slices > GMAV_CODEC_MAX_SLICES)
+		codec->slices = GMAV_CODEC_MAX_SLICES;
+	if (codec->slices > height)
+		codec->slices = height;
+
+	size_t	planeSize = (size_t)width * height;
+
+	codec->residual = (uint8_t *)malloc(planeSize * codec->planes);
+	codec->counts = (uint32_t *)malloc((size_t)codec->slices * codec->planes * 256 * sizeof(uint32_t));
+	codec->bits = (uint8_t *)malloc((planeSize + 4 * codec->slices) * codec->planes);
+	codec->bitSize = (size_t *)calloc((size_t)codec->slices * codec->planes, sizeof(size_t));
+	codec->rows = (uint8_t *)malloc((size_t)codec->slices * 2 * width);
+	if (codec->residual == NULL || codec->counts == NULL || codec->bits == NULL
+		|| codec->bitSize == NULL || codec->rows == NULL
+		|| !gmav_pool_start(&codec->pool, codec->slices - 1))
+		return (false);
+
+	/*	Encoder version, original format, frame info size and flags	*/
+	uint8_t	*extra = codec->extraData;
+
+	extra[0] = 0x0F;
+	extra[1] = 0x00;
+	extra[2] = 0x00;
+	extra[3] = 0x01;
+	gmav_put_le32(extra + 4, pixelSize == 4 ? 0x18020000 : 0x18010000);
+	gmav_put_le32(extra + 8, 4);
+	gmav_put_le32(extra + 12, ((codec->slices - 1) << 24) | 1);
+	return (true);
+}
+
+size_t	gmav_codec_bound(
+	const gmavi_codec_t *codec)
+{
+	return ((256 + 8 * (size_t)codec->slices + (size_t)codec->width * codec->height) * codec->planes + 4);
+}
+
+size_t	gmav_codec_encode(
+	gmavi_codec_t *codec,
+	uint8_t *dst,
+	const uint8_t *src)
+{
+	uint8_t	*out = dst;
+
+	codec->source = src;
+	gmav_pool_run(&codec->pool, gmav_predict_slice, codec, codec->slices);
+	gmav_codec_tables(codec);
+	gmav_pool_run(&codec->pool, gmav_code_slice, codec, codec->slices);
+
+	/*	Per plane: code lengths, slice end offsets, slice data	*/
+	for (uint32_t p = 0; p < codec->planes; p++) {
+		uint32_t	offset = 0;
+
+		memcpy(out, codec->lengths[p], 256);
+		out += 256;
+		for (uint32_t s = 0; s < codec->slices; s++) {
+			offset += (uint32_t)codec->bitSize[s * codec->planes + p];
+			gmav_put_le32(out, offset);
+			out += 4;
+		}
+		for (uint32_t s = 0; s < codec->slices; s++) {
+			size_t	size = codec->bitSize[s * codec->planes + p];
+
+			memcpy(out, gmav_slice_bits(codec, s, p), size);
+			out += size;
+		}
+	}
+	gmav_put_le32(out, GMAV_CODEC_PRED_MEDIAN << 8);
+	out += 4;
+	return ((size_t)(out - dst));
+}
+
+void	gmav_codec_destroy(
+	gmavi_codec_t *codec)
+{
+	gmav_pool_destroy(&codec->pool);
+	free(codec->residual);
+	free(codec->counts);
+	free(codec->bits);
+	free(codec->bitSize);
+	free(codec->rows);
+	memset(codec, 0, sizeof(gmavi_codec_t));
+}
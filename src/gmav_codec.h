@@ -0,0 +1,103 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_CODEC_H
+# define GMAV_CODEC_H
+# include <stdint.h>
+# include <stdbool.h>
+# include <stddef.h>
+# include "gmav_pool.h"
+
+/*	Ut Video allows up to 256 slices per plane	*/
+# define GMAV_CODEC_MAX_SLICES		256
+# define GMAV_CODEC_MAX_PLANES		4
+/*	Longest Huffman code the encoder produces	*/
+# define GMAV_CODEC_MAX_CODE		24
+# define GMAV_CODEC_EXTRA_SIZE		16
+
+/*
+*	Lossless Ut Video (ULRG / ULRA) encoder
+*
+*	Every plane (G, B - G, R - G and alpha) is median predicted per slice and
+*	Huffman coded with one table per plane. Slices are independent, so both the
+*	prediction and the coding run as one job per slice on @pool.
+*
+*	@param	fourcc			-	'ULRG' for 24bpp, 'ULRA' for 32bpp sources
+*	@param	pixelSize		-	Bytes per source pixel, BGR(A) order, rows top first
+*	@param	slices			-	Horizontal slices per plane
+*	@param	residual		-	Predicted planes, @planes * @width * @height
+*	@param	counts			-	Symbol counts per slice and plane
+*	@param	bits			-	Coded slices, every slice has room for its raw size
+*	@param	bitSize			-	Coded bytes per slice and plane
+*	@param	rows			-	Two rows of plane samples per slice
+*	@param	lengths			-	Code lengths per plane, 0xFF for unused symbols
+*	@param	codes			-	Codes per plane
+*	@param	single			-	Plane holds one symbol only and is not coded
+*	@param	extraData		-	Stream format extension following the BITMAPINFOHEADER
+*/
+typedef struct	s_gmavi_codec
+{
+	uint32_t		fourcc;
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		planes;
+	uint32_t		pixelSize;
+	uint32_t		slices;
+	uint8_t			*residual;
+	uint32_t		*counts;
+	uint8_t			*bits;
+	size_t			*bitSize;
+	uint8_t			*rows;
+	uint8_t			lengths[GMAV_CODEC_MAX_PLANES][256];
+	uint32_t		codes[GMAV_CODEC_MAX_PLANES][256];
+	bool			single[GMAV_CODEC_MAX_PLANES];
+	const uint8_t	*source;
+	gmavi_pool_t	pool;
+	uint8_t			extraData[GMAV_CODEC_EXTRA_SIZE];
+}	gmavi_codec_t;
+
+/*
+*	@param	threads			-	Threads encoding in parallel, including the caller
+*/
+bool	gmav_codec_start(gmavi_codec_t *codec, uint32_t width, uint32_t height, uint32_t pixelSize, uint32_t threads);
+
+/*
+*	Largest frame gmav_codec_encode can produce
+*/
+size_t	gmav_codec_bound(const gmavi_codec_t *codec);
+
+/*
+*	Encode one frame into @dst (gmav_codec_bound bytes)
+*
+*	@return	size of the coded frame
+*/
+size_t	gmav_codec_encode(gmavi_codec_t *codec, uint8_t *dst, const uint8_t *src);
+
+/*
+*	Safe on a zeroed codec
+*/
+void	gmav_codec_destroy(gmavi_codec_t *codec);
+
+#endif
@@ -0,0 +1,42 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_CRC_H
+# define GMAV_CRC_H
+# include <stdint.h>
+# include <stddef.h>
+
+/*
+*	CRC32C (Castagnoli) of @size bytes, continuing from @crc. Start from 0, the
+*	result of one call can be passed on to checksum data given in pieces
+*/
+typedef uint32_t	(*gmavi_crc_t)(uint32_t crc, const uint8_t *data, size_t size);
+
+/*
+*	Fastest CRC32C this CPU offers (SSE4.2, ARMv8 CRC or slicing-by-8 tables)
+*/
+gmavi_crc_t	gmav_select_crc(void);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+#include <stdlib.h>
+#include "../include/libgmavi.h"
+#include "gmav_thread.h"
+
+/*
+*	Finish running on a thread of its own
+*
+*	@param	gmavi			- Instance being finished, handed over by the caller
+*	@param	callback		- Called once finished, may be NULL
+*	@param	ctx				- Passed to @callback
+*	@param	started			- @thread runs and has to be joined
+*	@param	done			- The file is finished (or failed), guarded by @lock
+*	@param	success			- Result of gmav_finish, valid once @done
+*/
+typedef struct	s_gmavi_finish
+{
+	void				*gmavi;
+	gmavi_finished_t	callback;
+	void				*ctx;
+	gmavi_thread_t		thread;
+	bool				started;
+	bool				done;
+	bool				success;
+	gmavi_mutex_t		lock;
+	gmavi_cond_t		finished;
+}	gmavi_finish_t;
+
+static void	gmav_finish_run(void *arg)
+{
+	gmavi_finish_t	*finish = (gmavi_finish_t *)arg;
+	bool			success = gmav_finish(finish->gmavi);
+
+	if (finish->callback != NULL)
+		finish->callback(finish->ctx, success);
+	gmav_mutex_lock(&finish->lock);
+	finish->success = success;
+	finish->done = true;
+	gmav_cond_broadcast(&finish->finished);
+	gmav_mutex_unlock(&finish->lock);
+}
+
+/*
+*	Nothing to hand the work to, finish on the caller's thread after all
+*/
+static void	*gmav_finish_here(void *gmavi, gmavi_finished_t callback, void *ctx)
+{
+	bool	success = gmav_finish(gmavi);
+
+	if (callback != NULL)
+		callback(ctx, success);
+	return (NULL);
+}
+
+void	*gmav_finish_async(
+	void *gmavi,
+	gmavi_finished_t callback,
+	void *ctx)
+{
+	gmavi_finish_t	*finish = (gmavi_finish_t *)calloc(1, sizeof(gmavi_finish_t));
+
+	if (finish == NULL)
+		return (gmav_finish_here(gmavi, callback, ctx));
+	if (!gmav_mutex_init(&finish->lock))
+	{
+		free(finish);
+		return (gmav_finish_here(gmavi, callback, ctx));
+	}
+	if (!gmav_cond_init(&finish->finished))
+	{
+		gmav_mutex_destroy(&finish->lock);
+		free(finish);
+		return (gmav_finish_here(gmavi, callback, ctx));
+	}
+	finish->gmavi = gmavi;
+	finish->callback = callback;
+	finish->ctx = ctx;
+	finish->started = gmav_thread_start(&finish->thread, gmav_finish_run, finish, -1);
+	if (!finish->started)
+		gmav_finish_run(finish);
+	return (finish);
+}
+
+bool	gmav_finish_done(
+	void *handle)
+{
+	gmavi_finish_t	*finish = (gmavi_finish_t *)handle;
+	bool			done;
+
+	if (finish == NULL)
+		return (true);
+	gmav_mutex_lock(&finish->lock);
+	done = finish->done;
+	gmav_mutex_unlock(&finish->lock);
+	return (done);
+}
+
+bool	gmav_finish_wait(
+	void *handle)
+{
+	gmavi_finish_t	*finish = (gmavi_finish_t *)handle;
+	bool			success;
+
+	if (finish == NULL)
+		return (false);
+	gmav_mutex_lock(&finish->lock);
+	while (!finish->done)
+		gmav_cond_wait(&finish->finished, &finish->lock);
+	success = finish->success;
+	gmav_mutex_unlock(&finish->lock);
+	if (finish->started)
+		gmav_thread_join(&finish->thread);
+	gmav_cond_destroy(&finish->finished);
+	gmav_mutex_destroy(&finish->lock);
+	free(finish);
+	return (success);
+}
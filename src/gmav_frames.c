@@ -0,0 +1,215 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "gmav_frames.h"
+#include "../include/libgmavi.h"
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+/*
+*	Map @size bytes backed the way @huge asks, falling back to transparent and
+*	then plain pages when the system has no huge pages to give
+*/
+static uint8_t	*gmav_frames_map(size_t size, uint32_t huge)
+{
+#ifdef _WIN32
+	void	*buffer = NULL;
+	SIZE_T	large = GetLargePageMinimum();
+
+	/*	Large pages need SeLockMemoryPrivilege, without it the call just fails	*/
+	if (huge == GMAV_HUGE_EXPLICIT && large && size % large == 0)
+		buffer = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (buffer == NULL)
+		buffer = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	return ((uint8_t *)buffer);
+#else
+	void	*buffer = MAP_FAILED;
+
+# ifdef MAP_HUGETLB
+	if (huge == GMAV_HUGE_EXPLICIT)
+		buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (buffer != MAP_FAILED)
+		return ((uint8_t *)buffer);
+# endif
+	if (huge == GMAV_HUGE_NONE)
+	{
+		buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return (buffer == MAP_FAILED ? NULL : (uint8_t *)buffer);
+	}
+
+	/*	Transparent huge pages only back huge page aligned ranges, map one more
+		and cut off what lies outside	*/
+	uint8_t	*raw = (uint8_t *)mmap(NULL, size + GMAV_HUGE_PAGE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if ((void *)raw == MAP_FAILED)
+		return (NULL);
+
+	size_t	lead = (GMAV_HUGE_PAGE - (uintptr_t)raw % GMAV_HUGE_PAGE) % GMAV_HUGE_PAGE;
+
+	if (lead)
+		munmap(raw, lead);
+	munmap(raw + lead + size, GMAV_HUGE_PAGE - lead);
+# ifdef MADV_HUGEPAGE
+	madvise(raw + lead, size, MADV_HUGEPAGE);
+# endif
+	return (raw + lead);
+#endif
+}
+
+static void	gmav_frames_unmap(uint8_t *buffer, size_t size)
+{
+#ifdef _WIN32
+	(void)size;
+	VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+	munmap(buffer, size);
+#endif
+}
+
+bool	gmav_frames_setup(
+	gmavi_frames_t *frames,
+	size_t size,
+	uint32_t huge)
+{
+#ifdef _WIN32
+	SYSTEM_INFO	system;
+
+	GetSystemInfo(&system);
+	size_t		page = system.dwPageSize;
+#else
+	size_t		page = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+
+	memset(frames, 0, sizeof(gmavi_frames_t));
+	if (huge != GMAV_HUGE_NONE)
+		page = GMAV_HUGE_PAGE;
+	frames->size = (size + page - 1) / page * page;
+	frames->huge = huge;
+	frames->ready = gmav_mutex_init(&frames->lock);
+	return (frames->ready);
+}
+
+/*
+*	Room for one more buffer in both lists
+*/
+static bool	gmav_frames_grow(gmavi_frames_t *frames)
+{
+	if (frames->count < frames->capacity)
+		return (true);
+
+	uint32_t	capacity = frames->capacity ? frames->capacity * 2 : 8;
+	uint8_t		**buffers = (uint8_t **)realloc(frames->buffers, sizeof(uint8_t *) * capacity);
+
+	if (buffers == NULL)
+		return (false);
+	frames->buffers = buffers;
+
+	uint8_t		**idle = (uint8_t **)realloc(frames->idle, sizeof(uint8_t *) * capacity);
+
+	if (idle == NULL)
+		return (false);
+	frames->idle = idle;
+	frames->capacity = capacity;
+	return (true);
+}
+
+uint8_t	*gmav_frames_take(
+	gmavi_frames_t *frames)
+{
+	uint8_t	*buffer = NULL;
+
+	gmav_mutex_lock(&frames->lock);
+	if (frames->idleCount)
+		buffer = frames->idle[--frames->idleCount];
+	else if (gmav_frames_grow(frames) && (buffer = gmav_frames_map(frames->size, frames->huge)) != NULL)
+		frames->buffers[frames->count++] = buffer;
+	gmav_mutex_unlock(&frames->lock);
+	return (buffer);
+}
+
+/*
+*	Position of @buffer in @list, @count when it is not there
+*/
+static uint32_t	gmav_frames_find(uint8_t *const *list, uint32_t count, const uint8_t *buffer)
+{
+	uint32_t	i = 0;
+
+	while (i < count && list[i] != buffer)
+		i++;
+	return (i);
+}
+
+bool	gmav_frames_give(
+	gmavi_frames_t *frames,
+	uint8_t *buffer)
+{
+	bool	owned;
+
+	if (!frames->ready || buffer == NULL)
+		return (false);
+	gmav_mutex_lock(&frames->lock);
+	/*	A buffer handed back twice would later be handed out twice	*/
+	owned = gmav_frames_find(frames->buffers, frames->count, buffer) < frames->count
+		&& gmav_frames_find(frames->idle, frames->idleCount, buffer) == frames->idleCount;
+	if (owned)
+		frames->idle[frames->idleCount++] = buffer;
+	gmav_mutex_unlock(&frames->lock);
+	return (owned);
+}
+
+bool	gmav_frames_owns(
+	gmavi_frames_t *frames,
+	const uint8_t *buffer)
+{
+	bool	owned;
+
+	if (!frames->ready || buffer == NULL)
+		return (false);
+	gmav_mutex_lock(&frames->lock);
+	owned = gmav_frames_find(frames->buffers, frames->count, buffer) < frames->count;
+	gmav_mutex_unlock(&frames->lock);
+	return (owned);
+}
+
+void	gmav_frames_release(
+	gmavi_frames_t *frames)
+{
+	if (!frames->ready)
+		return ;
+	for (uint32_t i = 0; i < frames->count; i++)
+		gmav_frames_unmap(frames->buffers[i], frames->size);
+	free(frames->buffers);
+	free(frames->idle);
+	gmav_mutex_destroy(&frames->lock);
+	memset(frames, 0, sizeof(gmavi_frames_t));
+}
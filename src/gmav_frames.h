@@ -0,0 +1,89 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_FRAMES_H
+# define GMAV_FRAMES_H
+# include <stdint.h>
+# include <stdbool.h>
+# include <stddef.h>
+# include "gmav_thread.h"
+
+/*
+*	Huge page size asked for with GMAV_HUGE_*, the common size on x86-64 and arm64
+*/
+# define GMAV_HUGE_PAGE			0x200000
+
+/*
+*	Frame buffers owned by an instance, handed out by gmav_alloc_frame and, when
+*	frames are queued as they are, also making up the slots of the writer queue.
+*	Buffers are mapped straight from the system, page aligned and never given
+*	back before the pool is released
+*
+*	@param	size			-	Bytes per buffer, whole pages (or huge pages)
+*	@param	huge			-	GMAV_HUGE_* backing
+*	@param	buffers			-	Every buffer mapped, @count of them
+*	@param	idle			-	Buffers not handed out, @idleCount of them
+*	@param	capacity		-	Room in @buffers and @idle
+*	@param	ready			-	Lock is initialised
+*/
+typedef struct	s_gmavi_frames
+{
+	size_t			size;
+	uint32_t		huge;
+	uint8_t			**buffers;
+	uint32_t		count;
+	uint8_t			**idle;
+	uint32_t		idleCount;
+	uint32_t		capacity;
+	bool			ready;
+	gmavi_mutex_t	lock;
+}	gmavi_frames_t;
+
+/*
+*	Prepare a pool of buffers holding at least @size bytes each, nothing is mapped yet
+*/
+bool	gmav_frames_setup(gmavi_frames_t *frames, size_t size, uint32_t huge);
+
+/*
+*	An idle buffer, or a newly mapped one. NULL when mapping fails
+*/
+uint8_t	*gmav_frames_take(gmavi_frames_t *frames);
+
+/*
+*	Hand @buffer back, false when it does not belong to the pool or is idle already
+*/
+bool	gmav_frames_give(gmavi_frames_t *frames, uint8_t *buffer);
+
+/*
+*	Whether @buffer was mapped by the pool
+*/
+bool	gmav_frames_owns(gmavi_frames_t *frames, const uint8_t *buffer);
+
+/*
+*	Unmap every buffer, handed out or not. Safe on a zeroed pool.
+*/
+void	gmav_frames_release(gmavi_frames_t *frames);
+
+#endif
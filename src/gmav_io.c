@@ -0,0 +1,61 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include "gmav_io.h"
+#ifdef _WIN32
+# include <malloc.h>
+#endif
+
+const gmavi_io_t	*gmav_io_default(void)
+{
+#ifdef _WIN32
+	return (&gmav_io_stdio);
+#else
+	return (&gmav_io_posix);
+#endif
+}
+
+void	*gmav_aligned_alloc(size_t size)
+{
+#ifdef _WIN32
+	return (_aligned_malloc(size, GMAV_IO_SECTOR));
+#else
+	void	*ptr;
+
+	if (posix_memalign(&ptr, GMAV_IO_SECTOR, size))
+		return (NULL);
+	return (ptr);
+#endif
+}
+
+void	gmav_aligned_free(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
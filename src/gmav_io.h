@@ -0,0 +1,135 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_IO_H
+# define GMAV_IO_H
+# include <stdint.h>
+# include <stdbool.h>
+# include <stddef.h>
+# include "../include/libgmavi.h"
+
+/*	Alignment required for unbuffered (O_DIRECT) transfers, frames are laid out on it	*/
+# define GMAV_IO_SECTOR			GMAV_FRAME_SECTOR
+
+/*	Open flags	*/
+# define GMAV_IO_DIRECT			0x1
+
+/*
+*	gmavi_iovec_t
+*
+*	@param	base			-	Start of the data to be written
+*	@param	size			-	Amount of bytes at @base
+*/
+typedef struct	s_gmavi_iovec
+{
+	const void	*base;
+	size_t		size;
+}	gmavi_iovec_t;
+
+/*
+*	Called by an asynchronous backend once it no longer reads @data
+*/
+typedef void	(*gmavi_release_t)(void *ctx, const void *data);
+
+/*
+*	I/O backend
+*
+*	Every write is positional, the writer keeps track of its own offsets so a
+*	backend never has to seek or buffer.
+*
+*	@param	name			-	Backend identifier
+*	@param	open			-	Create (truncate) @filePath, returns a handle or NULL (errno is set).
+*								@depth is the amount of writes an asynchronous backend keeps in flight
+*	@param	writev			-	Gather @count buffers into a single write at @offset. With
+*								@GMAV_IO_DIRECT, writes whose offset, buffers and sizes are all
+*								@GMAV_IO_SECTOR aligned bypass the page cache
+*	@param	writevAsync		-	Optional. Like @writev, but the data is staged and the write may
+*								still be in flight on return. Failures are reported by a later
+*								call. @writev always waits for outstanding writes first.
+*	@param	writevHeld		-	Optional. Like @writevAsync, but the buffer starting at @held is
+*								written in place instead of staged, only the other buffers are
+*								copied. @release(@ctx, @held) follows exactly once, when the write
+*								is done or has failed, from within a later call on the handle
+*								(@close at the latest) or before returning
+*	@param	map				-	Optional. Map @size bytes at @offset (a multiple of the page size)
+*								writable, growing the file when it is shorter. NULL on failure
+*	@param	unmap			-	Release a mapping returned by @map
+*	@param	truncate		-	Optional. Set the file size to exactly @size bytes
+*	@param	allocate		-	Optional. Reserve disk space for @size bytes at @offset without
+*								changing the file size, space past the end is released again
+*								by @truncate
+*	@param	close			-	Release the handle, false when the data could not be flushed
+*/
+typedef struct	s_gmavi_io
+{
+	const char	*name;
+	void		*(*open)(const char *filePath, uint32_t flags, uint32_t depth);
+	bool		(*writev)(void *handle, const gmavi_iovec_t *iov, uint32_t count, uint64_t offset);
+	bool		(*writevAsync)(void *handle, const gmavi_iovec_t *iov, uint32_t count, uint64_t offset);
+	bool		(*writevHeld)(void *handle, const gmavi_iovec_t *iov, uint32_t count, uint64_t offset,
+					const void *held, gmavi_release_t release, void *ctx);
+	void		*(*map)(void *handle, uint64_t offset, size_t size);
+	bool		(*unmap)(void *handle, void *addr, size_t size);
+	bool		(*truncate)(void *handle, uint64_t size);
+	bool		(*allocate)(void *handle, uint64_t offset, uint64_t size);
+	bool		(*close)(void *handle);
+}	gmavi_io_t;
+
+/*	Buffered stdio, available everywhere	*/
+extern const gmavi_io_t	gmav_io_stdio;
+
+# ifndef _WIN32
+/*	Raw file descriptors using pwritev(2)	*/
+extern const gmavi_io_t	gmav_io_posix;
+
+/*
+*	pwritev(2) until everything is written, shared by the descriptor based backends
+*/
+bool	gmav_posix_pwritev(int fd, const gmavi_iovec_t *iov, uint32_t count, uint64_t offset);
+bool	gmav_posix_is_aligned(const gmavi_iovec_t *iov, uint32_t count, uint64_t offset);
+bool	gmav_posix_truncate(int fd, uint64_t size);
+bool	gmav_posix_allocate(int fd, uint64_t offset, uint64_t size);
+# endif
+
+# ifdef __linux__
+/*
+*	io_uring, keeps several frame writes in flight. Behaves like @gmav_io_posix
+*	when the kernel does not offer io_uring.
+*/
+extern const gmavi_io_t	gmav_io_uring;
+# endif
+
+/*
+*	Preferred backend for the current platform
+*/
+const gmavi_io_t	*gmav_io_default(void);
+
+/*
+*	@GMAV_IO_SECTOR aligned allocations, release with gmav_aligned_free
+*/
+void				*gmav_aligned_alloc(size_t size);
+void				gmav_aligned_free(void *ptr);
+
+#endif
@@ -0,0 +1,257 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <limits.h>
+# include <errno.h>
+# include <stdlib.h>
+# include <sys/uio.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include "gmav_io.h"
+
+# ifndef IOV_MAX
+#  define IOV_MAX		1024
+# endif
+
+/*
+*	Only a handful of buffers are ever gathered (chunk header + bitmap, index
+*	header + entries), larger requests are split up
+*/
+# define GMAV_POSIX_IOV		16
+
+/*
+*	@param	fd				-	Buffered descriptor, used for headers, indexes and anything unaligned
+*	@param	directFd		-	Second descriptor opened with O_DIRECT, -1 when not requested or
+*								not supported by the file system
+*/
+typedef struct	s_gmavi_posix
+{
+	int			fd;
+	int			directFd;
+}	gmavi_posix_t;
+
+static void	*gmav_posix_open(const char *filePath, uint32_t flags, uint32_t depth)
+{
+	gmavi_posix_t	*file;
+
+	(void)depth;
+	file = (gmavi_posix_t *)malloc(sizeof(gmavi_posix_t));
+	if (file == NULL)
+		return (NULL);
+	file->fd = open(filePath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file->fd < 0)
+	{
+		free(file);
+		return (NULL);
+	}
+	file->directFd = -1;
+# ifdef O_DIRECT
+	if (flags & GMAV_IO_DIRECT)
+		file->directFd = open(filePath, O_WRONLY | O_DIRECT);
+# else
+	(void)flags;
+# endif
+	return (file);
+}
+
+bool	gmav_posix_is_aligned(
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	if (offset % GMAV_IO_SECTOR)
+		return (false);
+	for (uint32_t i = 0; i < count; i++) {
+		if ((uintptr_t)iov[i].base % GMAV_IO_SECTOR || iov[i].size % GMAV_IO_SECTOR)
+			return (false);
+	}
+	return (true);
+}
+
+bool	gmav_posix_pwritev(
+	int fd,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	struct iovec	vec[GMAV_POSIX_IOV];
+	uint32_t		next = 0;
+
+	while (next < count)
+	{
+		int		used = 0;
+		size_t	left = 0;
+
+		while (next < count && used < GMAV_POSIX_IOV && used < IOV_MAX)
+		{
+			vec[used].iov_base = (void *)iov[next].base;
+			vec[used].iov_len = iov[next].size;
+			left += iov[next].size;
+			used += 1;
+			next += 1;
+		}
+
+		/*	Short writes are legal, resume at whatever the kernel left over	*/
+		struct iovec	*cur = vec;
+		while (left)
+		{
+			ssize_t	written = pwritev(fd, cur, used, (off_t)offset);
+
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue ;
+				return (false);
+			}
+			if (written == 0)
+			{
+				errno = EIO;
+				return (false);
+			}
+			offset += (uint64_t)written;
+			left -= (size_t)written;
+			while (used && (size_t)written >= cur->iov_len)
+			{
+				written -= (ssize_t)cur->iov_len;
+				cur += 1;
+				used -= 1;
+			}
+			if (used)
+			{
+				cur->iov_base = (uint8_t *)cur->iov_base + written;
+				cur->iov_len -= (size_t)written;
+			}
+		}
+	}
+	return (true);
+}
+
+static bool	gmav_posix_writev(
+	void *handle,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	gmavi_posix_t	*file = (gmavi_posix_t *)handle;
+
+	if (file->directFd >= 0 && gmav_posix_is_aligned(iov, count, offset))
+		return (gmav_posix_pwritev(file->directFd, iov, count, offset));
+	return (gmav_posix_pwritev(file->fd, iov, count, offset));
+}
+
+bool	gmav_posix_truncate(int fd, uint64_t size)
+{
+	while (ftruncate(fd, (off_t)size))
+	{
+		if (errno != EINTR)
+			return (false);
+	}
+	return (true);
+}
+
+/*
+*	Blocks past the end of the file are only reserved, the size stays where the
+*	last write left it so a crashed recording never ends in unwritten space
+*/
+bool	gmav_posix_allocate(int fd, uint64_t offset, uint64_t size)
+{
+# ifdef FALLOC_FL_KEEP_SIZE
+	while (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)size))
+	{
+		if (errno != EINTR)
+			return (false);
+	}
+	return (true);
+# else
+	(void)fd;
+	(void)offset;
+	(void)size;
+	errno = EOPNOTSUPP;
+	return (false);
+# endif
+}
+
+static void	*gmav_posix_map(void *handle, uint64_t offset, size_t size)
+{
+	gmavi_posix_t	*file = (gmavi_posix_t *)handle;
+	struct stat		info;
+	void			*addr;
+
+	if (fstat(file->fd, &info))
+		return (NULL);
+	if ((uint64_t)info.st_size < offset + size && !gmav_posix_truncate(file->fd, offset + size))
+		return (NULL);
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, (off_t)offset);
+	if (addr == MAP_FAILED)
+		return (NULL);
+	return (addr);
+}
+
+static bool	gmav_posix_unmap(void *handle, void *addr, size_t size)
+{
+	(void)handle;
+	return (munmap(addr, size) == 0);
+}
+
+static bool	gmav_posix_resize(void *handle, uint64_t size)
+{
+	return (gmav_posix_truncate(((gmavi_posix_t *)handle)->fd, size));
+}
+
+static bool	gmav_posix_reserve(void *handle, uint64_t offset, uint64_t size)
+{
+	return (gmav_posix_allocate(((gmavi_posix_t *)handle)->fd, offset, size));
+}
+
+static bool	gmav_posix_close(void *handle)
+{
+	gmavi_posix_t	*file = (gmavi_posix_t *)handle;
+	int				status = 0;
+
+	if (file->directFd >= 0 && close(file->directFd))
+		status = -1;
+	if (close(file->fd))
+		status = -1;
+	free(file);
+	return (status == 0);
+}
+
+const gmavi_io_t	gmav_io_posix = {
+	"posix",
+	gmav_posix_open,
+	gmav_posix_writev,
+	NULL,
+	NULL,
+	gmav_posix_map,
+	gmav_posix_unmap,
+	gmav_posix_resize,
+	gmav_posix_reserve,
+	gmav_posix_close
+};
+
+#endif
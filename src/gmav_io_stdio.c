@@ -0,0 +1,78 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdio.h>
+#include "gmav_io.h"
+
+#ifdef _WIN32
+# define gmav_fseek		_fseeki64
+#else
+# define gmav_fseek		fseeko
+#endif
+
+/*
+*	stdio can not bypass the system cache, @GMAV_IO_DIRECT is ignored
+*/
+static void	*gmav_stdio_open(const char *filePath, uint32_t flags, uint32_t depth)
+{
+	(void)flags;
+	(void)depth;
+	return (fopen(filePath, "wb+"));
+}
+
+static bool	gmav_stdio_writev(
+	void *handle,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	FILE	*file = (FILE *)handle;
+
+	if (gmav_fseek(file, offset, SEEK_SET))
+		return (false);
+	for (uint32_t i = 0; i < count; i++) {
+		if (iov[i].size && fwrite(iov[i].base, iov[i].size, 1, file) != 1)
+			return (false);
+	}
+	return (true);
+}
+
+static bool	gmav_stdio_close(void *handle)
+{
+	return (fclose((FILE *)handle) == 0);
+}
+
+const gmavi_io_t	gmav_io_stdio = {
+	"stdio",
+	gmav_stdio_open,
+	gmav_stdio_writev,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	gmav_stdio_close
+};
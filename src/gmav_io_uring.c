@@ -0,0 +1,520 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifdef __linux__
+# include <fcntl.h>
+# include <unistd.h>
+# include <errno.h>
+# include <stdlib.h>
+# include <string.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/uio.h>
+# include <linux/io_uring.h>
+# include "gmav_io.h"
+
+# define GMAV_URING_DEPTH		4
+# define GMAV_URING_VECS		8
+
+/*
+*	One write in flight
+*
+*	@param	buffer			-	@GMAV_IO_SECTOR aligned copies of the buffers that are not held
+*	@param	capacity		-	Allocated size of @buffer
+*	@param	vecs			-	Point into @buffer or at @held, must stay valid until completion
+*	@param	vecCount		-	Entries used in @vecs
+*	@param	size			-	Total size of @vecs
+*	@param	offset			-	File offset of the write
+*	@param	held			-	Caller buffer written in place, handed back through @release
+*	@param	busy			-	Submitted and not reaped yet
+*/
+typedef struct	s_gmavi_uring_slot
+{
+	uint8_t			*buffer;
+	size_t			capacity;
+	struct iovec	vecs[GMAV_URING_VECS];
+	uint32_t		vecCount;
+	size_t			size;
+	uint64_t		offset;
+	const void		*held;
+	gmavi_release_t	release;
+	void			*ctx;
+	bool			busy;
+}	gmavi_uring_slot_t;
+
+/*
+*	@param	fd, directFd	-	See the posix backend
+*	@param	ringFd			-	io_uring instance, -1 when unavailable (plain pwritev is used)
+*	@param	inFlight		-	Submitted writes not yet reaped
+*	@param	error			-	First failed completion (errno), reported by the next call
+*/
+typedef struct	s_gmavi_uring
+{
+	int						fd;
+	int						directFd;
+	int						ringFd;
+	uint32_t				depth;
+	uint32_t				inFlight;
+	int						error;
+	gmavi_uring_slot_t		*slots;
+	void					*sqMap;
+	size_t					sqMapSize;
+	void					*cqMap;
+	size_t					cqMapSize;
+	struct io_uring_sqe		*sqes;
+	size_t					sqesSize;
+	uint32_t				*sqTail;
+	uint32_t				*sqMask;
+	uint32_t				*sqArray;
+	uint32_t				*cqHead;
+	uint32_t				*cqTail;
+	uint32_t				*cqMask;
+	struct io_uring_cqe		*cqes;
+}	gmavi_uring_t;
+
+static bool	gmav_uring_setup(gmavi_uring_t *ring)
+{
+	struct io_uring_params	params;
+
+	memset(&params, 0, sizeof(params));
+	ring->ringFd = (int)syscall(__NR_io_uring_setup, ring->depth, &params);
+	if (ring->ringFd < 0)
+		return (false);
+
+	ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cqMapSize > ring->sqMapSize)
+			ring->sqMapSize = ring->cqMapSize;
+		ring->cqMapSize = 0;
+	}
+	ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+	if (ring->sqMap == MAP_FAILED)
+		return (false);
+	ring->cqMap = ring->sqMap;
+	if (ring->cqMapSize)
+	{
+		ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+		if (ring->cqMap == MAP_FAILED)
+			return (false);
+	}
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		return (false);
+
+	ring->sqTail = (uint32_t *)((uint8_t *)ring->sqMap + params.sq_off.tail);
+	ring->sqMask = (uint32_t *)((uint8_t *)ring->sqMap + params.sq_off.ring_mask);
+	ring->sqArray = (uint32_t *)((uint8_t *)ring->sqMap + params.sq_off.array);
+	ring->cqHead = (uint32_t *)((uint8_t *)ring->cqMap + params.cq_off.head);
+	ring->cqTail = (uint32_t *)((uint8_t *)ring->cqMap + params.cq_off.tail);
+	ring->cqMask = (uint32_t *)((uint8_t *)ring->cqMap + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((uint8_t *)ring->cqMap + params.cq_off.cqes);
+	return (true);
+}
+
+static void	gmav_uring_teardown(gmavi_uring_t *ring)
+{
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqesSize);
+	if (ring->cqMapSize && ring->cqMap != NULL && ring->cqMap != MAP_FAILED)
+		munmap(ring->cqMap, ring->cqMapSize);
+	if (ring->sqMap != NULL && ring->sqMap != MAP_FAILED)
+		munmap(ring->sqMap, ring->sqMapSize);
+	if (ring->ringFd >= 0)
+		close(ring->ringFd);
+	ring->sqes = NULL;
+	ring->cqMap = NULL;
+	ring->sqMap = NULL;
+	ring->ringFd = -1;
+}
+
+static void	*gmav_uring_open(const char *filePath, uint32_t flags, uint32_t depth)
+{
+	gmavi_uring_t	*ring;
+
+	ring = (gmavi_uring_t *)calloc(1, sizeof(gmavi_uring_t));
+	if (ring == NULL)
+		return (NULL);
+	ring->depth = depth ? depth : GMAV_URING_DEPTH;
+	ring->slots = (gmavi_uring_slot_t *)calloc(ring->depth, sizeof(gmavi_uring_slot_t));
+	ring->fd = open(filePath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (ring->slots == NULL || ring->fd < 0)
+	{
+		free(ring->slots);
+		free(ring);
+		return (NULL);
+	}
+	ring->directFd = -1;
+	if (flags & GMAV_IO_DIRECT)
+		ring->directFd = open(filePath, O_WRONLY | O_DIRECT);
+
+	/*	No io_uring (old kernel, seccomp, ...): every write becomes a plain pwritev	*/
+	if (!gmav_uring_setup(ring))
+		gmav_uring_teardown(ring);
+	return (ring);
+}
+
+/*
+*	Hand the held buffer of @slot back, once
+*/
+static void	gmav_uring_release(gmavi_uring_slot_t *slot)
+{
+	if (slot->release != NULL)
+		slot->release(slot->ctx, slot->held);
+	slot->release = NULL;
+	slot->held = NULL;
+}
+
+/*
+*	Short write, finish what is left of @slot synchronously
+*/
+static bool	gmav_uring_finish(gmavi_uring_t *ring, gmavi_uring_slot_t *slot, size_t done)
+{
+	gmavi_iovec_t	rest[GMAV_URING_VECS];
+	uint32_t		count = 0;
+	size_t			skip = done;
+
+	for (uint32_t i = 0; i < slot->vecCount; i++)
+	{
+		if (skip >= slot->vecs[i].iov_len)
+		{
+			skip -= slot->vecs[i].iov_len;
+			continue ;
+		}
+		rest[count++] = (gmavi_iovec_t){
+			(uint8_t *)slot->vecs[i].iov_base + skip,
+			slot->vecs[i].iov_len - skip
+		};
+		skip = 0;
+	}
+	return (gmav_posix_pwritev(ring->fd, rest, count, slot->offset + done));
+}
+
+/*
+*	Consume whatever completed, waiting for at least @wait completions
+*	(a single io_uring_enter, reaping itself never enters the kernel)
+*/
+static bool	gmav_uring_reap(gmavi_uring_t *ring, uint32_t wait)
+{
+	if (wait > ring->inFlight)
+		wait = ring->inFlight;
+	while (true)
+	{
+		uint32_t	head = *ring->cqHead;
+		uint32_t	tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+		while (head != tail)
+		{
+			struct io_uring_cqe	*cqe = &ring->cqes[head & *ring->cqMask];
+			gmavi_uring_slot_t	*slot = &ring->slots[cqe->user_data];
+
+			if (cqe->res < 0 && !ring->error)
+				ring->error = -cqe->res;
+			else if (cqe->res >= 0 && (size_t)cqe->res < slot->size
+				&& !gmav_uring_finish(ring, slot, (size_t)cqe->res) && !ring->error)
+				ring->error = errno;
+			gmav_uring_release(slot);
+			slot->busy = false;
+			ring->inFlight -= 1;
+			head += 1;
+			if (wait)
+				wait -= 1;
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+		if (wait == 0)
+			break ;
+		/*	EAGAIN and EBUSY only ask to consume completions and try again	*/
+		if (syscall(__NR_io_uring_enter, ring->ringFd, 0, wait, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+			&& errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			ring->error = errno;
+			return (false);
+		}
+	}
+	return (true);
+}
+
+static bool	gmav_uring_status(gmavi_uring_t *ring)
+{
+	if (ring->error == 0)
+		return (true);
+	errno = ring->error;
+	return (false);
+}
+
+static bool	gmav_uring_writev(
+	void *handle,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	gmavi_uring_t	*ring = (gmavi_uring_t *)handle;
+
+	if (ring->inFlight)
+		gmav_uring_reap(ring, ring->inFlight);
+	if (!gmav_uring_status(ring))
+		return (false);
+	if (ring->directFd >= 0 && gmav_posix_is_aligned(iov, count, offset))
+		return (gmav_posix_pwritev(ring->directFd, iov, count, offset));
+	return (gmav_posix_pwritev(ring->fd, iov, count, offset));
+}
+
+/*
+*	Fill the vectors of @slot, entries starting at @held point at the caller's
+*	buffer, runs of other entries are copied into one sector aligned piece each
+*/
+static bool	gmav_uring_stage(
+	gmavi_uring_slot_t *slot,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	const void *held)
+{
+	size_t	capacity = 0;
+	size_t	size = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+		capacity += iov[i].size + GMAV_IO_SECTOR;
+	if (slot->capacity < capacity)
+	{
+		gmav_aligned_free(slot->buffer);
+		slot->capacity = (capacity + GMAV_IO_SECTOR - 1) & ~(size_t)(GMAV_IO_SECTOR - 1);
+		slot->buffer = (uint8_t *)gmav_aligned_alloc(slot->capacity);
+		if (slot->buffer == NULL)
+		{
+			slot->capacity = 0;
+			return (false);
+		}
+	}
+
+	bool	staging = false;
+
+	slot->vecCount = 0;
+	slot->size = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (iov[i].size == 0)
+			continue ;
+		if (held != NULL && iov[i].base == held)
+		{
+			slot->vecs[slot->vecCount++] = (struct iovec){(void *)iov[i].base, iov[i].size};
+			staging = false;
+		}
+		else
+		{
+			if (!staging)
+			{
+				size = (size + GMAV_IO_SECTOR - 1) & ~(size_t)(GMAV_IO_SECTOR - 1);
+				slot->vecs[slot->vecCount++] = (struct iovec){slot->buffer + size, 0};
+				staging = true;
+			}
+			memcpy(slot->buffer + size, iov[i].base, iov[i].size);
+			slot->vecs[slot->vecCount - 1].iov_len += iov[i].size;
+			size += iov[i].size;
+		}
+		slot->size += iov[i].size;
+	}
+	return (true);
+}
+
+/*
+*	Queue one write, @release(@ctx, @held) is called once nothing reads @held anymore
+*/
+static bool	gmav_uring_submit(
+	gmavi_uring_t *ring,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset,
+	const void *held,
+	gmavi_release_t release,
+	void *ctx)
+{
+	gmavi_uring_slot_t	*slot = NULL;
+
+	if (gmav_uring_reap(ring, ring->inFlight == ring->depth ? 1 : 0) && gmav_uring_status(ring))
+	{
+		for (uint32_t i = 0; i < ring->depth && slot == NULL; i++) {
+			if (!ring->slots[i].busy)
+				slot = &ring->slots[i];
+		}
+	}
+	if (slot == NULL)
+	{
+		if (release != NULL)
+			release(ctx, held);
+		errno = ring->error ? ring->error : EBUSY;
+		return (false);
+	}
+	slot->held = held;
+	slot->release = release;
+	slot->ctx = ctx;
+
+	/*	Every entry may start a vector of its own, past that everything is copied	*/
+	if (!gmav_uring_stage(slot, iov, count, count > GMAV_URING_VECS ? NULL : held))
+	{
+		gmav_uring_release(slot);
+		return (false);
+	}
+	if (count > GMAV_URING_VECS)
+		gmav_uring_release(slot);
+	slot->offset = offset;
+	slot->busy = true;
+
+	uint32_t			tail = *ring->sqTail;
+	uint32_t			index = tail & *ring->sqMask;
+	struct io_uring_sqe	*sqe = &ring->sqes[index];
+	gmavi_iovec_t		vecs[GMAV_URING_VECS];
+
+	for (uint32_t i = 0; i < slot->vecCount; i++)
+		vecs[i] = (gmavi_iovec_t){(const uint8_t *)slot->vecs[i].iov_base, slot->vecs[i].iov_len};
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = ring->directFd >= 0 && gmav_posix_is_aligned(vecs, slot->vecCount, offset)
+		? ring->directFd : ring->fd;
+	sqe->off = offset;
+	sqe->addr = (uint64_t)(uintptr_t)slot->vecs;
+	sqe->len = slot->vecCount;
+	sqe->user_data = (uint64_t)(slot - ring->slots);
+	ring->sqArray[index] = index;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring->inFlight += 1;
+
+	while (syscall(__NR_io_uring_enter, ring->ringFd, 1, 0, 0, NULL, 0) < 0)
+	{
+		if (errno != EINTR && errno != EAGAIN)
+		{
+			ring->error = errno;
+			gmav_uring_release(slot);
+			slot->busy = false;
+			ring->inFlight -= 1;
+			return (false);
+		}
+	}
+	return (true);
+}
+
+static bool	gmav_uring_writev_async(
+	void *handle,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset)
+{
+	gmavi_uring_t	*ring = (gmavi_uring_t *)handle;
+
+	if (ring->ringFd < 0)
+		return (gmav_uring_writev(handle, iov, count, offset));
+	return (gmav_uring_submit(ring, iov, count, offset, NULL, NULL, NULL));
+}
+
+/*
+*	Only the buffer at @held is left in place, the rest of the gather (chunk
+*	headers, audio, padding, an unaligned tail) still goes through the slot
+*/
+static bool	gmav_uring_writev_held(
+	void *handle,
+	const gmavi_iovec_t *iov,
+	uint32_t count,
+	uint64_t offset,
+	const void *held,
+	gmavi_release_t release,
+	void *ctx)
+{
+	gmavi_uring_t	*ring = (gmavi_uring_t *)handle;
+	bool			status;
+
+	if (ring->ringFd >= 0)
+		return (gmav_uring_submit(ring, iov, count, offset, held, release, ctx));
+	status = gmav_uring_writev(handle, iov, count, offset);
+	release(ctx, held);
+	return (status);
+}
+
+static bool	gmav_uring_truncate(void *handle, uint64_t size)
+{
+	gmavi_uring_t	*ring = (gmavi_uring_t *)handle;
+
+	if (ring->inFlight)
+		gmav_uring_reap(ring, ring->inFlight);
+	return (gmav_uring_status(ring) && gmav_posix_truncate(ring->fd, size));
+}
+
+static bool	gmav_uring_allocate(void *handle, uint64_t offset, uint64_t size)
+{
+	return (gmav_posix_allocate(((gmavi_uring_t *)handle)->fd, offset, size));
+}
+
+static bool	gmav_uring_close(void *handle)
+{
+	gmavi_uring_t	*ring = (gmavi_uring_t *)handle;
+	uint32_t		inFlight;
+	bool			status;
+	int				error;
+
+	if (ring->inFlight)
+		gmav_uring_reap(ring, ring->inFlight);
+	inFlight = ring->inFlight;
+	status = gmav_uring_status(ring) && inFlight == 0;
+	error = ring->error;
+	gmav_uring_teardown(ring);
+
+	/*	Writes that could not be reaped may still read their slot (and held
+		buffer), those are leaked rather than handed back	*/
+	for (uint32_t i = 0; i < ring->depth; i++)
+	{
+		if (ring->slots[i].busy)
+			continue ;
+		gmav_uring_release(&ring->slots[i]);
+		gmav_aligned_free(ring->slots[i].buffer);
+	}
+	if (ring->directFd >= 0 && close(ring->directFd))
+		status = false;
+	if (close(ring->fd))
+		status = false;
+	if (inFlight == 0)
+		free(ring->slots);
+	free(ring);
+	if (inFlight)
+		errno = error ? error : EIO;
+	return (status);
+}
+
+const gmavi_io_t	gmav_io_uring = {
+	"io_uring",
+	gmav_uring_open,
+	gmav_uring_writev,
+	gmav_uring_writev_async,
+	gmav_uring_writev_held,
+	NULL,
+	NULL,
+	gmav_uring_truncate,
+	gmav_uring_allocate,
+	gmav_uring_close
+};
+
+#endif
@@ -0,0 +1,1220 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "gmav_pixel.h"
+#include "../include/libgmavi.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define GMAV_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define GMAV_NEON
+# include <arm_neon.h>
+#endif
+
+/*	GCC and Clang need per-function targets, MSVC accepts the intrinsics anywhere	*/
+#if defined(__GNUC__) || defined(__clang__)
+# define GMAV_TARGET(isa)	__attribute__((target(isa)))
+#else
+# define GMAV_TARGET(isa)
+#endif
+
+/*
+*	Scalar kernels, also used for the tail of every vector loop
+*/
+static void	gmav_row_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst += 3;
+		src += 4;
+	}
+}
+
+static void	gmav_row_32_to_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst += 3;
+		src += 4;
+	}
+}
+
+static void	gmav_row_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = src[3];
+		dst += 4;
+		src += 4;
+	}
+}
+
+static void	gmav_row_24_to_32(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = 0xFF;
+		dst += 4;
+		src += 3;
+	}
+}
+
+static void	gmav_row_24_to_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = 0xFF;
+		dst += 4;
+		src += 3;
+	}
+}
+
+static void	gmav_row_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst += 3;
+		src += 3;
+	}
+}
+
+#ifdef GMAV_X86
+
+/*
+*	SSSE3, 16 pixels per iteration: four 4-pixel shuffles packed into three stores
+*/
+GMAV_TARGET("ssse3")
+static uint32_t	gmav_ssse3_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width, __m128i mask)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i	v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 0)), mask);
+		__m128i	v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16)), mask);
+		__m128i	v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 32)), mask);
+		__m128i	v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 48)), mask);
+
+		_mm_storeu_si128((__m128i *)(dst + 0), _mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+		_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+		src += 64;
+		dst += 48;
+	}
+	return (x);
+}
+
+GMAV_TARGET("ssse3")
+static void	gmav_ssse3_row_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	uint32_t		x = gmav_ssse3_32_to_24(dst, src, width, mask);
+
+	gmav_row_32_to_24(dst + x * 3, src + x * 4, width - x);
+}
+
+GMAV_TARGET("ssse3")
+static void	gmav_ssse3_row_32_to_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	uint32_t		x = gmav_ssse3_32_to_24(dst, src, width, mask);
+
+	gmav_row_32_to_24_swap(dst + x * 3, src + x * 4, width - x);
+}
+
+/*
+*	SSSE3, 16 pixels per iteration: three loads realigned into four 4-pixel shuffles
+*/
+GMAV_TARGET("ssse3")
+static uint32_t	gmav_ssse3_24_to_32(uint8_t *dst, const uint8_t *src, uint32_t width, __m128i mask)
+{
+	const __m128i	alpha = _mm_set1_epi32((int)0xFF000000);
+	uint32_t		x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i	in0 = _mm_loadu_si128((const __m128i *)(src + 0));
+		__m128i	in1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i	in2 = _mm_loadu_si128((const __m128i *)(src + 32));
+
+		_mm_storeu_si128((__m128i *)(dst + 0), _mm_or_si128(_mm_shuffle_epi8(in0, mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + 48), _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(in2, 4), mask), alpha));
+		src += 48;
+		dst += 64;
+	}
+	return (x);
+}
+
+GMAV_TARGET("ssse3")
+static void	gmav_ssse3_row_24_to_32(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	uint32_t		x = gmav_ssse3_24_to_32(dst, src, width, mask);
+
+	gmav_row_24_to_32(dst + x * 4, src + x * 3, width - x);
+}
+
+GMAV_TARGET("ssse3")
+static void	gmav_ssse3_row_24_to_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	mask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	uint32_t		x = gmav_ssse3_24_to_32(dst, src, width, mask);
+
+	gmav_row_24_to_32_swap(dst + x * 4, src + x * 3, width - x);
+}
+
+/*
+*	SSSE3, 16 pixels per iteration: four overlapping 4-pixel loads, the last one
+*	shifted in the mask so nothing past the 48 bytes is read, packed like 32 to 24
+*/
+GMAV_TARGET("ssse3")
+static void	gmav_ssse3_row_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+	const __m128i	tail = _mm_setr_epi8(6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13, -1, -1, -1, -1);
+	uint32_t		x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i	v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 0)), mask);
+		__m128i	v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 12)), mask);
+		__m128i	v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 24)), mask);
+		__m128i	v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 32)), tail);
+
+		_mm_storeu_si128((__m128i *)(dst + 0), _mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+		_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+		src += 48;
+		dst += 48;
+	}
+	gmav_row_24_swap(dst, src, width - x);
+}
+
+/*
+*	SSE2 red/blue swap, plain shifts and masks
+*/
+static void	gmav_sse2_row_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i	keep = _mm_set1_epi32((int)0xFF00FF00);
+	const __m128i	low = _mm_set1_epi32(0x000000FF);
+	uint32_t		x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i	v = _mm_loadu_si128((const __m128i *)src);
+		__m128i	r = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+		__m128i	b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(r, b)));
+		src += 16;
+		dst += 16;
+	}
+	gmav_row_32_swap(dst, src, width - x);
+}
+
+/*
+*	AVX2, 8 pixels per shuffle. vpshufb works per 128 bit lane, vpermd then
+*	closes the gap between the two 12 byte halves
+*/
+GMAV_TARGET("avx2")
+static uint32_t	gmav_avx2_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width, __m256i mask)
+{
+	const __m256i	pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	uint32_t		x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m256i	v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), mask);
+
+		v = _mm256_permutevar8x32_epi32(v, pack);
+		_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(v, 1));
+		src += 32;
+		dst += 24;
+	}
+	return (x);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m256i	mask = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	uint32_t		x = gmav_avx2_32_to_24(dst, src, width, mask);
+
+	gmav_row_32_to_24(dst + x * 3, src + x * 4, width - x);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_32_to_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m256i	mask = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	uint32_t		x = gmav_avx2_32_to_24(dst, src, width, mask);
+
+	gmav_row_32_to_24_swap(dst + x * 3, src + x * 4, width - x);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m256i	mask = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t		x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		_mm256_storeu_si256((__m256i *)dst,
+			_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), mask));
+		src += 32;
+		dst += 32;
+	}
+	gmav_row_32_swap(dst, src, width - x);
+}
+
+static bool	gmav_cpu_ssse3(void)
+{
+# ifdef _MSC_VER
+	int	info[4];
+
+	__cpuid(info, 1);
+	return ((info[2] & (1 << 9)) != 0);
+# else
+	return (__builtin_cpu_supports("ssse3"));
+# endif
+}
+
+static bool	gmav_cpu_avx2(void)
+{
+# ifdef _MSC_VER
+	int	info[4];
+
+	__cpuid(info, 1);
+	/*	OSXSAVE and AVX, and the OS saves the YMM state	*/
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return (false);
+	__cpuidex(info, 7, 0);
+	return ((info[1] & (1 << 5)) != 0);
+# else
+	return (__builtin_cpu_supports("avx2"));
+# endif
+}
+
+#endif
+
+#ifdef GMAV_NEON
+
+static void	gmav_neon_row_32_to_24(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x4_t	in = vld4q_u8(src);
+		uint8x16x3_t	out = {{in.val[0], in.val[1], in.val[2]}};
+
+		vst3q_u8(dst, out);
+		src += 64;
+		dst += 48;
+	}
+	gmav_row_32_to_24(dst, src, width - x);
+}
+
+static void	gmav_neon_row_32_to_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x4_t	in = vld4q_u8(src);
+		uint8x16x3_t	out = {{in.val[2], in.val[1], in.val[0]}};
+
+		vst3q_u8(dst, out);
+		src += 64;
+		dst += 48;
+	}
+	gmav_row_32_to_24_swap(dst, src, width - x);
+}
+
+static void	gmav_neon_row_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x4_t	in = vld4q_u8(src);
+		uint8x16x4_t	out = {{in.val[2], in.val[1], in.val[0], in.val[3]}};
+
+		vst4q_u8(dst, out);
+		src += 64;
+		dst += 64;
+	}
+	gmav_row_32_swap(dst, src, width - x);
+}
+
+static void	gmav_neon_row_24_to_32(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x3_t	in = vld3q_u8(src);
+		uint8x16x4_t	out = {{in.val[0], in.val[1], in.val[2], vdupq_n_u8(0xFF)}};
+
+		vst4q_u8(dst, out);
+		src += 48;
+		dst += 64;
+	}
+	gmav_row_24_to_32(dst, src, width - x);
+}
+
+static void	gmav_neon_row_24_to_32_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x3_t	in = vld3q_u8(src);
+		uint8x16x4_t	out = {{in.val[2], in.val[1], in.val[0], vdupq_n_u8(0xFF)}};
+
+		vst4q_u8(dst, out);
+		src += 48;
+		dst += 64;
+	}
+	gmav_row_24_to_32_swap(dst, src, width - x);
+}
+
+static void	gmav_neon_row_24_swap(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	uint32_t	x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x3_t	in = vld3q_u8(src);
+		uint8x16x3_t	out = {{in.val[2], in.val[1], in.val[0]}};
+
+		vst3q_u8(dst, out);
+		src += 48;
+		dst += 48;
+	}
+	gmav_row_24_swap(dst, src, width - x);
+}
+
+#endif
+
+/*
+*	RGB to YUV, BT.709 studio range. Coefficients are Q14 and applied to 32bpp
+*	pixels, @red is the byte offset of the red channel (0 for RGBA, 2 for BGRA).
+*	Chroma is taken from the sum of a pixel pair, so it carries one extra bit.
+*/
+static const int32_t	gmavYuvCoef[3][3] = {
+	{2991, 10064, 1016},		/*	Y	*/
+	{-1649, -5547, 7196},		/*	Cb	*/
+	{7196, -6536, -660}			/*	Cr	*/
+};
+
+/*	Rounding offsets: 8 bit Y and C, then 10 bit Y and C	*/
+# define GMAV_Y8_OFFSET		((16 << 14) + (1 << 13))
+# define GMAV_C8_OFFSET		((128 << 15) + (1 << 14))
+# define GMAV_Y10_OFFSET	((64 << 12) + (1 << 11))
+# define GMAV_C10_OFFSET	((512 << 13) + (1 << 12))
+
+static int32_t	gmav_yuv_dot(const int32_t *coef, int32_t r, int32_t g, int32_t b)
+{
+	return (coef[0] * r + coef[1] * g + coef[2] * b);
+}
+
+/*
+*	Unscaled Y of both pixels, then Cb and Cr of the pair
+*/
+static void	gmav_yuv_pair(const uint8_t *src, uint32_t red, int32_t *yuv)
+{
+	uint32_t	blue = red ^ 2;
+
+	yuv[0] = gmav_yuv_dot(gmavYuvCoef[0], src[red], src[1], src[blue]);
+	yuv[1] = gmav_yuv_dot(gmavYuvCoef[0], src[4 + red], src[5], src[4 + blue]);
+	yuv[2] = gmav_yuv_dot(gmavYuvCoef[1], src[red] + src[4 + red], src[1] + src[5], src[blue] + src[4 + blue]);
+	yuv[3] = gmav_yuv_dot(gmavYuvCoef[2], src[red] + src[4 + red], src[1] + src[5], src[blue] + src[4 + blue]);
+}
+
+static uint8_t	gmav_clamp8(int32_t value)
+{
+	if (value < 0)
+		return (0);
+	if (value > 255)
+		return (255);
+	return ((uint8_t)value);
+}
+
+/*
+*	Packed 4:2:2, UYVY or YUY2 byte order. @width is even
+*/
+static void	gmav_yuv422_row(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t red, bool yuy2)
+{
+	int32_t	yuv[4];
+
+	for (uint32_t x = 0; x + 2 <= width; x += 2) {
+		gmav_yuv_pair(src, red, yuv);
+
+		uint8_t	y0 = gmav_clamp8((yuv[0] + GMAV_Y8_OFFSET) >> 14);
+		uint8_t	y1 = gmav_clamp8((yuv[1] + GMAV_Y8_OFFSET) >> 14);
+		uint8_t	cb = gmav_clamp8((yuv[2] + GMAV_C8_OFFSET) >> 15);
+		uint8_t	cr = gmav_clamp8((yuv[3] + GMAV_C8_OFFSET) >> 15);
+
+		dst[0] = yuy2 ? y0 : cb;
+		dst[1] = yuy2 ? cb : y0;
+		dst[2] = yuy2 ? y1 : cr;
+		dst[3] = yuy2 ? cr : y1;
+		src += 8;
+		dst += 4;
+	}
+}
+
+/*
+*	10 bit planar Y, Cb and Cr of @pairs pixel pairs
+*/
+typedef void	(*gmavi_yuv10_t)(const uint8_t *src, uint32_t pairs, uint32_t red,
+					uint16_t *luma, uint16_t *cb, uint16_t *cr);
+
+static void	gmav_yuv10(const uint8_t *src, uint32_t pairs, uint32_t red,
+	uint16_t *luma, uint16_t *cb, uint16_t *cr)
+{
+	int32_t	yuv[4];
+
+	for (uint32_t p = 0; p < pairs; p++) {
+		gmav_yuv_pair(src, red, yuv);
+		luma[p * 2] = (uint16_t)((yuv[0] + GMAV_Y10_OFFSET) >> 12);
+		luma[p * 2 + 1] = (uint16_t)((yuv[1] + GMAV_Y10_OFFSET) >> 12);
+		cb[p] = (uint16_t)((yuv[2] + GMAV_C10_OFFSET) >> 13);
+		cr[p] = (uint16_t)((yuv[3] + GMAV_C10_OFFSET) >> 13);
+		src += 8;
+	}
+}
+
+static void	gmav_put_v210(uint8_t *dst, uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t	word = a | (b << 10) | (c << 20);
+
+	dst[0] = (uint8_t)word;
+	dst[1] = (uint8_t)(word >> 8);
+	dst[2] = (uint8_t)(word >> 16);
+	dst[3] = (uint8_t)(word >> 24);
+}
+
+/*
+*	v210, 48 pixels per 128 bytes. The padding past @width repeats the last pair
+*/
+static void	gmav_v210_row(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t red, gmavi_yuv10_t yuv10)
+{
+	uint16_t	luma[GMAV_V210_BLOCK];
+	uint16_t	cb[GMAV_V210_BLOCK / 2];
+	uint16_t	cr[GMAV_V210_BLOCK / 2];
+
+	for (uint32_t x = 0; x < width; x += GMAV_V210_BLOCK) {
+		uint32_t	pairs = (width - x < GMAV_V210_BLOCK ? width - x : GMAV_V210_BLOCK) / 2;
+
+		yuv10(src + x * 4, pairs, red, luma, cb, cr);
+		for (uint32_t p = pairs; p < GMAV_V210_BLOCK / 2; p++) {
+			luma[p * 2] = luma[pairs * 2 - 2];
+			luma[p * 2 + 1] = luma[pairs * 2 - 1];
+			cb[p] = cb[pairs - 1];
+			cr[p] = cr[pairs - 1];
+		}
+		for (uint32_t g = 0; g < GMAV_V210_BLOCK / 6; g++) {
+			const uint16_t	*y = luma + g * 6;
+			const uint16_t	*u = cb + g * 3;
+			const uint16_t	*v = cr + g * 3;
+
+			gmav_put_v210(dst + 0, u[0], y[0], v[0]);
+			gmav_put_v210(dst + 4, y[1], u[1], y[2]);
+			gmav_put_v210(dst + 8, v[1], y[3], u[2]);
+			gmav_put_v210(dst + 12, y[4], v[2], y[5]);
+			dst += 16;
+		}
+	}
+}
+
+static void	gmav_row_bgra_uyvy(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_yuv422_row(dst, src, width, 2, false);
+}
+
+static void	gmav_row_rgba_uyvy(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_yuv422_row(dst, src, width, 0, false);
+}
+
+static void	gmav_row_bgra_yuy2(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_yuv422_row(dst, src, width, 2, true);
+}
+
+static void	gmav_row_rgba_yuy2(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_yuv422_row(dst, src, width, 0, true);
+}
+
+static void	gmav_row_bgra_v210(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_v210_row(dst, src, width, 2, gmav_yuv10);
+}
+
+static void	gmav_row_rgba_v210(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_v210_row(dst, src, width, 0, gmav_yuv10);
+}
+
+#ifdef GMAV_X86
+
+/*
+*	Q14 coefficient rows as 16 bit lanes in pixel byte order, alpha weighs nothing
+*/
+GMAV_TARGET("avx2")
+static __m256i	gmav_avx2_coef(const int32_t *coef, uint32_t red)
+{
+	int16_t		lanes[4] = {0, (int16_t)coef[1], 0, 0};
+	uint64_t	packed = 0;
+
+	lanes[red] = (int16_t)coef[0];
+	lanes[red ^ 2] = (int16_t)coef[2];
+	for (int i = 3; i >= 0; i--)
+		packed = (packed << 16) | (uint16_t)lanes[i];
+	return (_mm256_set1_epi64x((long long)packed));
+}
+
+/*
+*	8 pixels: unscaled Y0..Y3 | Y4..Y7 and Cb01 Cb23 Cr01 Cr23 | Cb45 Cb67 Cr45 Cr67
+*/
+GMAV_TARGET("avx2")
+static void	gmav_avx2_yuv8(const uint8_t *src, const __m256i *coef, __m256i *luma, __m256i *chroma)
+{
+	const __m256i	zero = _mm256_setzero_si256();
+	__m256i			v = _mm256_loadu_si256((const __m256i *)src);
+	__m256i			lo = _mm256_unpacklo_epi8(v, zero);
+	__m256i			hi = _mm256_unpackhi_epi8(v, zero);
+
+	*luma = _mm256_hadd_epi32(_mm256_madd_epi16(lo, coef[0]), _mm256_madd_epi16(hi, coef[0]));
+	*chroma = _mm256_hadd_epi32(
+		_mm256_hadd_epi32(_mm256_madd_epi16(lo, coef[1]), _mm256_madd_epi16(hi, coef[1])),
+		_mm256_hadd_epi32(_mm256_madd_epi16(lo, coef[2]), _mm256_madd_epi16(hi, coef[2])));
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_yuv422_row(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t red, bool yuy2)
+{
+	const __m256i	coef[3] = {
+		gmav_avx2_coef(gmavYuvCoef[0], red),
+		gmav_avx2_coef(gmavYuvCoef[1], red),
+		gmav_avx2_coef(gmavYuvCoef[2], red)
+	};
+	const __m256i	yOffset = _mm256_set1_epi32(GMAV_Y8_OFFSET);
+	const __m256i	cOffset = _mm256_set1_epi32(GMAV_C8_OFFSET);
+	/*	Bytes arrive as Y0 Y1 Y2 Y3 Cb01 Cb23 Cr01 Cr23 per lane	*/
+	const __m256i	order = yuy2
+		? _mm256_setr_epi8(0, 4, 1, 6, 2, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1,
+			0, 4, 1, 6, 2, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1)
+		: _mm256_setr_epi8(4, 0, 6, 1, 5, 2, 7, 3, -1, -1, -1, -1, -1, -1, -1, -1,
+			4, 0, 6, 1, 5, 2, 7, 3, -1, -1, -1, -1, -1, -1, -1, -1);
+	uint32_t		x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m256i	luma;
+		__m256i	chroma;
+
+		gmav_avx2_yuv8(src, coef, &luma, &chroma);
+		luma = _mm256_srai_epi32(_mm256_add_epi32(luma, yOffset), 14);
+		chroma = _mm256_srai_epi32(_mm256_add_epi32(chroma, cOffset), 15);
+
+		__m256i	packed = _mm256_packus_epi16(_mm256_packs_epi32(luma, chroma), _mm256_setzero_si256());
+
+		packed = _mm256_shuffle_epi8(packed, order);
+		packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(packed));
+		src += 32;
+		dst += 16;
+	}
+	gmav_yuv422_row(dst, src, width - x, red, yuy2);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_yuv10(const uint8_t *src, uint32_t pairs, uint32_t red,
+	uint16_t *luma, uint16_t *cb, uint16_t *cr)
+{
+	const __m256i	coef[3] = {
+		gmav_avx2_coef(gmavYuvCoef[0], red),
+		gmav_avx2_coef(gmavYuvCoef[1], red),
+		gmav_avx2_coef(gmavYuvCoef[2], red)
+	};
+	const __m256i	yOffset = _mm256_set1_epi32(GMAV_Y10_OFFSET);
+	const __m256i	cOffset = _mm256_set1_epi32(GMAV_C10_OFFSET);
+	uint32_t		p = 0;
+
+	for (; p + 4 <= pairs; p += 4) {
+		__m256i	y;
+		__m256i	c;
+
+		gmav_avx2_yuv8(src, coef, &y, &c);
+		y = _mm256_srai_epi32(_mm256_add_epi32(y, yOffset), 12);
+		c = _mm256_srai_epi32(_mm256_add_epi32(c, cOffset), 13);
+
+		/*	Y0..Y7 in the low half, Cb01 Cb23 Cr01 Cr23 Cb45 Cb67 Cr45 Cr67 in the high half	*/
+		__m256i	packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(y, c), _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i	chroma = _mm_shuffle_epi32(_mm256_extracti128_si256(packed, 1), _MM_SHUFFLE(3, 1, 2, 0));
+
+		_mm_storeu_si128((__m128i *)(luma + p * 2), _mm256_castsi256_si128(packed));
+		_mm_storel_epi64((__m128i *)(cb + p), chroma);
+		_mm_storel_epi64((__m128i *)(cr + p), _mm_unpackhi_epi64(chroma, chroma));
+		src += 32;
+	}
+	gmav_yuv10(src, pairs - p, red, luma + p * 2, cb + p, cr + p);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_bgra_uyvy(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_avx2_yuv422_row(dst, src, width, 2, false);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_rgba_uyvy(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_avx2_yuv422_row(dst, src, width, 0, false);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_bgra_yuy2(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_avx2_yuv422_row(dst, src, width, 2, true);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_row_rgba_yuy2(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_avx2_yuv422_row(dst, src, width, 0, true);
+}
+
+static void	gmav_avx2_row_bgra_v210(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_v210_row(dst, src, width, 2, gmav_avx2_yuv10);
+}
+
+static void	gmav_avx2_row_rgba_v210(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	gmav_v210_row(dst, src, width, 0, gmav_avx2_yuv10);
+}
+
+#endif
+
+/*
+*	Kernel table, indexed by @GMAV_KERNEL_*
+*/
+# define GMAV_KERNEL_32_TO_24			0
+# define GMAV_KERNEL_32_TO_24_SWAP		1
+# define GMAV_KERNEL_32_SWAP			2
+# define GMAV_KERNEL_24_TO_32			3
+# define GMAV_KERNEL_24_TO_32_SWAP		4
+# define GMAV_KERNEL_24_SWAP			5
+# define GMAV_KERNEL_BGRA_UYVY			6
+# define GMAV_KERNEL_RGBA_UYVY			7
+# define GMAV_KERNEL_BGRA_YUY2			8
+# define GMAV_KERNEL_RGBA_YUY2			9
+# define GMAV_KERNEL_BGRA_V210			10
+# define GMAV_KERNEL_RGBA_V210			11
+# define GMAV_KERNEL_COUNT				12
+
+static void	gmav_select_kernels(gmavi_row_t *kernels)
+{
+	kernels[GMAV_KERNEL_32_TO_24] = gmav_row_32_to_24;
+	kernels[GMAV_KERNEL_32_TO_24_SWAP] = gmav_row_32_to_24_swap;
+	kernels[GMAV_KERNEL_32_SWAP] = gmav_row_32_swap;
+	kernels[GMAV_KERNEL_24_TO_32] = gmav_row_24_to_32;
+	kernels[GMAV_KERNEL_24_TO_32_SWAP] = gmav_row_24_to_32_swap;
+	kernels[GMAV_KERNEL_24_SWAP] = gmav_row_24_swap;
+	kernels[GMAV_KERNEL_BGRA_UYVY] = gmav_row_bgra_uyvy;
+	kernels[GMAV_KERNEL_RGBA_UYVY] = gmav_row_rgba_uyvy;
+	kernels[GMAV_KERNEL_BGRA_YUY2] = gmav_row_bgra_yuy2;
+	kernels[GMAV_KERNEL_RGBA_YUY2] = gmav_row_rgba_yuy2;
+	kernels[GMAV_KERNEL_BGRA_V210] = gmav_row_bgra_v210;
+	kernels[GMAV_KERNEL_RGBA_V210] = gmav_row_rgba_v210;
+#ifdef GMAV_X86
+	kernels[GMAV_KERNEL_32_SWAP] = gmav_sse2_row_32_swap;
+	if (gmav_cpu_ssse3())
+	{
+		kernels[GMAV_KERNEL_32_TO_24] = gmav_ssse3_row_32_to_24;
+		kernels[GMAV_KERNEL_32_TO_24_SWAP] = gmav_ssse3_row_32_to_24_swap;
+		kernels[GMAV_KERNEL_24_TO_32] = gmav_ssse3_row_24_to_32;
+		kernels[GMAV_KERNEL_24_TO_32_SWAP] = gmav_ssse3_row_24_to_32_swap;
+		kernels[GMAV_KERNEL_24_SWAP] = gmav_ssse3_row_24_swap;
+	}
+	if (gmav_cpu_avx2())
+	{
+		kernels[GMAV_KERNEL_32_TO_24] = gmav_avx2_row_32_to_24;
+		kernels[GMAV_KERNEL_32_TO_24_SWAP] = gmav_avx2_row_32_to_24_swap;
+		kernels[GMAV_KERNEL_32_SWAP] = gmav_avx2_row_32_swap;
+		kernels[GMAV_KERNEL_BGRA_UYVY] = gmav_avx2_row_bgra_uyvy;
+		kernels[GMAV_KERNEL_RGBA_UYVY] = gmav_avx2_row_rgba_uyvy;
+		kernels[GMAV_KERNEL_BGRA_YUY2] = gmav_avx2_row_bgra_yuy2;
+		kernels[GMAV_KERNEL_RGBA_YUY2] = gmav_avx2_row_rgba_yuy2;
+		kernels[GMAV_KERNEL_BGRA_V210] = gmav_avx2_row_bgra_v210;
+		kernels[GMAV_KERNEL_RGBA_V210] = gmav_avx2_row_rgba_v210;
+	}
+#elif defined(GMAV_NEON)
+	kernels[GMAV_KERNEL_32_TO_24] = gmav_neon_row_32_to_24;
+	kernels[GMAV_KERNEL_32_TO_24_SWAP] = gmav_neon_row_32_to_24_swap;
+	kernels[GMAV_KERNEL_32_SWAP] = gmav_neon_row_32_swap;
+	kernels[GMAV_KERNEL_24_TO_32] = gmav_neon_row_24_to_32;
+	kernels[GMAV_KERNEL_24_TO_32_SWAP] = gmav_neon_row_24_to_32_swap;
+	kernels[GMAV_KERNEL_24_SWAP] = gmav_neon_row_24_swap;
+#endif
+}
+
+uint32_t	gmav_pixel_size(uint32_t pixelFormat)
+{
+	return (GMAV_PIXEL_SIZE(pixelFormat));
+}
+
+uint32_t	gmav_stream_bit_count(uint32_t streamFormat)
+{
+	switch (streamFormat)
+	{
+		case GMAV_STREAM_BGR24:
+			return (24);
+		case GMAV_STREAM_BGRA32:
+			return (32);
+		case GMAV_STREAM_UYVY:
+		case GMAV_STREAM_YUY2:
+			return (16);
+		case GMAV_STREAM_V210:
+			return (20);
+	}
+	return (0);
+}
+
+size_t	gmav_stream_row_size(uint32_t streamFormat, uint32_t width)
+{
+	return (GMAV_STREAM_ROW_SIZE(streamFormat, width));
+}
+
+bool	gmav_stream_is_yuv(uint32_t streamFormat)
+{
+	return (streamFormat == GMAV_STREAM_UYVY || streamFormat == GMAV_STREAM_YUY2
+		|| streamFormat == GMAV_STREAM_V210);
+}
+
+/*
+*	YUV kernels read 32bpp pixels, 24bpp input is widened one row at a time first
+*/
+static int	gmav_select_yuv(gmavi_convert_t *convert, gmavi_row_t *kernels, uint32_t inputFormat, uint32_t streamFormat)
+{
+	int		kernel;
+
+	if (streamFormat == GMAV_STREAM_UYVY)
+		kernel = GMAV_KERNEL_BGRA_UYVY;
+	else if (streamFormat == GMAV_STREAM_YUY2)
+		kernel = GMAV_KERNEL_BGRA_YUY2;
+	else
+		kernel = GMAV_KERNEL_BGRA_V210;
+	/*	RGBA variants follow their BGRA counterpart	*/
+	if (inputFormat == GMAV_PIXEL_RGB24 || inputFormat == GMAV_PIXEL_RGBA32)
+		kernel += 1;
+	if (gmav_pixel_size(inputFormat) == 3)
+		convert->expand = kernels[GMAV_KERNEL_24_TO_32];
+	return (kernel);
+}
+
+/*
+*	Row kernels for @inputFormat to @streamFormat, no row kernel for a plain copy
+*/
+static bool	gmav_select_row(gmavi_convert_t *convert, uint32_t inputFormat, uint32_t streamFormat)
+{
+	gmavi_row_t	kernels[GMAV_KERNEL_COUNT];
+	int			kernel = -1;
+
+	gmav_select_kernels(kernels);
+	if (streamFormat == GMAV_STREAM_BGR24)
+	{
+		if (inputFormat == GMAV_PIXEL_RGB24)
+			kernel = GMAV_KERNEL_24_SWAP;
+		else if (inputFormat == GMAV_PIXEL_BGRA32)
+			kernel = GMAV_KERNEL_32_TO_24;
+		else if (inputFormat == GMAV_PIXEL_RGBA32)
+			kernel = GMAV_KERNEL_32_TO_24_SWAP;
+	}
+	else if (streamFormat == GMAV_STREAM_BGRA32)
+	{
+		if (inputFormat == GMAV_PIXEL_BGR24)
+			kernel = GMAV_KERNEL_24_TO_32;
+		else if (inputFormat == GMAV_PIXEL_RGB24)
+			kernel = GMAV_KERNEL_24_TO_32_SWAP;
+		else if (inputFormat == GMAV_PIXEL_RGBA32)
+			kernel = GMAV_KERNEL_32_SWAP;
+	}
+	else if (gmav_stream_is_yuv(streamFormat))
+		kernel = gmav_select_yuv(convert, kernels, inputFormat, streamFormat);
+	else
+		return (false);
+
+	if (kernel >= 0)
+		convert->row = kernels[kernel];
+	return (true);
+}
+
+bool	gmav_convert_setup(
+	gmavi_convert_t *convert,
+	uint32_t inputFormat,
+	uint32_t streamFormat,
+	uint32_t width,
+	uint32_t height,
+	size_t inputStride,
+	bool flip)
+{
+	uint32_t	inputSize = gmav_pixel_size(inputFormat);
+
+	memset(convert, 0, sizeof(gmavi_convert_t));
+	convert->dstStride = gmav_stream_row_size(streamFormat, width);
+	if (inputSize == 0 || convert->dstStride == 0
+		|| !gmav_select_row(convert, inputFormat, streamFormat))
+		return (false);
+	if (convert->expand != NULL)
+	{
+		convert->scratch = (uint8_t *)malloc((size_t)width * 4);
+		if (convert->scratch == NULL)
+			return (false);
+	}
+	convert->width = width;
+	convert->height = height;
+	convert->srcStride = inputStride ? inputStride : (size_t)width * inputSize;
+	convert->flip = flip;
+	convert->identity = convert->row == NULL && !flip && convert->srcStride == convert->dstStride;
+	return (true);
+}
+
+void	gmav_convert_frame(
+	const gmavi_convert_t *convert,
+	uint8_t *dst,
+	const uint8_t *src)
+{
+	for (uint32_t y = 0; y < convert->height; y++) {
+		const uint8_t	*srcRow = src + convert->srcStride * (convert->flip ? convert->height - 1 - y : y);
+		uint8_t			*dstRow = dst + convert->dstStride * y;
+
+		if (convert->expand != NULL)
+		{
+			convert->expand(convert->scratch, srcRow, convert->width);
+			srcRow = convert->scratch;
+		}
+		if (convert->row != NULL)
+			convert->row(dstRow, srcRow, convert->width);
+		else
+			memcpy(dstRow, srcRow, convert->dstStride);
+	}
+}
+
+void	gmav_convert_release(
+	gmavi_convert_t *convert)
+{
+	free(convert->scratch);
+	convert->scratch = NULL;
+}
+
+/*
+*	Frame comparison, in blocks of @GMAV_DIFF_BLOCK bytes
+*/
+# define GMAV_DIFF_BLOCK	64
+
+static size_t	gmav_diff_tail(const uint8_t *frame, const uint8_t *previous, size_t offset, size_t size)
+{
+	for (; offset < size; offset += GMAV_DIFF_BLOCK) {
+		size_t	length = size - offset < GMAV_DIFF_BLOCK ? size - offset : GMAV_DIFF_BLOCK;
+
+		if (memcmp(frame + offset, previous + offset, length) != 0)
+			return (offset);
+	}
+	return (size);
+}
+
+#ifdef GMAV_X86
+
+static size_t	gmav_sse2_frame_diff(const uint8_t *frame, const uint8_t *previous, size_t size)
+{
+	size_t	offset = 0;
+
+	for (; offset + GMAV_DIFF_BLOCK <= size; offset += GMAV_DIFF_BLOCK) {
+		__m128i	same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(frame + offset)),
+			_mm_loadu_si128((const __m128i *)(previous + offset)));
+
+		for (uint32_t i = 16; i < GMAV_DIFF_BLOCK; i += 16)
+			same = _mm_and_si128(same, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(frame + offset + i)),
+				_mm_loadu_si128((const __m128i *)(previous + offset + i))));
+		if (_mm_movemask_epi8(same) != 0xFFFF)
+			return (offset);
+	}
+	return (gmav_diff_tail(frame, previous, offset, size));
+}
+
+GMAV_TARGET("avx2")
+static size_t	gmav_avx2_frame_diff(const uint8_t *frame, const uint8_t *previous, size_t size)
+{
+	size_t	offset = 0;
+
+	for (; offset + GMAV_DIFF_BLOCK <= size; offset += GMAV_DIFF_BLOCK) {
+		__m256i	low = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(frame + offset)),
+			_mm256_loadu_si256((const __m256i *)(previous + offset)));
+		__m256i	high = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(frame + offset + 32)),
+			_mm256_loadu_si256((const __m256i *)(previous + offset + 32)));
+
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_and_si256(low, high)) != 0xFFFFFFFFu)
+			return (offset);
+	}
+	return (gmav_diff_tail(frame, previous, offset, size));
+}
+
+#elif defined(GMAV_NEON)
+
+static size_t	gmav_neon_frame_diff(const uint8_t *frame, const uint8_t *previous, size_t size)
+{
+	size_t	offset = 0;
+
+	for (; offset + GMAV_DIFF_BLOCK <= size; offset += GMAV_DIFF_BLOCK) {
+		uint8x16_t	same = vceqq_u8(vld1q_u8(frame + offset), vld1q_u8(previous + offset));
+
+		for (uint32_t i = 16; i < GMAV_DIFF_BLOCK; i += 16)
+			same = vandq_u8(same, vceqq_u8(vld1q_u8(frame + offset + i), vld1q_u8(previous + offset + i)));
+
+		uint64x2_t	lanes = vreinterpretq_u64_u8(same);
+
+		if ((vgetq_lane_u64(lanes, 0) & vgetq_lane_u64(lanes, 1)) != ~(uint64_t)0)
+			return (offset);
+	}
+	return (gmav_diff_tail(frame, previous, offset, size));
+}
+
+#else
+
+static size_t	gmav_frame_diff_c(const uint8_t *frame, const uint8_t *previous, size_t size)
+{
+	return (gmav_diff_tail(frame, previous, 0, size));
+}
+
+#endif
+
+gmavi_diff_t	gmav_select_diff(void)
+{
+#ifdef GMAV_X86
+	if (gmav_cpu_avx2())
+		return (gmav_avx2_frame_diff);
+	return (gmav_sse2_frame_diff);
+#elif defined(GMAV_NEON)
+	return (gmav_neon_frame_diff);
+#else
+	return (gmav_frame_diff_c);
+#endif
+}
+
+/*
+*	Proxy downscaling, the rows under one output row are summed per byte first
+*	(the bulk of the work), then every @factor columns are folded into a pixel
+*/
+static void	gmav_accumulate_c(uint16_t *sums, const uint8_t *src, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		sums[i] += src[i];
+}
+
+#ifdef GMAV_X86
+
+static void	gmav_sse2_accumulate(uint16_t *sums, const uint8_t *src, size_t size)
+{
+	__m128i	zero = _mm_setzero_si128();
+	size_t	i = 0;
+
+	for (; i + 16 <= size; i += 16) {
+		__m128i	bytes = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i	*sum = (__m128i *)(sums + i);
+
+		_mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), _mm_unpacklo_epi8(bytes, zero)));
+		_mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi8(bytes, zero)));
+	}
+	gmav_accumulate_c(sums + i, src + i, size - i);
+}
+
+GMAV_TARGET("avx2")
+static void	gmav_avx2_accumulate(uint16_t *sums, const uint8_t *src, size_t size)
+{
+	size_t	i = 0;
+
+	for (; i + 16 <= size; i += 16) {
+		__m256i	*sum = (__m256i *)(sums + i);
+		__m256i	words = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+
+		_mm256_storeu_si256(sum, _mm256_add_epi16(_mm256_loadu_si256(sum), words));
+	}
+	gmav_accumulate_c(sums + i, src + i, size - i);
+}
+
+#elif defined(GMAV_NEON)
+
+static void	gmav_neon_accumulate(uint16_t *sums, const uint8_t *src, size_t size)
+{
+	size_t	i = 0;
+
+	for (; i + 8 <= size; i += 8)
+		vst1q_u16(sums + i, vaddw_u8(vld1q_u16(sums + i), vld1_u8(src + i)));
+	gmav_accumulate_c(sums + i, src + i, size - i);
+}
+
+#endif
+
+static void	gmav_downscale_rgb(const gmavi_downscale_t *scale, uint8_t *dst)
+{
+	uint32_t	round = 1u << (scale->shift - 1);
+
+	for (uint32_t x = 0; x < scale->width; x++) {
+		const uint16_t	*sum = scale->sums + (size_t)x * scale->factor * scale->pixelSize;
+
+		for (uint32_t c = 0; c < scale->pixelSize; c++) {
+			uint32_t	total = round;
+
+			for (uint32_t k = 0; k < scale->factor; k++)
+				total += sum[k * scale->pixelSize + c];
+			*dst++ = (uint8_t)(total >> scale->shift);
+		}
+	}
+}
+
+/*
+*	4:2:2 pixel pairs: each output luma covers @factor / 2 input pairs, each
+*	output chroma all @factor pairs under the output pair
+*/
+static void	gmav_downscale_yuv(const gmavi_downscale_t *scale, uint8_t *dst)
+{
+	uint32_t	round = 1u << (scale->shift - 1);
+	uint32_t	luma = scale->lumaOffset;
+	uint32_t	chroma = luma ^ 1;
+	uint32_t	half = scale->factor / 2;
+
+	for (uint32_t x = 0; x < scale->width / 2; x++) {
+		const uint16_t	*sum = scale->sums + (size_t)x * scale->factor * 4;
+		uint32_t		y0 = round;
+		uint32_t		y1 = round;
+		uint32_t		u = round;
+		uint32_t		v = round;
+
+		for (uint32_t k = 0; k < half; k++) {
+			y0 += sum[k * 4 + luma] + sum[k * 4 + luma + 2];
+			y1 += sum[(k + half) * 4 + luma] + sum[(k + half) * 4 + luma + 2];
+		}
+		for (uint32_t k = 0; k < scale->factor; k++) {
+			u += sum[k * 4 + chroma];
+			v += sum[k * 4 + chroma + 2];
+		}
+		dst[luma] = (uint8_t)(y0 >> scale->shift);
+		dst[luma + 2] = (uint8_t)(y1 >> scale->shift);
+		dst[chroma] = (uint8_t)(u >> scale->shift);
+		dst[chroma + 2] = (uint8_t)(v >> scale->shift);
+		dst += 4;
+	}
+}
+
+bool	gmav_downscale_setup(
+	gmavi_downscale_t *scale,
+	uint32_t streamFormat,
+	uint32_t width,
+	uint32_t height,
+	uint32_t factor,
+	size_t srcStride,
+	size_t dstStride)
+{
+	memset(scale, 0, sizeof(gmavi_downscale_t));
+	if (factor != 2 && factor != 4)
+		return (false);
+	switch (streamFormat)
+	{
+		case GMAV_STREAM_BGR24:
+			scale->pixelSize = 3;
+			break ;
+		case GMAV_STREAM_BGRA32:
+			scale->pixelSize = 4;
+			break ;
+		case GMAV_STREAM_UYVY:
+		case GMAV_STREAM_YUY2:
+			scale->pixelSize = 2;
+			scale->lumaOffset = streamFormat == GMAV_STREAM_UYVY;
+			scale->fold = gmav_downscale_yuv;
+			break ;
+		default:
+			return (false);
+	}
+	if (scale->fold == NULL)
+		scale->fold = gmav_downscale_rgb;
+	scale->width = width;
+	scale->height = height;
+	scale->factor = factor;
+	scale->shift = factor == 2 ? 2 : 4;
+	scale->rowSize = (size_t)width * factor * scale->pixelSize;
+	scale->srcStride = srcStride;
+	scale->dstStride = dstStride;
+	scale->sums = (uint16_t *)malloc(scale->rowSize * sizeof(uint16_t));
+	if (scale->sums == NULL)
+		return (false);
+	scale->accumulate = gmav_accumulate_c;
+#ifdef GMAV_X86
+	scale->accumulate = gmav_cpu_avx2() ? gmav_avx2_accumulate : gmav_sse2_accumulate;
+#elif defined(GMAV_NEON)
+	scale->accumulate = gmav_neon_accumulate;
+#endif
+	return (true);
+}
+
+void	gmav_downscale_frame(
+	const gmavi_downscale_t *scale,
+	uint8_t *dst,
+	const uint8_t *src)
+{
+	for (uint32_t y = 0; y < scale->height; y++) {
+		memset(scale->sums, 0, scale->rowSize * sizeof(uint16_t));
+		for (uint32_t k = 0; k < scale->factor; k++)
+			scale->accumulate(scale->sums, src + scale->srcStride * ((size_t)y * scale->factor + k), scale->rowSize);
+		scale->fold(scale, dst + scale->dstStride * y);
+	}
+}
+
+void	gmav_downscale_release(
+	gmavi_downscale_t *scale)
+{
+	free(scale->sums);
+	scale->sums = NULL;
+}
@@ -0,0 +1,164 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_PIXEL_H
+# define GMAV_PIXEL_H
+# include <stdint.h>
+# include <stdbool.h>
+# include <stddef.h>
+
+/*
+*	Converts one row of @width pixels
+*/
+typedef void	(*gmavi_row_t)(uint8_t *dst, const uint8_t *src, uint32_t width);
+
+/*
+*	Input to stream conversion of a whole frame
+*
+*	@param	row				-	Row kernel, NULL when rows only need to be copied
+*	@param	expand			-	Widens 24bpp input rows to 32bpp into @scratch before @row
+*	@param	srcStride		-	Bytes between two input rows
+*	@param	dstStride		-	Bytes between two stream rows
+*	@param	flip			-	Input and stream rows are in opposite order
+*	@param	identity		-	Input already is the stream layout, nothing to do
+*/
+typedef struct	s_gmavi_convert
+{
+	gmavi_row_t		row;
+	gmavi_row_t		expand;
+	uint8_t			*scratch;
+	uint32_t		width;
+	uint32_t		height;
+	size_t			srcStride;
+	size_t			dstStride;
+	bool			flip;
+	bool			identity;
+}	gmavi_convert_t;
+
+/*
+*	Bytes per pixel of a GMAV_PIXEL_* input format
+*/
+uint32_t	gmav_pixel_size(uint32_t pixelFormat);
+
+/*
+*	Bits per pixel (DIB bitCount) of a GMAV_STREAM_* format, 0 when unknown
+*/
+uint32_t	gmav_stream_bit_count(uint32_t streamFormat);
+
+/*
+*	Bytes per stream row of @width pixels, including any padding of the format.
+*	0 when the format does not exist or can not hold @width pixels
+*/
+size_t		gmav_stream_row_size(uint32_t streamFormat, uint32_t width);
+
+/*
+*	YUV streams are always stored top row first
+*/
+bool		gmav_stream_is_yuv(uint32_t streamFormat);
+
+/*
+*	Pick the conversion for @inputFormat to @streamFormat, using the best kernels
+*	this CPU offers (AVX2, SSSE3/SSE2 or NEON). RGB to YUV uses BT.709 studio range.
+*
+*	@param	inputStride		-	Bytes between input rows, 0 when tightly packed
+*	@return	false when the formats can not be converted
+*/
+bool		gmav_convert_setup(gmavi_convert_t *convert, uint32_t inputFormat, uint32_t streamFormat,
+				uint32_t width, uint32_t height, size_t inputStride, bool flip);
+
+/*
+*	Convert a full frame, @dst holds the stream layout
+*/
+void		gmav_convert_frame(const gmavi_convert_t *convert, uint8_t *dst, const uint8_t *src);
+
+/*
+*	Free what gmav_convert_setup allocated, safe on a zeroed convert
+*/
+void		gmav_convert_release(gmavi_convert_t *convert);
+
+/*
+*	Offset of the first 64 byte block in which @frame and @previous differ,
+*	@size when both are equal
+*/
+typedef size_t	(*gmavi_diff_t)(const uint8_t *frame, const uint8_t *previous, size_t size);
+
+/*
+*	Fastest frame comparison this CPU offers (AVX2, SSE2 or NEON)
+*/
+gmavi_diff_t	gmav_select_diff(void);
+
+/*
+*	Adds @size bytes of a source row to 16 bit sums
+*/
+typedef void	(*gmavi_accumulate_t)(uint16_t *sums, const uint8_t *src, size_t size);
+
+/*
+*	Box filter shrinking a stream frame by @factor in both directions
+*
+*	@param	accumulate		-	Row summing kernel (AVX2, SSE2 or NEON)
+*	@param	fold			-	Turns the row sums into one output row
+*	@param	sums			-	Sums of the @factor source rows under one output row
+*	@param	width			-	Output width, @height output rows
+*	@param	shift			-	log2 of the amount of source samples in one output sample
+*	@param	rowSize			-	Source bytes read per row
+*	@param	pixelSize		-	Bytes per pixel, 2 for 4:2:2 streams
+*	@param	lumaOffset		-	Byte of the first luma sample in a 4:2:2 pair
+*/
+typedef struct	s_gmavi_downscale
+{
+	gmavi_accumulate_t	accumulate;
+	void				(*fold)(const struct s_gmavi_downscale *scale, uint8_t *dst);
+	uint16_t			*sums;
+	uint32_t			width;
+	uint32_t			height;
+	uint32_t			factor;
+	uint32_t			shift;
+	size_t				rowSize;
+	size_t				srcStride;
+	size_t				dstStride;
+	uint32_t			pixelSize;
+	uint32_t			lumaOffset;
+}	gmavi_downscale_t;
+
+/*
+*	Set up downscaling of @streamFormat frames to @width x @height, a @factor
+*	(2 or 4) of the source size. V210 is not supported
+*
+*	@return	false when the format or factor is not supported, or out of memory
+*/
+bool		gmav_downscale_setup(gmavi_downscale_t *scale, uint32_t streamFormat, uint32_t width,
+				uint32_t height, uint32_t factor, size_t srcStride, size_t dstStride);
+
+/*
+*	Downscale a full frame, @dst and @src are both in the stream layout
+*/
+void		gmav_downscale_frame(const gmavi_downscale_t *scale, uint8_t *dst, const uint8_t *src);
+
+/*
+*	Free what gmav_downscale_setup allocated, safe on a zeroed downscale
+*/
+void		gmav_downscale_release(gmavi_downscale_t *scale);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "gmav_pool.h"
+
+static void	gmav_pool_worker(void *arg)
+{
+	gmavi_pool_t	*pool = (gmavi_pool_t *)arg;
+
+	gmav_mutex_lock(&pool->lock);
+	while (true)
+	{
+		while (!pool->stopping && pool->next >= pool->count)
+			gmav_cond_wait(&pool->wake, &pool->lock);
+		if (pool->stopping)
+			break ;
+
+		uint32_t	index = pool->next++;
+
+		gmav_mutex_unlock(&pool->lock);
+		pool->job(pool->ctx, index);
+		gmav_mutex_lock(&pool->lock);
+		if (++pool->finished == pool->count)
+			gmav_cond_signal(&pool->done);
+	}
+	gmav_mutex_unlock(&pool->lock);
+}
+
+bool	gmav_pool_start(
+	gmavi_pool_t *pool,
+	uint32_t workers)
+{
+	memset(pool, 0, sizeof(gmavi_pool_t));
+	if (!gmav_mutex_init(&pool->lock))
+		return (false);
+	gmav_cond_init(&pool->wake);
+	gmav_cond_init(&pool->done);
+	pool->ready = true;
+	if (workers == 0)
+		return (true);
+	pool->threads = (gmavi_thread_t *)calloc(workers, sizeof(gmavi_thread_t));
+	if (pool->threads == NULL)
+		return (false);
+	for (; pool->workers < workers; pool->workers++) {
+		if (!gmav_thread_start(&pool->threads[pool->workers], gmav_pool_worker, pool, -1))
+			return (false);
+	}
+	return (true);
+}
+
+void	gmav_pool_run(
+	gmavi_pool_t *pool,
+	gmavi_job_t job,
+	void *ctx,
+	uint32_t count)
+{
+	gmav_mutex_lock(&pool->lock);
+	pool->job = job;
+	pool->ctx = ctx;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->count = count;
+	gmav_cond_broadcast(&pool->wake);
+	while (pool->next < pool->count)
+	{
+		uint32_t	index = pool->next++;
+
+		gmav_mutex_unlock(&pool->lock);
+		job(ctx, index);
+		gmav_mutex_lock(&pool->lock);
+		pool->finished += 1;
+	}
+	while (pool->finished < pool->count)
+		gmav_cond_wait(&pool->done, &pool->lock);
+	/*	Idle again, workers go back to sleep	*/
+	pool->count = 0;
+	pool->next = 0;
+	gmav_mutex_unlock(&pool->lock);
+}
+
+void	gmav_pool_destroy(
+	gmavi_pool_t *pool)
+{
+	if (!pool->ready)
+		return ;
+	gmav_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	gmav_cond_broadcast(&pool->wake);
+	gmav_mutex_unlock(&pool->lock);
+	for (uint32_t i = 0; i < pool->workers; i++)
+		gmav_thread_join(&pool->threads[i]);
+	free(pool->threads);
+	gmav_cond_destroy(&pool->wake);
+	gmav_cond_destroy(&pool->done);
+	gmav_mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof(gmavi_pool_t));
+}
@@ -0,0 +1,80 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_POOL_H
+# define GMAV_POOL_H
+# include <stdint.h>
+# include <stdbool.h>
+# include "gmav_thread.h"
+
+/*
+*	Job callback, runs once for every index of a gmav_pool_run batch
+*/
+typedef void	(*gmavi_job_t)(void *ctx, uint32_t index);
+
+/*
+*	Fixed set of worker threads sharing batches of indexed jobs
+*
+*	@param	workers			-	Threads started next to the caller, may be zero
+*	@param	job				-	Job of the running batch
+*	@param	next			-	Next index to hand out
+*	@param	count			-	Indices in the running batch, zero when idle
+*	@param	finished		-	Indices done
+*	@param	stopping		-	Workers should exit
+*	@param	ready			-	Lock and conditions are initialised
+*/
+typedef struct	s_gmavi_pool
+{
+	uint32_t		workers;
+	gmavi_thread_t	*threads;
+	gmavi_job_t		job;
+	void			*ctx;
+	uint32_t		next;
+	uint32_t		count;
+	uint32_t		finished;
+	bool			stopping;
+	bool			ready;
+	gmavi_mutex_t	lock;
+	gmavi_cond_t	wake;
+	gmavi_cond_t	done;
+}	gmavi_pool_t;
+
+/*
+*	Start @workers threads. A pool without workers runs every job on the caller
+*/
+bool	gmav_pool_start(gmavi_pool_t *pool, uint32_t workers);
+
+/*
+*	Run @job for indices [0, @count) and wait for all of them, the calling
+*	thread takes jobs as well. Only one thread may run batches at a time.
+*/
+void	gmav_pool_run(gmavi_pool_t *pool, gmavi_job_t job, void *ctx, uint32_t count);
+
+/*
+*	Stop and join the workers. Safe on a zeroed pool.
+*/
+void	gmav_pool_destroy(gmavi_pool_t *pool);
+
+#endif
@@ -0,0 +1,257 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gmav_queue.h"
+#include "gmav_io.h"
+
+static void	gmav_queue_run(void *arg)
+{
+	gmavi_queue_t	*queue = (gmavi_queue_t *)arg;
+
+	gmav_mutex_lock(&queue->lock);
+	while (true)
+	{
+		while (queue->head == queue->tail && !queue->stopping)
+			gmav_cond_wait(&queue->filled, &queue->lock);
+		if (queue->head == queue->tail)
+			break ;
+
+		uint8_t	*slot = queue->slots[queue->tail % queue->depth];
+		bool	failed = queue->failed;
+
+		gmav_mutex_unlock(&queue->lock);
+		/*	After a failure the ring keeps draining so the producer never blocks forever	*/
+		if (!failed && !queue->consume(queue->ctx, slot))
+		{
+			int	error = errno;
+
+			gmav_mutex_lock(&queue->lock);
+			queue->failed = true;
+			queue->error = error ? error : EIO;
+		}
+		else
+			gmav_mutex_lock(&queue->lock);
+		queue->tail += 1;
+		gmav_cond_signal(&queue->drained);
+	}
+	gmav_mutex_unlock(&queue->lock);
+}
+
+bool	gmav_queue_start(
+	gmavi_queue_t *queue,
+	uint32_t depth,
+	size_t slotSize,
+	int32_t cpu,
+	gmavi_frames_t *frames,
+	gmavi_consume_t consume,
+	void *ctx)
+{
+	memset(queue, 0, sizeof(gmavi_queue_t));
+	queue->slots = (uint8_t **)calloc(depth, sizeof(uint8_t *));
+	if (queue->slots == NULL)
+		return (false);
+	queue->depth = depth;
+	queue->slotSize = slotSize;
+	queue->frames = frames;
+	queue->consume = consume;
+	queue->ctx = ctx;
+	for (uint32_t i = 0; i < depth; i++) {
+		if (frames != NULL)
+			queue->slots[i] = gmav_frames_take(frames);
+		else
+			queue->slots[i] = (uint8_t *)gmav_aligned_alloc(slotSize);
+		if (queue->slots[i] == NULL)
+		{
+			gmav_queue_destroy(queue);
+			return (false);
+		}
+	}
+	if (!gmav_mutex_init(&queue->lock))
+	{
+		gmav_queue_destroy(queue);
+		return (false);
+	}
+	gmav_cond_init(&queue->filled);
+	gmav_cond_init(&queue->drained);
+	if (!gmav_thread_start(&queue->thread, gmav_queue_run, queue, cpu))
+	{
+		gmav_cond_destroy(&queue->filled);
+		gmav_cond_destroy(&queue->drained);
+		gmav_mutex_destroy(&queue->lock);
+		gmav_queue_destroy(queue);
+		return (false);
+	}
+	queue->running = true;
+	return (true);
+}
+
+/*
+*	Wait under the lock until the slot at head is free
+*
+*	@return	GMAV_QUEUE_QUEUED with the lock still held, otherwise unlocked
+*/
+static int	gmav_queue_wait(gmavi_queue_t *queue, bool block)
+{
+	gmav_mutex_lock(&queue->lock);
+	while (!queue->failed && queue->head - queue->tail == queue->depth)
+	{
+		if (!block)
+		{
+			queue->dropped += 1;
+			gmav_mutex_unlock(&queue->lock);
+			return (GMAV_QUEUE_DROPPED);
+		}
+		queue->stalls += 1;
+		gmav_cond_wait(&queue->drained, &queue->lock);
+	}
+	if (queue->failed)
+	{
+		gmav_mutex_unlock(&queue->lock);
+		return (GMAV_QUEUE_FAILED);
+	}
+	return (GMAV_QUEUE_QUEUED);
+}
+
+int		gmav_queue_push(
+	gmavi_queue_t *queue,
+	const uint8_t *data,
+	bool block,
+	gmavi_fill_t fill)
+{
+	int		result = gmav_queue_wait(queue, block);
+
+	if (result != GMAV_QUEUE_QUEUED)
+		return (result);
+	uint8_t	*slot = queue->slots[queue->head % queue->depth];
+	gmav_mutex_unlock(&queue->lock);
+
+	/*	Single producer: the slot is not visible to the consumer until published	*/
+	if (fill != NULL)
+		fill(queue->ctx, slot, data);
+	else
+		memcpy(slot, data, queue->slotSize);
+
+	gmav_mutex_lock(&queue->lock);
+	queue->head += 1;
+	gmav_cond_signal(&queue->filled);
+	gmav_mutex_unlock(&queue->lock);
+	return (GMAV_QUEUE_QUEUED);
+}
+
+int		gmav_queue_swap(
+	gmavi_queue_t *queue,
+	uint8_t **data,
+	bool block)
+{
+	int		result = gmav_queue_wait(queue, block);
+
+	if (result != GMAV_QUEUE_QUEUED)
+		return (result);
+
+	/*	The slot at head is free, the consumer only looks at it once published	*/
+	uint8_t	*slot = queue->slots[queue->head % queue->depth];
+
+	queue->slots[queue->head % queue->depth] = *data;
+	*data = slot;
+	queue->head += 1;
+	gmav_cond_signal(&queue->filled);
+	gmav_mutex_unlock(&queue->lock);
+	return (GMAV_QUEUE_QUEUED);
+}
+
+bool	gmav_queue_keep(gmavi_queue_t *queue)
+{
+	if (queue->frames == NULL)
+		return (false);
+
+	uint8_t	*fresh = gmav_frames_take(queue->frames);
+
+	if (fresh == NULL)
+		return (false);
+
+	/*	The producer never touches the slot at tail, the lock only orders the store	*/
+	gmav_mutex_lock(&queue->lock);
+	queue->slots[queue->tail % queue->depth] = fresh;
+	gmav_mutex_unlock(&queue->lock);
+	return (true);
+}
+
+bool	gmav_queue_room(gmavi_queue_t *queue)
+{
+	gmav_mutex_lock(&queue->lock);
+	bool	room = queue->failed || queue->head - queue->tail < queue->depth;
+	gmav_mutex_unlock(&queue->lock);
+	return (room);
+}
+
+void	gmav_queue_counters(gmavi_queue_t *queue, uint32_t *used, uint64_t *dropped, uint64_t *stalls)
+{
+	if (queue->running)
+		gmav_mutex_lock(&queue->lock);
+	*used = (uint32_t)(queue->head - queue->tail);
+	*dropped = queue->dropped;
+	*stalls = queue->stalls;
+	if (queue->running)
+		gmav_mutex_unlock(&queue->lock);
+}
+
+bool	gmav_queue_stop(gmavi_queue_t *queue)
+{
+	if (queue->running)
+	{
+		gmav_mutex_lock(&queue->lock);
+		queue->stopping = true;
+		gmav_cond_signal(&queue->filled);
+		gmav_mutex_unlock(&queue->lock);
+		gmav_thread_join(&queue->thread);
+		gmav_cond_destroy(&queue->filled);
+		gmav_cond_destroy(&queue->drained);
+		gmav_mutex_destroy(&queue->lock);
+		queue->running = false;
+	}
+	if (queue->failed)
+		errno = queue->error;
+	return (!queue->failed);
+}
+
+void	gmav_queue_destroy(gmavi_queue_t *queue)
+{
+	gmav_queue_stop(queue);
+	if (queue->slots != NULL)
+	{
+		for (uint32_t i = 0; i < queue->depth; i++) {
+			if (queue->frames != NULL)
+				gmav_frames_give(queue->frames, queue->slots[i]);
+			else
+				gmav_aligned_free(queue->slots[i]);
+		}
+		free(queue->slots);
+	}
+	queue->slots = NULL;
+	queue->depth = 0;
+}
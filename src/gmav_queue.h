@@ -0,0 +1,150 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_QUEUE_H
+# define GMAV_QUEUE_H
+# include <stdint.h>
+# include <stdbool.h>
+# include <stddef.h>
+# include "gmav_thread.h"
+# include "gmav_frames.h"
+
+/*	gmav_queue_push results	*/
+# define GMAV_QUEUE_QUEUED		0
+# define GMAV_QUEUE_DROPPED		1
+# define GMAV_QUEUE_FAILED		2
+
+/*
+*	Consumer callback, runs on the queue thread. Returning false stops all
+*	further consumption, errno is kept as the queue error.
+*/
+typedef bool	(*gmavi_consume_t)(void *ctx, const uint8_t *slot);
+
+/*
+*	Producer callback, fills @slot from @data on the producing thread
+*/
+typedef void	(*gmavi_fill_t)(void *ctx, uint8_t *slot, const uint8_t *data);
+
+/*
+*	Bounded single producer / single consumer ring of fixed size slots
+*
+*	@param	depth			-	Amount of slots, zero when the queue is not running
+*	@param	slotSize		-	Size of every slot
+*	@param	slots			-	@GMAV_IO_SECTOR aligned slot buffers
+*	@param	frames			-	Pool the slots were taken from, NULL when they are owned
+*	@param	head			-	Slots published by the producer
+*	@param	tail			-	Slots released by the consumer
+*	@param	running			-	The consumer thread has been started and not joined yet
+*	@param	stopping		-	Producer is done, drain and exit
+*	@param	failed			-	The consumer returned false
+*	@param	error			-	errno of the failure
+*	@param	dropped			-	Pushes rejected because the ring was full
+*	@param	stalls			-	Pushes that had to wait for the consumer
+*/
+typedef struct	s_gmavi_queue
+{
+	uint32_t		depth;
+	size_t			slotSize;
+	uint8_t			**slots;
+	gmavi_frames_t	*frames;
+	uint64_t		head;
+	uint64_t		tail;
+	bool			running;
+	bool			stopping;
+	bool			failed;
+	int				error;
+	uint64_t		dropped;
+	uint64_t		stalls;
+	gmavi_consume_t	consume;
+	void			*ctx;
+	gmavi_mutex_t	lock;
+	gmavi_cond_t	filled;
+	gmavi_cond_t	drained;
+	gmavi_thread_t	thread;
+}	gmavi_queue_t;
+
+/*
+*	Allocate the ring and start the consumer thread
+*
+*	@param	cpu				-	CPU to pin the consumer thread to, negative for none
+*	@param	frames			-	Take the slots from this pool so they can be swapped with its
+*								buffers, NULL to allocate them
+*/
+bool	gmav_queue_start(gmavi_queue_t *queue, uint32_t depth, size_t slotSize, int32_t cpu, gmavi_frames_t *frames, gmavi_consume_t consume, void *ctx);
+
+/*
+*	Copy @data into the next free slot
+*
+*	@param	block			-	Wait for a free slot instead of dropping @data
+*	@param	fill			-	Fills the slot from @data, NULL for a plain copy
+*	@return	GMAV_QUEUE_QUEUED, GMAV_QUEUE_DROPPED or GMAV_QUEUE_FAILED
+*/
+int		gmav_queue_push(gmavi_queue_t *queue, const uint8_t *data, bool block, gmavi_fill_t fill);
+
+/*
+*	Publish @*data as the next slot without copying it, only for queues
+*	started with a pool. On GMAV_QUEUE_QUEUED @*data is replaced by the buffer
+*	that used to back the slot, which now belongs to the caller.
+*
+*	@param	block			-	Wait for a free slot instead of dropping @*data
+*	@return	GMAV_QUEUE_QUEUED, GMAV_QUEUE_DROPPED or GMAV_QUEUE_FAILED
+*/
+int		gmav_queue_swap(gmavi_queue_t *queue, uint8_t **data, bool block);
+
+/*
+*	From the consumer callback only: the slot being consumed is kept by the
+*	caller and replaced by a fresh pool buffer. Hand it back to the pool once
+*	done with it.
+*
+*	@return	false when the queue has no pool or it is out of memory, the slot
+*			then stays with the queue
+*/
+bool	gmav_queue_keep(gmavi_queue_t *queue);
+
+/*
+*	Whether a push would find a free slot right away. With a single producer
+*	this stays true until that producer pushes.
+*/
+bool	gmav_queue_room(gmavi_queue_t *queue);
+
+/*
+*	Slots in use, drops and stalls so far. Safe from any thread while the queue runs
+*/
+void	gmav_queue_counters(gmavi_queue_t *queue, uint32_t *used, uint64_t *dropped, uint64_t *stalls);
+
+/*
+*	Consume everything still queued and join the thread
+*
+*	@return	false when the consumer failed at any point
+*/
+bool	gmav_queue_stop(gmavi_queue_t *queue);
+
+/*
+*	Release the ring, stops the thread first when it is still running.
+*	Safe on a zeroed queue.
+*/
+void	gmav_queue_destroy(gmavi_queue_t *queue);
+
+#endif
@@ -0,0 +1,642 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "../include/libgmavi.h"
+#include "aviStruct.h"
+#include "gmav_pool.h"
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+/*
+*	Where a frame's payload lies in the file
+*/
+typedef struct	s_gmavi_payload
+{
+	uint64_t			offset;
+	uint32_t			size;
+}	gmavi_payload_t;
+
+/*
+*	Reader state, the whole file is mapped read only for as long as it is open
+*
+*	@param	data			- Start of the mapping
+*	@param	size			- File size
+*	@param	fd / file		- The file, kept open for cache advice
+*	@param	pageSize		- Granularity of the mapping
+*	@param	info			- Stream properties handed out by gmav_get_info
+*	@param	chunkId			- '##d' of the video stream, its chunks end in 'b' or 'c'
+*	@param	superIndex		- The video stream's super index, NULL when it has none
+*	@param	movi			- Offset of the first movi list's fourcc, idx1 offsets are relative to it
+*	@param	oldIndex		- The idx1 chunk, NULL when there is none
+*	@param	frames			- Every frame's payload, in stream order
+*/
+typedef struct	s_gmavi_reader
+{
+	const uint8_t		*data;
+	uint64_t			size;
+#ifdef _WIN32
+	HANDLE				file;
+	HANDLE				mapping;
+#else
+	int					fd;
+#endif
+	uint64_t			pageSize;
+	gmavi_info_t		info;
+	uint32_t			chunkId;
+	const AVISUPERINDEX	*superIndex;
+	uint64_t			movi;
+	const RIFFCHUNK		*oldIndex;
+	gmavi_payload_t		*frames;
+}	gmavi_reader_t;
+
+static bool	gmav_map_file(gmavi_reader_t *reader, const char *filePath)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	size;
+	SYSTEM_INFO		system;
+
+	GetSystemInfo(&system);
+	reader->pageSize = system.dwPageSize;
+	reader->file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (reader->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(reader->file, &size) || size.QuadPart == 0)
+		return (false);
+	reader->size = (uint64_t)size.QuadPart;
+	reader->mapping = CreateFileMappingA(reader->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (reader->mapping == NULL)
+		return (false);
+	reader->data = (const uint8_t *)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+	return (reader->data != NULL);
+#else
+	struct stat	info;
+	void		*data;
+
+	reader->pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	reader->fd = open(filePath, O_RDONLY);
+	if (reader->fd < 0 || fstat(reader->fd, &info) || info.st_size <= 0)
+		return (false);
+	reader->size = (uint64_t)info.st_size;
+	data = mmap(NULL, (size_t)reader->size, PROT_READ, MAP_SHARED, reader->fd, 0);
+	if (data == MAP_FAILED)
+		return (false);
+	reader->data = (const uint8_t *)data;
+	return (true);
+#endif
+}
+
+static void	gmav_unmap_file(gmavi_reader_t *reader)
+{
+#ifdef _WIN32
+	if (reader->data != NULL)
+		UnmapViewOfFile(reader->data);
+	if (reader->mapping != NULL)
+		CloseHandle(reader->mapping);
+	if (reader->file != INVALID_HANDLE_VALUE)
+		CloseHandle(reader->file);
+#else
+	if (reader->data != NULL)
+		munmap((void *)reader->data, (size_t)reader->size);
+	if (reader->fd >= 0)
+		close(reader->fd);
+#endif
+}
+
+/*
+*	Ask for [@offset, @end) to be read in ahead of use, without waiting for it
+*/
+static void	gmav_prefetch(gmavi_reader_t *reader, uint64_t offset, uint64_t end)
+{
+	uint64_t	start = offset & ~(reader->pageSize - 1);
+
+#ifdef _WIN32
+# if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY	range = {(PVOID)(reader->data + start), (SIZE_T)(end - start)};
+
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+# else
+	(void)start;
+	(void)end;
+# endif
+#else
+	madvise((void *)(reader->data + start), (size_t)(end - start), MADV_WILLNEED);
+#endif
+}
+
+/*
+*	Drop the whole pages of [@offset, @end) from the mapping and the system cache
+*/
+static void	gmav_drop(gmavi_reader_t *reader, uint64_t offset, uint64_t end)
+{
+	offset = (offset + reader->pageSize - 1) & ~(reader->pageSize - 1);
+	end &= ~(reader->pageSize - 1);
+	if (end <= offset)
+		return;
+#ifdef _WIN32
+	/*	Unlocking pages that are not locked removes them from the working set	*/
+	VirtualUnlock((LPVOID)(reader->data + offset), (SIZE_T)(end - offset));
+#else
+	madvise((void *)(reader->data + offset), (size_t)(end - offset), MADV_DONTNEED);
+	posix_fadvise(reader->fd, (off_t)offset, (off_t)(end - offset), POSIX_FADV_DONTNEED);
+#endif
+}
+
+/*
+*	Chunk at @offset when its header and @size bytes of data lie before @end
+*/
+static const RIFFCHUNK	*gmav_chunk_at(gmavi_reader_t *reader, uint64_t offset, uint64_t end, uint32_t size)
+{
+	const RIFFCHUNK	*chunk;
+
+	if (offset + sizeof(RIFFCHUNK) > end)
+		return (NULL);
+	chunk = (const RIFFCHUNK *)(reader->data + offset);
+	if (chunk->cb < size || offset + sizeof(RIFFCHUNK) + chunk->cb > end)
+		return (NULL);
+	return (chunk);
+}
+
+/*
+*	Offset of the chunk after the one at @offset
+*/
+static uint64_t	gmav_next_chunk(const RIFFCHUNK *chunk, uint64_t offset)
+{
+	return (offset + sizeof(RIFFCHUNK) + chunk->cb + (chunk->cb & 1));
+}
+
+/*
+*	Stream list of the first video stream: its header, bitmap format and super index
+*/
+static void	gmav_parse_stream(gmavi_reader_t *reader, uint64_t offset, uint64_t end, uint32_t stream)
+{
+	const AVISTREAMHEADER	*header = NULL;
+	const RIFFCHUNK			*chunk;
+
+	for (; (chunk = gmav_chunk_at(reader, offset, end, 0)) != NULL; offset = gmav_next_chunk(chunk, offset)) {
+		if (chunk->fcc == FCC('strh') && chunk->cb >= STATIC_STREAM_HEADER_SIZE - 8)
+			header = (const AVISTREAMHEADER *)chunk;
+		if (header == NULL || header->fccType != FCC('vids'))
+			continue;
+		if (chunk->fcc == FCC('strf') && chunk->cb >= STATIC_BITMAP_HEADER_SIZE)
+		{
+			const BITMAPINFOHEADER	*bitmap = (const BITMAPINFOHEADER *)(chunk + 1);
+
+			reader->info.width = (uint32_t)bitmap->width;
+			reader->info.height = bitmap->height;
+			reader->info.compression = bitmap->compression;
+			reader->info.bitCount = bitmap->bitCount;
+		}
+		else if (chunk->fcc == FCC('indx') && chunk->cb >= sizeof(AVISUPERINDEX) - sizeof(RIFFCHUNK))
+			reader->superIndex = (const AVISUPERINDEX *)chunk;
+	}
+	if (header == NULL || header->fccType != FCC('vids'))
+		return;
+	reader->info.rate = header->rate;
+	reader->info.scale = header->scale;
+	/*	Two digit stream number and 'd', then 'b' or 'c'. Writers disagree on which
+		one FourCC formats like UYVY take, libgmavi itself only uses 'dc' for coded frames	*/
+	reader->chunkId = ('0' + stream / 10) | ('0' + stream % 10) << 8 | 'd' << 16;
+}
+
+/*
+*	Stream lists of the hdrl list, only the first video stream is used
+*/
+static void	gmav_parse_header(gmavi_reader_t *reader, uint64_t offset, uint64_t end)
+{
+	const RIFFCHUNK	*chunk;
+	uint32_t		stream = 0;
+
+	for (; (chunk = gmav_chunk_at(reader, offset, end, 0)) != NULL; offset = gmav_next_chunk(chunk, offset)) {
+		if (chunk->fcc != FOURCC_LIST || chunk->cb < 4 || ((const RIFFLIST *)chunk)->fccListType != FCC('strl'))
+			continue;
+		if (reader->chunkId == 0)
+			gmav_parse_stream(reader, offset + sizeof(RIFFLIST), gmav_next_chunk(chunk, offset), stream);
+		stream += 1;
+	}
+}
+
+/*
+*	Walk the first RIFF list: the stream lists in hdrl, the movi list and idx1
+*/
+static bool	gmav_parse_riff(gmavi_reader_t *reader)
+{
+	const RIFFLIST	*riff = (const RIFFLIST *)gmav_chunk_at(reader, 0, reader->size, 4);
+	const RIFFCHUNK	*chunk;
+	uint64_t		end;
+
+	if (riff == NULL || riff->fcc != FOURCC_RIFF || riff->fccListType != FOURCC_TYPE_VIDEO)
+		return (false);
+	end = sizeof(RIFFCHUNK) + riff->cb;
+	for (uint64_t offset = sizeof(RIFFLIST); (chunk = gmav_chunk_at(reader, offset, end, 0)) != NULL;
+		offset = gmav_next_chunk(chunk, offset)) {
+		const RIFFLIST	*list = (const RIFFLIST *)chunk;
+
+		if (chunk->fcc == FCC('idx1'))
+			reader->oldIndex = chunk;
+		if (chunk->fcc != FOURCC_LIST || chunk->cb < 4)
+			continue;
+		if (list->fccListType == FCC('movi') && reader->movi == 0)
+			reader->movi = offset + offsetof(RIFFLIST, fccListType);
+		if (list->fccListType == FCC('hdrl'))
+			gmav_parse_header(reader, offset + sizeof(RIFFLIST), gmav_next_chunk(chunk, offset));
+	}
+	return (reader->chunkId != 0 && reader->movi != 0);
+}
+
+/*
+*	Every frame listed by the ix00 chunks the super index points at
+*/
+static bool	gmav_read_std_indexes(gmavi_reader_t *reader)
+{
+	const AVISUPERINDEX_ENTRY	*entries = (const AVISUPERINDEX_ENTRY *)(reader->superIndex + 1);
+	uint64_t					total = 0;
+	uint32_t					used = reader->superIndex->entriesInUse;
+
+	if ((uint64_t)used * sizeof(AVISUPERINDEX_ENTRY) > reader->superIndex->cb + sizeof(RIFFCHUNK) - sizeof(AVISUPERINDEX))
+		return (false);
+	for (uint32_t i = 0; i < used; i++)
+		total += entries[i].duration;
+	if (total > UINT32_MAX)
+		return (false);
+	reader->frames = (gmavi_payload_t *)malloc(sizeof(gmavi_payload_t) * (size_t)(total ? total : 1));
+	if (reader->frames == NULL)
+		return (false);
+	for (uint32_t i = 0; i < used; i++) {
+		const AVISTDINDEX	*index = (const AVISTDINDEX *)gmav_chunk_at(reader, entries[i].offset, reader->size,
+			sizeof(AVISTDINDEX) - sizeof(RIFFCHUNK));
+
+		if (index == NULL || index->wLongsPerEntry != 2 || index->bIndexType != AVI_INDEX_OF_CHUNKS
+			|| (uint64_t)index->nEntriesInUse * sizeof(AVISTDINDEX_ENTRY) > index->cb + sizeof(RIFFCHUNK) - sizeof(AVISTDINDEX)
+			|| reader->info.frameCount + (uint64_t)index->nEntriesInUse > total)
+			return (false);
+
+		const AVISTDINDEX_ENTRY	*entry = (const AVISTDINDEX_ENTRY *)(index + 1);
+
+		/*	Bit 31 of the size marks a frame that is not a key frame	*/
+		for (uint32_t j = 0; j < index->nEntriesInUse; j++)
+			reader->frames[reader->info.frameCount++] = (gmavi_payload_t){
+				index->qwBaseOffset + entry[j].dwOffset, entry[j].dwSize & 0x7FFFFFFF};
+	}
+	return (true);
+}
+
+/*
+*	Every video frame listed by idx1, for files that do not have a super index.
+*	Offsets are relative to the movi fourcc, or absolute in some older files
+*/
+static bool	gmav_read_old_index(gmavi_reader_t *reader)
+{
+	const AVIOLDINDEX_ENTRY	*entries = (const AVIOLDINDEX_ENTRY *)(reader->oldIndex + 1);
+	uint32_t				count = reader->oldIndex->cb / sizeof(AVIOLDINDEX_ENTRY);
+	uint64_t				base = reader->movi;
+
+	reader->frames = (gmavi_payload_t *)malloc(sizeof(gmavi_payload_t) * (count ? count : 1));
+	if (reader->frames == NULL)
+		return (false);
+	for (uint32_t i = 0; i < count; i++) {
+		if ((entries[i].chunkId & 0xFFFFFF) != reader->chunkId
+			|| (entries[i].chunkId >> 24 != 'b' && entries[i].chunkId >> 24 != 'c'))
+			continue;
+		if (reader->info.frameCount == 0 && (base + entries[i].offset + sizeof(RIFFCHUNK) > reader->size
+			|| ((const RIFFCHUNK *)(reader->data + base + entries[i].offset))->fcc != entries[i].chunkId))
+			base = 0;
+		reader->frames[reader->info.frameCount++] = (gmavi_payload_t){
+			base + entries[i].offset + sizeof(RIFFCHUNK), entries[i].size};
+	}
+	return (true);
+}
+
+static void	gmav_reader_release(gmavi_reader_t *reader)
+{
+	gmav_unmap_file(reader);
+	free(reader->frames);
+	free(reader);
+}
+
+void	*gmav_open_read(
+	const char *filePath)
+{
+	gmavi_reader_t	*reader = (gmavi_reader_t *)calloc(1, sizeof(gmavi_reader_t));
+	bool			indexed;
+
+	if (reader == NULL)
+		return (NULL);
+#ifdef _WIN32
+	reader->file = INVALID_HANDLE_VALUE;
+#else
+	reader->fd = -1;
+#endif
+	if (!gmav_map_file(reader, filePath) || !gmav_parse_riff(reader))
+	{
+		printf("%s is not a readable AVI file\n", filePath);
+		gmav_reader_release(reader);
+		return (NULL);
+	}
+	if (reader->superIndex != NULL && reader->superIndex->fcc == FCC('indx')
+		&& reader->superIndex->indexType == AVI_INDEX_OF_INDEXES)
+		indexed = gmav_read_std_indexes(reader);
+	else
+		indexed = reader->oldIndex != NULL && gmav_read_old_index(reader);
+	if (!indexed)
+	{
+		printf("%s has no usable index, gmav_recover can rebuild it\n", filePath);
+		gmav_reader_release(reader);
+		return (NULL);
+	}
+	return (reader);
+}
+
+bool	gmav_get_info(
+	void *reader,
+	gmavi_info_t *info)
+{
+	if (reader == NULL || info == NULL)
+		return (false);
+	*info = ((gmavi_reader_t *)reader)->info;
+	return (true);
+}
+
+const uint8_t	*gmav_get_frame(
+	void *reader,
+	uint32_t index,
+	uint32_t *size)
+{
+	gmavi_reader_t	*in = (gmavi_reader_t *)reader;
+
+	if (in == NULL || index >= in->info.frameCount)
+		return (NULL);
+
+	gmavi_payload_t	frame = in->frames[index];
+
+	if (frame.offset + frame.size > in->size)
+		return (NULL);
+	if (size != NULL)
+		*size = frame.size;
+	return (in->data + frame.offset);
+}
+
+bool	gmav_read_range(
+	void *reader,
+	uint32_t start,
+	uint32_t count,
+	gmavi_frame_t callback,
+	void *ctx)
+{
+	gmavi_reader_t	*in = (gmavi_reader_t *)reader;
+
+	if (in == NULL || callback == NULL || (uint64_t)start + count > in->info.frameCount)
+		return (false);
+
+	uint32_t	end = start + count;
+	uint32_t	ahead = start;
+	uint64_t	horizon = 0;
+	uint64_t	dropped = count ? in->frames[start].offset : 0;
+
+	for (uint32_t i = start; i < end; i++) {
+		gmavi_payload_t	frame = in->frames[i];
+
+		if (frame.offset + frame.size > in->size)
+			return (false);
+		/*	Less than half of the read ahead left, advise the next stretch in one go	*/
+		if (horizon < frame.offset + frame.size + GMAV_READ_AHEAD / 2)
+		{
+			uint64_t	from = horizon > frame.offset ? horizon : frame.offset;
+			uint64_t	to = from;
+
+			for (; ahead < end && (ahead <= i || to < frame.offset + GMAV_READ_AHEAD); ahead++) {
+				uint64_t	next = in->frames[ahead].offset + in->frames[ahead].size;
+
+				if (next > to && next <= in->size)
+					to = next;
+			}
+			if (to > from)
+				gmav_prefetch(in, from, to);
+			if (to > horizon)
+				horizon = to;
+		}
+		if (!callback(ctx, i, in->data + frame.offset, frame.size))
+			return (false);
+		/*	Repeated frames point back, only what lies behind everything read so far goes	*/
+		if (frame.offset + frame.size > dropped)
+		{
+			gmav_drop(in, dropped, frame.offset + frame.size);
+			dropped = (frame.offset + frame.size) & ~(in->pageSize - 1);
+		}
+	}
+	return (true);
+}
+
+void	gmav_close_read(
+	void *reader)
+{
+	if (reader != NULL)
+		gmav_reader_release((gmavi_reader_t *)reader);
+}
+
+/*
+*	Checksum chunk at @offset, or in one of the two chunks after it, holding @frames checksums
+*/
+static const gmavi_checksums_t	*gmav_checksums_from(gmavi_reader_t *reader, uint64_t offset, uint32_t frames)
+{
+	const RIFFCHUNK	*chunk;
+
+	for (uint32_t i = 0; i < 3 && (chunk = gmav_chunk_at(reader, offset, reader->size, 0)) != NULL; i++) {
+		const gmavi_checksums_t	*checksums = (const gmavi_checksums_t *)chunk;
+
+		if (chunk->fcc == FCC('JUNK') && chunk->cb >= 8 + (uint64_t)frames * 4 + 4
+			&& checksums->signature == GMAV_CHECKSUM_SIGNATURE && checksums->frames == frames)
+			return (checksums);
+		offset = gmav_next_chunk(chunk, offset);
+	}
+	return (NULL);
+}
+
+/*
+*	Checksum chunk ending where idx1 starts, found by the size repeated at its end
+*/
+static const gmavi_checksums_t	*gmav_checksums_before(gmavi_reader_t *reader, uint64_t end, uint32_t frames)
+{
+	uint32_t	size;
+
+	if (end < reader->movi + sizeof(gmavi_checksums_t) + sizeof(uint32_t))
+		return (NULL);
+	memcpy(&size, reader->data + end - sizeof(uint32_t), sizeof(uint32_t));
+	if (size > end - reader->movi - sizeof(RIFFCHUNK))
+		return (NULL);
+	return (gmav_checksums_from(reader, end - sizeof(RIFFCHUNK) - size, frames));
+}
+
+/*
+*	Stored checksum of every frame into @expected, @state marks the frames that have one
+*/
+static void	gmav_read_checksums(gmavi_reader_t *reader, uint32_t *expected, uint8_t *state)
+{
+	const gmavi_checksums_t	*checksums;
+	uint32_t				first = 0;
+
+	if (reader->frames == NULL || reader->info.frameCount == 0)
+		return;
+	if (reader->superIndex == NULL || reader->superIndex->indexType != AVI_INDEX_OF_INDEXES)
+	{
+		checksums = gmav_checksums_before(reader, (uint64_t)((const uint8_t *)reader->oldIndex - reader->data),
+			reader->info.frameCount);
+		if (checksums != NULL)
+		{
+			memcpy(expected, checksums + 1, sizeof(uint32_t) * reader->info.frameCount);
+			memset(state, 1, reader->info.frameCount);
+		}
+		return;
+	}
+
+	const AVISUPERINDEX_ENTRY	*entries = (const AVISUPERINDEX_ENTRY *)(reader->superIndex + 1);
+
+	/*	Both indexes were checked when the file was opened	*/
+	for (uint32_t i = 0; i < reader->superIndex->entriesInUse; i++) {
+		const AVISTDINDEX	*index = (const AVISTDINDEX *)(reader->data + entries[i].offset);
+		uint32_t			frames = index->nEntriesInUse;
+
+		checksums = gmav_checksums_from(reader, entries[i].offset, frames);
+		if (checksums != NULL)
+		{
+			memcpy(expected + first, checksums + 1, sizeof(uint32_t) * frames);
+			memset(state + first, 1, frames);
+		}
+		first += frames;
+	}
+}
+
+/*
+*	State of a gmav_verify run shared by its jobs
+*
+*	@param	expected		- Stored checksum per frame
+*	@param	state			- Per frame: 0 without a checksum, 1 checked and intact, 2 corrupt
+*	@param	batch			- Frames per job
+*/
+typedef struct	s_gmavi_check
+{
+	gmavi_reader_t	*reader;
+	gmavi_crc_t		crc;
+	const uint32_t	*expected;
+	uint8_t			*state;
+	uint32_t		batch;
+}	gmavi_check_t;
+
+static void	gmav_check_batch(void *ctx, uint32_t job)
+{
+	gmavi_check_t	*check = (gmavi_check_t *)ctx;
+	gmavi_reader_t	*reader = check->reader;
+	uint32_t		start = job * check->batch;
+	uint32_t		end = start + check->batch;
+	uint64_t		from = reader->size;
+	uint64_t		to = 0;
+
+	if (end > reader->info.frameCount)
+		end = reader->info.frameCount;
+	for (uint32_t i = start; i < end; i++) {
+		gmavi_payload_t	frame = reader->frames[i];
+
+		if (check->state[i] && frame.offset + frame.size <= reader->size)
+		{
+			from = frame.offset < from ? frame.offset : from;
+			to = frame.offset + frame.size > to ? frame.offset + frame.size : to;
+		}
+	}
+	if (to > from)
+		gmav_prefetch(reader, from, to);
+	for (uint32_t i = start; i < end; i++) {
+		uint32_t		size;
+		const uint8_t	*payload;
+
+		if (check->state[i] == 0)
+			continue;
+		payload = gmav_get_frame(reader, i, &size);
+		if (payload == NULL || check->crc(0, payload, size) != check->expected[i])
+			check->state[i] = 2;
+	}
+	if (to > from)
+		gmav_drop(reader, from, to);
+}
+
+bool	gmav_verify(
+	const char *filePath,
+	uint32_t threads,
+	gmavi_corrupt_t callback,
+	void *ctx,
+	gmavi_verify_t *result)
+{
+	gmavi_reader_t	*reader = (gmavi_reader_t *)gmav_open_read(filePath);
+	gmavi_verify_t	outcome = {0, 0, 0};
+	gmavi_pool_t	pool;
+	gmavi_check_t	check;
+
+	if (reader == NULL)
+		return (false);
+	outcome.frames = reader->info.frameCount;
+
+	uint32_t	*expected = (uint32_t *)calloc(outcome.frames + 1, sizeof(uint32_t));
+	uint8_t		*state = (uint8_t *)calloc(outcome.frames + 1, 1);
+
+	memset(&pool, 0, sizeof(gmavi_pool_t));
+	if (threads == 0)
+		threads = gmav_cpu_count();
+	if (expected == NULL || state == NULL || !gmav_pool_start(&pool, threads - 1))
+	{
+		gmav_pool_destroy(&pool);
+		free(expected);
+		free(state);
+		gmav_close_read(reader);
+		return (false);
+	}
+	gmav_read_checksums(reader, expected, state);
+	check = (gmavi_check_t){reader, gmav_select_crc(), expected, state, GMAV_VERIFY_BATCH};
+	gmav_pool_run(&pool, gmav_check_batch, &check, (outcome.frames + check.batch - 1) / check.batch);
+	gmav_pool_destroy(&pool);
+
+	for (uint32_t i = 0; i < outcome.frames; i++) {
+		if (state[i])
+			outcome.checked += 1;
+		if (state[i] != 2)
+			continue;
+		outcome.corrupt += 1;
+		if (callback != NULL)
+			callback(ctx, i);
+	}
+	free(expected);
+	free(state);
+	gmav_close_read(reader);
+	if (result != NULL)
+		*result = outcome;
+	return (true);
+}
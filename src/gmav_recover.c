@@ -0,0 +1,597 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "../include/libgmavi.h"
+#include "aviStruct.h"
+#ifdef _WIN32
+# include <io.h>
+# define gmav_fseek		_fseeki64
+# define gmav_ftell		_ftelli64
+# define gmav_truncate(file, size)	(_chsize_s(_fileno(file), (__int64)(size)) == 0)
+#else
+# include <unistd.h>
+# define gmav_fseek		fseeko
+# define gmav_ftell		ftello
+# define gmav_truncate(file, size)	(ftruncate(fileno(file), (off_t)(size)) == 0)
+#endif
+
+/*
+*	RIFF segment found in the file
+*
+*	@param	riff			- Offset of its RIFF list
+*	@param	moviEnd			- End of its movi list, where idx1 starts in the first segment
+*	@param	index			- Super index entry of its ix00, zero while it has none
+*	@param	audioIndex		- Super index entry of its ix01, when recorded with audio
+*/
+typedef struct	s_gmavi_segment
+{
+	uint64_t			riff;
+	uint64_t			moviEnd;
+	AVISUPERINDEX_ENTRY	index;
+	AVISUPERINDEX_ENTRY	audioIndex;
+}	gmavi_segment_t;
+
+/*
+*	Chunks of one stream found in the last segment, relative to @base of the recovery
+*/
+typedef struct	s_gmavi_found
+{
+	AVISTDINDEX_ENTRY	*entries;
+	uint32_t			count;
+	uint32_t			capacity;
+	uint32_t			samples;
+}	gmavi_found_t;
+
+/*
+*	Recovery state
+*
+*	@param	movi			- Offset of the first segment's movi list
+*	@param	grandFrames		- Offset of dmlh::grandFrames
+*	@param	maxSegments		- Segments the super index has room for
+*	@param	end				- End of the last complete chunk, the file is cut here
+*	@param	count			- Segments found, the last one is the one being walked
+*	@param	oldFrames		- Frames in the first segment's idx1, when it is complete
+*	@param	oldSamples		- Audio samples in the first segment's idx1
+*	@param	base			- Start of the last segment's movi data, index offsets are relative to it
+*	@param	video			- Frames found in the last segment
+*	@param	blockAlign		- Bytes per audio sample, 0 without an audio stream
+*	@param	audioList		- Offset of the audio stream list
+*	@param	audio			- Audio chunks found in the last segment
+*/
+typedef struct	s_gmavi_recover
+{
+	FILE				*file;
+	uint64_t			fileSize;
+	uint64_t			movi;
+	uint64_t			grandFrames;
+	uint32_t			maxSegments;
+	uint64_t			end;
+	uint32_t			chunkId;
+	gmavi_segment_t		*segments;
+	uint32_t			count;
+	bool				hasOldIndex;
+	uint32_t			oldFrames;
+	uint32_t			oldSamples;
+	uint64_t			base;
+	gmavi_found_t		video;
+	uint32_t			blockAlign;
+	uint64_t			audioList;
+	gmavi_found_t		audio;
+}	gmavi_recover_t;
+
+static bool	gmav_read_at(gmavi_recover_t *rec, uint64_t offset, void *data, size_t size)
+{
+	if (offset + size > rec->fileSize || gmav_fseek(rec->file, offset, SEEK_SET))
+		return (false);
+	return (fread(data, size, 1, rec->file) == 1);
+}
+
+static bool	gmav_write_at(gmavi_recover_t *rec, uint64_t offset, const void *data, size_t size)
+{
+	if (gmav_fseek(rec->file, offset, SEEK_SET))
+		return (false);
+	return (fwrite(data, size, 1, rec->file) == 1);
+}
+
+/*
+*	Whether @offset holds a complete chunk of @size bytes (header included)
+*/
+static bool	gmav_complete(gmavi_recover_t *rec, uint64_t offset, uint64_t size)
+{
+	return (offset + size <= rec->fileSize);
+}
+
+/*
+*	Whether an AVIX segment (RIFF 'AVIX' and LIST 'movi' headers) starts at @offset
+*/
+static bool	gmav_segment_at(gmavi_recover_t *rec, uint64_t offset)
+{
+	RIFFLIST	lists[2];
+
+	return (gmav_read_at(rec, offset, lists, sizeof(lists))
+		&& lists[0].fcc == FOURCC_RIFF && lists[0].fccListType == FOURCC_TYPE_VIDEO_EXT
+		&& lists[1].fcc == FOURCC_LIST && lists[1].fccListType == FCC('movi'));
+}
+
+static bool	gmav_is_frame(gmavi_recover_t *rec, FOURCC fcc)
+{
+	if (rec->chunkId)
+		return (fcc == rec->chunkId);
+	return (fcc == FCC('00db') || fcc == FCC('00dc'));
+}
+
+static bool	gmav_found_chunk(gmavi_recover_t *rec, gmavi_found_t *found, uint64_t payload, uint32_t size)
+{
+	if (found->count >= found->capacity)
+	{
+		uint32_t			capacity = found->capacity ? found->capacity * 2 : 1024;
+		AVISTDINDEX_ENTRY	*entries = (AVISTDINDEX_ENTRY *)realloc(found->entries,
+			sizeof(AVISTDINDEX_ENTRY) * capacity);
+
+		if (entries == NULL)
+			return (false);
+		found->entries = entries;
+		found->capacity = capacity;
+	}
+	found->entries[found->count++] = (AVISTDINDEX_ENTRY){(uint32_t)(payload - rec->base), size};
+	if (found == &rec->audio)
+		found->samples += size / rec->blockAlign;
+	return (true);
+}
+
+/*
+*	Start walking the segment whose movi data starts at @base
+*/
+static void	gmav_enter_segment(gmavi_recover_t *rec, uint64_t base)
+{
+	rec->base = base;
+	rec->video.count = 0;
+	rec->audio.count = 0;
+	rec->audio.samples = 0;
+}
+
+/*
+*	Count the frames and audio samples of a complete idx1, the entries are only
+*	read when there is audio to tell apart
+*/
+static bool	gmav_count_old_index(gmavi_recover_t *rec, uint64_t offset, uint32_t size)
+{
+	AVIOLDINDEX_ENTRY	entry;
+
+	rec->hasOldIndex = true;
+	rec->oldFrames = size / sizeof(AVIOLDINDEX_ENTRY);
+	rec->oldSamples = 0;
+	if (rec->blockAlign == 0)
+		return (true);
+	rec->oldFrames = 0;
+	if (gmav_fseek(rec->file, offset + sizeof(AVIOLDINDEX), SEEK_SET))
+		return (false);
+	for (uint32_t i = 0; i < size / sizeof(AVIOLDINDEX_ENTRY); i++) {
+		if (fread(&entry, sizeof(AVIOLDINDEX_ENTRY), 1, rec->file) != 1)
+			return (false);
+		if (entry.chunkId == FCC('01wb'))
+			rec->oldSamples += entry.size / rec->blockAlign;
+		else
+			rec->oldFrames += 1;
+	}
+	return (true);
+}
+
+/*
+*	Super index entry @i of the audio stream, and the ix01 it points at when that
+*	starts at @offset
+*/
+static bool	gmav_audio_index_at(gmavi_recover_t *rec, uint32_t i, uint64_t offset, AVISUPERINDEX_ENTRY *entry)
+{
+	AVISTDINDEX	index;
+
+	return (gmav_read_at(rec, rec->audioList + sizeof(gmavi_audio_t) + sizeof(AVISUPERINDEX_ENTRY) * (uint64_t)i,
+			entry, sizeof(AVISUPERINDEX_ENTRY))
+		&& entry->offset == offset && gmav_read_at(rec, offset, &index, sizeof(AVISTDINDEX))
+		&& index.fcc == FCC('ix01') && gmav_complete(rec, offset, sizeof(RIFFCHUNK) + index.cb));
+}
+
+/*
+*	End of the checksum chunk (GMAV_FLAG_CHECKSUM) at @offset, @offset when there is none
+*/
+static uint64_t	gmav_skip_checksums(gmavi_recover_t *rec, uint64_t offset)
+{
+	gmavi_checksums_t	checksums;
+
+	if (gmav_read_at(rec, offset, &checksums, sizeof(gmavi_checksums_t)) && checksums.fcc == FOURCC_JUNK
+		&& checksums.signature == GMAV_CHECKSUM_SIGNATURE
+		&& gmav_complete(rec, offset, sizeof(RIFFCHUNK) + checksums.cb))
+		return (offset + sizeof(RIFFCHUNK) + checksums.cb);
+	return (offset);
+}
+
+/*
+*	Skip the segments the super index already lists (checkpointed at every rollover),
+*	only their ix00 (and ix01, checksums) and the headers around it are read
+*/
+static void	gmav_skip_indexed(gmavi_recover_t *rec, const AVISUPERINDEX *superIndex)
+{
+	if (superIndex->fcc != FCC('indx'))
+		return;
+	rec->chunkId = superIndex->chunkId;
+	for (uint32_t i = 0; i < superIndex->entriesInUse && i + 1 < rec->maxSegments; i++) {
+		AVISUPERINDEX_ENTRY	entry;
+		AVISTDINDEX			index;
+		RIFFCHUNK			oldIndex;
+
+		if (!gmav_read_at(rec, sizeof(gmavi_static_t) + sizeof(AVISUPERINDEX_ENTRY) * (uint64_t)i,
+				&entry, sizeof(AVISUPERINDEX_ENTRY))
+			|| !gmav_read_at(rec, entry.offset, &index, sizeof(AVISTDINDEX))
+			|| index.fcc != FCC('ix00') || index.nEntriesInUse != entry.duration
+			|| !gmav_complete(rec, entry.offset, sizeof(RIFFCHUNK) + index.cb))
+			return;
+
+		uint64_t			next = entry.offset + sizeof(RIFFCHUNK) + index.cb;
+		AVISUPERINDEX_ENTRY	audio = {0, 0, 0};
+
+		if (rec->blockAlign)
+		{
+			if (!gmav_audio_index_at(rec, i, next, &audio))
+				return;
+			next += audio.size;
+		}
+		next = gmav_skip_checksums(rec, next);
+		rec->segments[i].moviEnd = next;
+		if (i == 0)
+		{
+			if (!gmav_read_at(rec, next, &oldIndex, sizeof(RIFFCHUNK)) || oldIndex.fcc != FCC('idx1')
+				|| !gmav_complete(rec, next, sizeof(RIFFCHUNK) + oldIndex.cb)
+				|| !gmav_count_old_index(rec, next, oldIndex.cb))
+				return;
+			next += sizeof(RIFFCHUNK) + oldIndex.cb;
+		}
+		if (!gmav_segment_at(rec, next))
+			return;
+		rec->segments[i].index = entry;
+		rec->segments[i].audioIndex = audio;
+		rec->segments[i + 1] = (gmavi_segment_t){next, 0, {0, 0, 0}, {0, 0, 0}};
+		rec->count = i + 2;
+		rec->end = next + 2 * sizeof(RIFFLIST);
+		gmav_enter_segment(rec, rec->end);
+	}
+}
+
+/*
+*	Walk the chunks of the last segment from @end. Only the 8 byte chunk headers are
+*	read, every payload is jumped over (a fixed stride for uncompressed streams). An
+*	index means the segment was closed (ix00, then ix01 with audio and the JUNK
+*	holding its checksums), a following AVIX segment is walked in turn.
+*	The walk stops at the first chunk that is cut off or not written at all
+*/
+static bool	gmav_walk(gmavi_recover_t *rec)
+{
+	gmavi_segment_t	*segment = &rec->segments[rec->count - 1];
+	RIFFCHUNK		chunk;
+
+	while (gmav_read_at(rec, rec->end, &chunk, sizeof(RIFFCHUNK)))
+	{
+		uint64_t	next = rec->end + sizeof(RIFFCHUNK) + chunk.cb + (chunk.cb & 1);
+		bool		closed = segment->index.offset || (rec->count == 1 && rec->hasOldIndex);
+
+		if (chunk.fcc == FOURCC_RIFF)
+		{
+			if (!segment->index.offset || (rec->blockAlign && !segment->audioIndex.offset)
+				|| (rec->count == 1 && !rec->hasOldIndex)
+				|| rec->count == rec->maxSegments || !gmav_segment_at(rec, rec->end))
+				break;
+			segment = &rec->segments[rec->count++];
+			*segment = (gmavi_segment_t){rec->end, 0, {0, 0, 0}, {0, 0, 0}};
+			rec->end += 2 * sizeof(RIFFLIST);
+			gmav_enter_segment(rec, rec->end);
+			continue;
+		}
+		if (next > rec->fileSize)
+			break;
+		if (gmav_is_frame(rec, chunk.fcc) && !closed)
+		{
+			rec->chunkId = chunk.fcc;
+			if (!gmav_found_chunk(rec, &rec->video, rec->end + sizeof(RIFFCHUNK), chunk.cb))
+				return (false);
+		}
+		else if (chunk.fcc == FCC('01wb') && rec->blockAlign && !closed)
+		{
+			if (!gmav_found_chunk(rec, &rec->audio, rec->end + sizeof(RIFFCHUNK), chunk.cb))
+				return (false);
+		}
+		else if (chunk.fcc == FCC('ix00') && !segment->index.offset)
+		{
+			AVISTDINDEX	index;
+
+			if (!gmav_read_at(rec, rec->end, &index, sizeof(AVISTDINDEX)))
+				break;
+			segment->index = (AVISUPERINDEX_ENTRY){rec->end, sizeof(RIFFCHUNK) + chunk.cb, index.nEntriesInUse};
+			segment->moviEnd = next;
+		}
+		else if (chunk.fcc == FCC('ix01') && rec->blockAlign && segment->index.offset
+			&& !segment->audioIndex.offset)
+		{
+			segment->audioIndex = (AVISUPERINDEX_ENTRY){rec->end, sizeof(RIFFCHUNK) + chunk.cb, rec->audio.samples};
+			segment->moviEnd = next;
+		}
+		else if (chunk.fcc == FCC('idx1') && rec->count == 1 && !rec->hasOldIndex)
+		{
+			if (!gmav_count_old_index(rec, rec->end, chunk.cb))
+				return (false);
+			segment->moviEnd = rec->end;
+		}
+		else if (chunk.fcc == FOURCC_JUNK && closed && segment->moviEnd == rec->end)
+			segment->moviEnd = next;
+		else if (chunk.fcc != FOURCC_JUNK || closed)
+			break;
+		rec->end = next;
+	}
+	return (true);
+}
+
+/*
+*	idx1 of the chunks walked in the first segment, both streams in file order
+*/
+static bool	gmav_write_old_index(gmavi_recover_t *rec)
+{
+	uint64_t	moviFcc = rec->movi + 8;
+	uint32_t	count = rec->video.count + rec->audio.count;
+	AVIOLDINDEX	header = {FCC('idx1'), sizeof(AVIOLDINDEX_ENTRY) * count};
+
+	if (!gmav_write_at(rec, rec->end, &header, sizeof(AVIOLDINDEX)))
+		return (false);
+	for (uint32_t frame = 0, chunk = 0; frame + chunk < count;) {
+		bool				audio = chunk < rec->audio.count && (frame == rec->video.count
+			|| rec->audio.entries[chunk].dwOffset < rec->video.entries[frame].dwOffset);
+		AVISTDINDEX_ENTRY	found = audio ? rec->audio.entries[chunk++] : rec->video.entries[frame++];
+		AVIOLDINDEX_ENTRY	entry = {
+			audio ? FCC('01wb') : rec->chunkId,	/*	chunkId				*/
+			AVIF_HASINDEX,						/*	flags				*/
+			(uint32_t)(rec->base + found.dwOffset - sizeof(RIFFCHUNK) - moviFcc),	/*	offset	*/
+			found.dwSize						/*	size				*/
+		};
+
+		if (fwrite(&entry, sizeof(AVIOLDINDEX_ENTRY), 1, rec->file) != 1)
+			return (false);
+	}
+	rec->hasOldIndex = true;
+	rec->oldFrames = rec->video.count;
+	rec->oldSamples = rec->audio.samples;
+	rec->end += sizeof(AVIOLDINDEX) + header.cb;
+	return (true);
+}
+
+/*
+*	ix00 (or ix01) of the chunks of one stream walked in the last segment
+*/
+static bool	gmav_write_std_index(gmavi_recover_t *rec, FOURCC fcc, uint32_t chunkId,
+	const gmavi_found_t *found, uint32_t duration, AVISUPERINDEX_ENTRY *entry)
+{
+	AVISTDINDEX	header = {
+		fcc,								/*	fcc					*/
+		24 + found->count * 8,				/*	cb					*/
+		2,									/*	wLongsPerEntry		*/
+		0,									/*	bIndexSubType		*/
+		AVI_INDEX_OF_CHUNKS,				/*	bIndexType			*/
+		found->count,						/*	nEntriesInUse		*/
+		chunkId,							/*	dwChunkId			*/
+		rec->base,							/*	qwBaseOffset		*/
+		0									/*	dwReserved_3		*/
+	};
+
+	if (!gmav_write_at(rec, rec->end, &header, sizeof(AVISTDINDEX))
+		|| fwrite(found->entries, sizeof(AVISTDINDEX_ENTRY), found->count, rec->file) != found->count)
+		return (false);
+	*entry = (AVISUPERINDEX_ENTRY){rec->end, sizeof(RIFFCHUNK) + header.cb, duration};
+	rec->end += sizeof(RIFFCHUNK) + header.cb;
+	return (true);
+}
+
+/*
+*	Index the chunks walked in the last segment: idx1 when it is the first one,
+*	an ix00 (and ix01) otherwise. Repeated frames left no chunk, they are not recovered
+*/
+static bool	gmav_rebuild_index(gmavi_recover_t *rec)
+{
+	gmavi_segment_t	*segment = &rec->segments[rec->count - 1];
+
+	if (rec->count == 1 && rec->hasOldIndex)
+		return (true);
+	if (rec->count > 1 && segment->index.offset && (!rec->blockAlign || segment->audioIndex.offset))
+		return (true);
+	/*	Indexes without what follows them were a rollover cut short, they are written again	*/
+	if (segment->index.offset)
+		rec->end = segment->index.offset;
+	segment->index = (AVISUPERINDEX_ENTRY){0, 0, 0};
+	segment->audioIndex = (AVISUPERINDEX_ENTRY){0, 0, 0};
+	if (rec->count == 1)
+	{
+		segment->moviEnd = rec->end;
+		return (gmav_write_old_index(rec));
+	}
+	/*	Nothing made it into the last segment, the file ends with the one before	*/
+	if (rec->video.count == 0 && rec->audio.count == 0)
+	{
+		rec->end = segment->riff;
+		rec->count -= 1;
+		return (true);
+	}
+	if (!gmav_write_std_index(rec, FCC('ix00'), rec->chunkId, &rec->video, rec->video.count, &segment->index))
+		return (false);
+	return (rec->blockAlign == 0 || gmav_write_std_index(rec, FCC('ix01'), FCC('01wb'),
+		&rec->audio, rec->audio.samples, &segment->audioIndex));
+}
+
+/*
+*	Super index of one stream, a single segment keeps the placeholder
+*
+*	@param	superIndex		- Offset of the super index header, its entries follow
+*	@param	audio			- Whether this is the audio stream's (ix01) or the video stream's
+*/
+static bool	gmav_rebuild_super_index(gmavi_recover_t *rec, uint64_t superIndex, bool audio)
+{
+	AVISUPERINDEX	header = {
+		FCC('JUNK'),						/*	fcc					*/
+		STATIC_SUPER_INDEX_SIZE(rec->maxSegments),	/*	cb			*/
+	};
+
+	if (rec->count > 1)
+	{
+		header.fcc = FCC('indx');
+		header.longsPerEntry = 4;
+		header.indexType = AVI_INDEX_OF_INDEXES;
+		header.entriesInUse = rec->count;
+		header.chunkId = audio ? FCC('01wb') : rec->chunkId;
+		for (uint32_t i = 0; i < rec->count; i++) {
+			if (!gmav_write_at(rec, superIndex + sizeof(AVISUPERINDEX) + sizeof(AVISUPERINDEX_ENTRY) * (uint64_t)i,
+				audio ? &rec->segments[i].audioIndex : &rec->segments[i].index, sizeof(AVISUPERINDEX_ENTRY)))
+				return (false);
+		}
+	}
+	return (gmav_write_at(rec, superIndex, &header, sizeof(AVISUPERINDEX)));
+}
+
+/*
+*	RIFF and movi sizes of every segment, frame and sample counts and the super indexes
+*/
+static bool	gmav_rebuild_header(gmavi_recover_t *rec)
+{
+	uint32_t	totalFrames = 0;
+	uint32_t	totalSamples = 0;
+
+	for (uint32_t i = 0; i < rec->count; i++) {
+		uint64_t	end = i + 1 < rec->count ? rec->segments[i + 1].riff : rec->end;
+		uint64_t	riff = rec->segments[i].riff;
+		uint32_t	riffSize = (uint32_t)(end - riff - 8);
+		uint32_t	moviSize = i ? riffSize - 12
+			: (uint32_t)(rec->segments[0].moviEnd - rec->movi - 8);
+
+		if (!gmav_write_at(rec, riff + 4, &riffSize, sizeof(uint32_t))
+			|| !gmav_write_at(rec, (i ? riff + sizeof(RIFFLIST) : rec->movi) + 4, &moviSize, sizeof(uint32_t)))
+			return (false);
+		totalFrames += rec->count == 1 ? rec->oldFrames : rec->segments[i].index.duration;
+		totalSamples += rec->count == 1 ? rec->oldSamples : rec->segments[i].audioIndex.duration;
+	}
+
+	uint32_t	firstFrames = rec->count == 1 ? rec->oldFrames : rec->segments[0].index.duration;
+
+	if (!gmav_write_at(rec, offsetof(gmavi_static_t, aviHeader.totalFrames), &firstFrames, sizeof(uint32_t))
+		|| !gmav_write_at(rec, offsetof(gmavi_static_t, streamHeader.length), &totalFrames, sizeof(uint32_t))
+		|| !gmav_write_at(rec, rec->grandFrames, &totalFrames, sizeof(uint32_t))
+		|| !gmav_rebuild_super_index(rec, offsetof(gmavi_static_t, superIndex), false))
+		return (false);
+	if (rec->blockAlign == 0)
+		return (true);
+	return (gmav_write_at(rec, rec->audioList + offsetof(gmavi_audio_t, streamHeader.length),
+			&totalSamples, sizeof(uint32_t))
+		&& gmav_rebuild_super_index(rec, rec->audioList + offsetof(gmavi_audio_t, superIndex), true));
+}
+
+/*
+*	Find the super index room, the audio stream list and the first movi list, the
+*	header size depends on the room reserved for segments
+*/
+static bool	gmav_read_header(gmavi_recover_t *rec, gmavi_static_t *contents)
+{
+	uint64_t		odml;
+	RIFFLIST		list;
+	RIFFCHUNK		junk;
+	gmavi_audio_t	audio;
+
+	if (!gmav_read_at(rec, 0, contents, sizeof(gmavi_static_t))
+		|| contents->main.fcc != FOURCC_RIFF || contents->main.fccListType != FOURCC_TYPE_VIDEO
+		|| contents->superIndex.cb < STATIC_SUPER_INDEX_SIZE(0))
+		return (false);
+	odml = offsetof(gmavi_static_t, superIndex) + sizeof(RIFFCHUNK) + contents->superIndex.cb;
+	if (contents->aviHeader.streams > 1)
+	{
+		if (!gmav_read_at(rec, odml, &audio, sizeof(gmavi_audio_t))
+			|| audio.strl.fccListType != FCC('strl') || audio.streamHeader.fccType != FCC('auds')
+			|| audio.format.blockAlign == 0 || audio.superIndex.cb != contents->superIndex.cb)
+			return (false);
+		rec->audioList = odml;
+		rec->blockAlign = audio.format.blockAlign;
+		odml += offsetof(gmavi_audio_t, superIndex) + sizeof(RIFFCHUNK) + audio.superIndex.cb;
+	}
+	if (!gmav_read_at(rec, odml, &list, sizeof(RIFFLIST)) || list.fccListType != FCC('odml')
+		|| !gmav_read_at(rec, odml + sizeof(RIFFCHUNK) + list.cb, &junk, sizeof(RIFFCHUNK))
+		|| junk.fcc != FOURCC_JUNK)
+		return (false);
+	rec->grandFrames = odml + offsetof(gmavi_odml_t, extendedHeader.grandFrames);
+	rec->movi = odml + sizeof(RIFFCHUNK) + list.cb + sizeof(RIFFCHUNK) + junk.cb;
+	rec->maxSegments = (contents->superIndex.cb - STATIC_SUPER_INDEX_SIZE(0)) / sizeof(AVISUPERINDEX_ENTRY);
+	if (rec->maxSegments == 0 || !gmav_read_at(rec, rec->movi, &list, sizeof(RIFFLIST))
+		|| list.fcc != FOURCC_LIST || list.fccListType != FCC('movi'))
+		return (false);
+	rec->segments = (gmavi_segment_t *)calloc(rec->maxSegments, sizeof(gmavi_segment_t));
+	rec->end = rec->movi + sizeof(RIFFLIST);
+	gmav_enter_segment(rec, rec->end);
+	return (rec->segments != NULL);
+}
+
+static bool	gmav_recover_file(gmavi_recover_t *rec)
+{
+	gmavi_static_t	contents;
+
+	if (!gmav_read_header(rec, &contents))
+		return (false);
+	gmav_skip_indexed(rec, &contents.superIndex);
+	if (!gmav_walk(rec))
+		return (false);
+	if (rec->chunkId == 0)
+		rec->chunkId = FCC('00db');
+	if (!gmav_rebuild_index(rec) || !gmav_rebuild_header(rec) || fflush(rec->file))
+		return (false);
+	return (gmav_truncate(rec->file, rec->end));
+}
+
+bool	gmav_recover(
+	const char *filePath)
+{
+	gmavi_recover_t	*rec = (gmavi_recover_t *)calloc(1, sizeof(gmavi_recover_t));
+	bool			recovered = false;
+
+	if (rec == NULL)
+		return (false);
+	rec->file = fopen(filePath, "rb+");
+	if (rec->file != NULL && !gmav_fseek(rec->file, 0, SEEK_END))
+	{
+		rec->fileSize = (uint64_t)gmav_ftell(rec->file);
+		rec->count = 1;
+		recovered = gmav_recover_file(rec);
+	}
+	if (rec->file != NULL && fclose(rec->file))
+		recovered = false;
+	if (!recovered)
+		printf("%s could not be recovered\n", filePath);
+	free(rec->video.entries);
+	free(rec->audio.entries);
+	free(rec->segments);
+	free(rec);
+	return (recovered);
+}
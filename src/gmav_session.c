@@ -0,0 +1,323 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "../include/libgmavi.h"
+#include "aviStruct.h"
+
+struct	s_gmavi_session;
+
+/*
+*	Writer thread shared by one or more passes
+*
+*	@param	queue			- Frame batches, a slot holds this writer's frame of every pass it owns
+*	@param	session			- Owning session
+*	@param	passes			- Passes written by this thread, in the order they sit in a slot
+*	@param	offsets			- Offset of each pass's frame in a slot, @GMAV_IO_SECTOR aligned
+*	@param	count			- Amount of @passes
+*	@param	load			- Slot size, the bytes this thread writes per frame
+*/
+typedef struct	s_gmavi_writer
+{
+	gmavi_queue_t			queue;
+	struct s_gmavi_session	*session;
+	uint32_t				*passes;
+	size_t					*offsets;
+	uint32_t				count;
+	size_t					load;
+}	gmavi_writer_t;
+
+/*
+*	Recording session, every pass is a writer instance of its own
+*
+*	@param	passes			- Writer instance of every pass
+*	@param	passCount		- Amount of passes
+*	@param	writers			- Writer threads the passes are spread over
+*	@param	writerCount		- Amount of @writers
+*	@param	queuePolicy		- GMAV_QUEUE_BLOCK or GMAV_QUEUE_DROP, for whole batches
+*	@param	frame			- Batches committed, the frame number shared by all passes
+*/
+typedef struct	s_gmavi_session
+{
+	gmavi_t				**passes;
+	uint32_t			passCount;
+	gmavi_writer_t		*writers;
+	uint32_t			writerCount;
+	uint32_t			queuePolicy;
+	uint32_t			frame;
+}	gmavi_session_t;
+
+/*
+*	Stop every writer thread and release the session, passes are released unfinished
+*/
+static void	gmav_session_release(gmavi_session_t *session)
+{
+	if (session->writers != NULL)
+	{
+		for (uint32_t i = 0; i < session->writerCount; i++) {
+			gmav_queue_destroy(&session->writers[i].queue);
+			free(session->writers[i].passes);
+			free(session->writers[i].offsets);
+		}
+		free(session->writers);
+	}
+	if (session->passes != NULL)
+	{
+		for (uint32_t i = 0; i < session->passCount; i++) {
+			if (session->passes[i] != NULL)
+				gmav_release(session->passes[i]);
+		}
+		free(session->passes);
+	}
+	free(session);
+}
+
+/*
+*	Like gmav_error, releases the whole session
+*/
+static bool	gmav_session_error(gmavi_session_t *session, const char *additionalString)
+{
+	if (session)
+		gmav_session_release(session);
+	if (additionalString)
+		printf("%s\n", additionalString);
+	return (false);
+}
+
+/*
+*	Writer thread: write this thread's frame of every pass in the batch
+*/
+static bool	gmav_session_consume(void *ctx, const uint8_t *slot)
+{
+	gmavi_writer_t	*writer = (gmavi_writer_t *)ctx;
+
+	for (uint32_t i = 0; i < writer->count; i++) {
+		if (!gmav_write_frame(writer->session->passes[writer->passes[i]], slot + writer->offsets[i]))
+			return (false);
+	}
+	return (true);
+}
+
+/*
+*	Calling thread: convert the caller's frames of this writer's passes into the slot.
+*	@data is the caller's array of buffers, one per pass.
+*/
+static void	gmav_session_fill(void *ctx, uint8_t *slot, const uint8_t *data)
+{
+	gmavi_writer_t	*writer = (gmavi_writer_t *)ctx;
+	uint8_t *const	*buffers = (uint8_t *const *)data;
+
+	for (uint32_t i = 0; i < writer->count; i++) {
+		gmavi_t	*pass = writer->session->passes[writer->passes[i]];
+
+		gmav_convert_frame(&pass->convert, slot + writer->offsets[i], buffers[writer->passes[i]]);
+	}
+}
+
+/*
+*	Hand every pass to the writer thread with the least bytes per frame so far,
+*	so a large color pass does not end up sharing a thread with the rest
+*/
+static bool	gmav_session_assign(gmavi_session_t *session)
+{
+	for (uint32_t i = 0; i < session->writerCount; i++) {
+		session->writers[i].session = session;
+		session->writers[i].passes = (uint32_t *)calloc(session->passCount, sizeof(uint32_t));
+		session->writers[i].offsets = (size_t *)calloc(session->passCount, sizeof(size_t));
+		if (session->writers[i].passes == NULL || session->writers[i].offsets == NULL)
+			return (false);
+	}
+	for (uint32_t i = 0; i < session->passCount; i++) {
+		gmavi_writer_t	*writer = session->writers;
+
+		for (uint32_t w = 1; w < session->writerCount; w++) {
+			if (session->writers[w].load < writer->load)
+				writer = &session->writers[w];
+		}
+		writer->passes[writer->count] = i;
+		writer->offsets[writer->count] = writer->load;
+		writer->count += 1;
+		writer->load += GMAV_ALIGN_UP(session->passes[i]->bitmapSize, GMAV_IO_SECTOR);
+	}
+	return (true);
+}
+
+void	*gmav_session_open(
+	const gmavi_pass_t *passes,
+	uint32_t passCount,
+	uint32_t framesPerSec,
+	const gmavi_config_t *config)
+{
+	gmavi_config_t	defaults;
+
+	if (passes == NULL || passCount == 0)
+	{
+		gmav_session_error(NULL, "No passes specified");
+		return (NULL);
+	}
+	if (config == NULL)
+	{
+		gmav_config_default(&defaults);
+		config = &defaults;
+	}
+
+	gmavi_session_t	*session = (gmavi_session_t *)calloc(1, sizeof(gmavi_session_t));
+
+	if (session == NULL)
+		return (NULL);
+	session->passes = (gmavi_t **)calloc(passCount, sizeof(gmavi_t *));
+	if (session->passes == NULL)
+	{
+		gmav_session_error(session, NULL);
+		return (NULL);
+	}
+	session->passCount = passCount;
+	session->queuePolicy = config->queuePolicy;
+	for (uint32_t i = 0; i < passCount; i++) {
+		gmavi_config_t	passConfig;
+
+		if (passes[i].config != NULL)
+			passConfig = *passes[i].config;
+		else
+			gmav_config_default(&passConfig);
+		/*	The session's writer threads do the queueing	*/
+		passConfig.queueDepth = 0;
+		session->passes[i] = (gmavi_t *)gmav_open_ex(passes[i].filePath,
+			passes[i].width, passes[i].height, framesPerSec, &passConfig);
+		if (session->passes[i] == NULL)
+		{
+			gmav_session_error(session, NULL);
+			return (NULL);
+		}
+		/*	Frames are converted straight into the batch	*/
+		gmav_aligned_free(session->passes[i]->convertBuffer);
+		session->passes[i]->convertBuffer = NULL;
+	}
+
+	uint32_t	threads = config->writerThreads;
+
+	if (threads == 0)
+		threads = gmav_cpu_count();
+	session->writerCount = threads < passCount ? threads : passCount;
+	session->writers = (gmavi_writer_t *)calloc(session->writerCount, sizeof(gmavi_writer_t));
+	if (session->writers == NULL || !gmav_session_assign(session))
+	{
+		gmav_session_error(session, NULL);
+		return (NULL);
+	}
+	for (uint32_t i = 0; i < session->writerCount; i++) {
+		gmavi_writer_t	*writer = &session->writers[i];
+
+		if (!gmav_queue_start(&writer->queue, config->queueDepth ? config->queueDepth : GMAV_SESSION_DEPTH,
+			writer->load, config->writerCpu < 0 ? -1 : config->writerCpu + (int32_t)i,
+			NULL, gmav_session_consume, writer))
+		{
+			gmav_session_error(session, NULL);
+			return (NULL);
+		}
+	}
+	return (session);
+}
+
+void	*gmav_session_pass(
+	void *session,
+	uint32_t pass)
+{
+	gmavi_session_t	*in = (gmavi_session_t *)session;
+
+	if (in == NULL || pass >= in->passCount)
+		return (NULL);
+	return (in->passes[pass]);
+}
+
+uint32_t	gmav_session_frame(
+	void *session)
+{
+	if (session == NULL)
+		return (0);
+	return (((gmavi_session_t *)session)->frame);
+}
+
+bool	gmav_session_add(
+	void *session,
+	uint8_t **buffers)
+{
+	gmavi_session_t	*in = (gmavi_session_t *)session;
+
+	if (in == NULL)
+		return (gmav_session_error(in, "No session specified (null)"));
+	if (buffers == NULL)
+		return (gmav_session_error(in, "No buffers specified (null)"));
+	for (uint32_t i = 0; i < in->passCount; i++) {
+		if (buffers[i] == NULL)
+			return (gmav_session_error(in, "No buffer specified (null)"));
+	}
+
+	/*	Only this thread pushes, a writer with room keeps it until the batch is in	*/
+	if (in->queuePolicy == GMAV_QUEUE_DROP)
+	{
+		for (uint32_t i = 0; i < in->writerCount; i++) {
+			if (!gmav_queue_room(&in->writers[i].queue))
+				return (true);
+		}
+	}
+	for (uint32_t i = 0; i < in->writerCount; i++) {
+		if (gmav_queue_push(&in->writers[i].queue, (const uint8_t *)buffers, true,
+			gmav_session_fill) == GMAV_QUEUE_FAILED)
+			return (gmav_session_error(in, NULL));
+	}
+	in->frame += 1;
+	return (true);
+}
+
+bool	gmav_session_finish(
+	void *session)
+{
+	gmavi_session_t	*in = (gmavi_session_t *)session;
+	bool			finished = true;
+
+	if (in == NULL)
+		return (gmav_session_error(in, "No session specified (null)"));
+	/*	Every pass is finished on its own, one failing does not cost the others their file	*/
+	for (uint32_t i = 0; i < in->writerCount; i++) {
+		gmavi_writer_t	*writer = &in->writers[i];
+		bool			written = gmav_queue_stop(&writer->queue);
+
+		for (uint32_t k = 0; k < writer->count; k++) {
+			gmavi_t	*pass = in->passes[writer->passes[k]];
+
+			in->passes[writer->passes[k]] = NULL;
+			if (!written)
+				gmav_release(pass);
+			if (!written || !gmav_finish(pass))
+				finished = false;
+		}
+	}
+	gmav_session_release(in);
+	return (finished);
+}
@@ -0,0 +1,321 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "../include/libgmavi.h"
+#include "aviStruct.h"
+
+/*
+*	Striped recording, frame n goes to stripe n % count
+*
+*	@param	stripes			- Writer instance of every stripe, each with its own writer thread
+*	@param	count			- Amount of @stripes
+*	@param	queuePolicy		- GMAV_QUEUE_BLOCK or GMAV_QUEUE_DROP, applied to the whole recording
+*	@param	frame			- Frames added so far
+*/
+typedef struct	s_gmavi_striped
+{
+	gmavi_t		**stripes;
+	uint32_t	count;
+	uint32_t	queuePolicy;
+	uint64_t	frame;
+}	gmavi_striped_t;
+
+/*
+*	Release every stripe still open, unfinished
+*/
+static void	gmav_stripe_release(gmavi_striped_t *striped)
+{
+	if (striped->stripes != NULL)
+	{
+		for (uint32_t i = 0; i < striped->count; i++) {
+			if (striped->stripes[i] != NULL)
+				gmav_release(striped->stripes[i]);
+		}
+		free(striped->stripes);
+	}
+	free(striped);
+}
+
+/*
+*	Like gmav_error, releases the whole recording
+*/
+static bool	gmav_stripe_error(gmavi_striped_t *striped, const char *additionalString)
+{
+	if (striped)
+		gmav_stripe_release(striped);
+	if (additionalString)
+		printf("%s\n", additionalString);
+	return (false);
+}
+
+/*
+*	@directory joined with @fileName, NULL when out of memory
+*/
+static char	*gmav_stripe_path(const char *directory, const char *fileName)
+{
+	size_t	length = strlen(directory);
+	bool	separated = length == 0 || directory[length - 1] == '/'
+#ifdef _WIN32
+		|| directory[length - 1] == '\\'
+#endif
+		;
+	char	*path = (char *)malloc(length + strlen(fileName) + 2);
+
+	if (path != NULL)
+		sprintf(path, separated ? "%s%s" : "%s/%s", directory, fileName);
+	return (path);
+}
+
+void	*gmav_stripe_open(
+	const char *const *directories,
+	uint32_t count,
+	const char *fileName,
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesPerSec,
+	const gmavi_config_t *config)
+{
+	gmavi_config_t	stripeConfig;
+
+	if (directories == NULL || count == 0 || fileName == NULL)
+	{
+		gmav_stripe_error(NULL, "No stripes specified");
+		return (NULL);
+	}
+	if (config != NULL)
+		stripeConfig = *config;
+	else
+		gmav_config_default(&stripeConfig);
+	if (stripeConfig.audioChannels || stripeConfig.proxyPath != NULL)
+	{
+		gmav_stripe_error(NULL, "Unsupported stripe configuration");
+		return (NULL);
+	}
+
+	gmavi_striped_t	*striped = (gmavi_striped_t *)calloc(1, sizeof(gmavi_striped_t));
+
+	if (striped == NULL)
+		return (NULL);
+	striped->stripes = (gmavi_t **)calloc(count, sizeof(gmavi_t *));
+	if (striped->stripes == NULL)
+	{
+		gmav_stripe_error(striped, NULL);
+		return (NULL);
+	}
+	striped->count = count;
+	striped->queuePolicy = stripeConfig.queuePolicy;
+	/*	Every drive gets a writer thread of its own, dropping is decided for all of them here	*/
+	if (stripeConfig.queueDepth == 0)
+		stripeConfig.queueDepth = GMAV_SESSION_DEPTH;
+	stripeConfig.queuePolicy = GMAV_QUEUE_BLOCK;
+	stripeConfig.expectedFrames = (uint32_t)(((uint64_t)stripeConfig.expectedFrames + count - 1) / count);
+
+	int32_t	writerCpu = stripeConfig.writerCpu;
+
+	for (uint32_t i = 0; i < count; i++) {
+		char	*path = gmav_stripe_path(directories[i], fileName);
+
+		if (path == NULL)
+		{
+			gmav_stripe_error(striped, NULL);
+			return (NULL);
+		}
+		stripeConfig.writerCpu = writerCpu < 0 ? -1 : writerCpu + (int32_t)i;
+		/*	Each stripe plays at its share of the rate, so it is a valid file on its own	*/
+		striped->stripes[i] = (gmavi_t *)gmav_open_scaled(path, width, height, framesPerSec, count, &stripeConfig);
+		free(path);
+		if (striped->stripes[i] == NULL)
+		{
+			gmav_stripe_error(striped, NULL);
+			return (NULL);
+		}
+	}
+	return (striped);
+}
+
+bool	gmav_stripe_add(
+	void *striped,
+	uint8_t *buffer)
+{
+	gmavi_striped_t	*in = (gmavi_striped_t *)striped;
+
+	if (in == NULL)
+		return (gmav_stripe_error(in, "No striped recording specified (null)"));
+	if (buffer == NULL)
+		return (gmav_stripe_error(in, "No buffer specified (null)"));
+
+	uint32_t	stripe = (uint32_t)(in->frame % in->count);
+
+	/*	A frame dropped from one stripe would shift every frame after it on merging	*/
+	if (in->queuePolicy == GMAV_QUEUE_DROP && !gmav_queue_room(&in->stripes[stripe]->queue))
+		return (true);
+	if (!gmav_add(in->stripes[stripe], buffer))
+	{
+		/*	gmav_add already released the failed stripe	*/
+		in->stripes[stripe] = NULL;
+		return (gmav_stripe_error(in, NULL));
+	}
+	in->frame += 1;
+	return (true);
+}
+
+bool	gmav_stripe_finish(
+	void *striped)
+{
+	gmavi_striped_t	*in = (gmavi_striped_t *)striped;
+	bool			finished = true;
+
+	if (in == NULL)
+		return (gmav_stripe_error(in, "No striped recording specified (null)"));
+	for (uint32_t i = 0; i < in->count; i++) {
+		gmavi_t	*stripe = in->stripes[i];
+
+		in->stripes[i] = NULL;
+		if (!gmav_finish(stripe))
+			finished = false;
+	}
+	gmav_stripe_release(in);
+	return (finished);
+}
+
+/*
+*	Recording options that reproduce a stripe's stream: format, orientation,
+*	alignment and, for Ut Video, the slice count stored in the format extra
+*/
+static bool	gmav_stripe_config(const char *filePath, gmavi_config_t *config, gmavi_static_t *header)
+{
+	FILE	*file = fopen(filePath, "rb");
+	bool	read = file != NULL && fread(header, sizeof(gmavi_static_t), 1, file) == 1;
+
+	if (file != NULL)
+		fclose(file);
+	if (!read || header->main.fcc != FCC('RIFF') || header->strf.fcc != FCC('strf'))
+		return (false);
+
+	BITMAPINFOHEADER	*bitmap = &header->bitmapHeader;
+	bool				alpha = bitmap->bitCount == 32;
+
+	gmav_config_default(config);
+	config->streamFormat = alpha ? GMAV_STREAM_BGRA32 : GMAV_STREAM_BGR24;
+	if (bitmap->compression == FCC('UYVY'))
+		config->streamFormat = GMAV_STREAM_UYVY;
+	else if (bitmap->compression == FCC('YUY2'))
+		config->streamFormat = GMAV_STREAM_YUY2;
+	else if (bitmap->compression == FCC('v210'))
+		config->streamFormat = GMAV_STREAM_V210;
+	else if (bitmap->compression == FCC('ULRG') || bitmap->compression == FCC('ULRA'))
+	{
+		config->codec = GMAV_CODEC_UTVIDEO;
+		config->codecThreads = header->formatExtra[15] + 1u;
+	}
+	else if (bitmap->compression != 0)
+		return (false);
+	if (bitmap->compression == 0 && bitmap->height < 0)
+		config->flags |= GMAV_FLAG_TOPDOWN;
+	if (header->aviHeader.paddingGranularity)
+		config->flags |= GMAV_FLAG_ALIGNED;
+	return (true);
+}
+
+/*
+*	Put frame @frame of the merged recording through, from stripe @frame % @count
+*/
+static bool	gmav_merge_frame(gmavi_t *out, void **readers, uint32_t count, uint64_t frame)
+{
+	uint32_t		size;
+	const uint8_t	*payload = gmav_get_frame(readers[frame % count], (uint32_t)(frame / count), &size);
+
+	if (payload == NULL)
+	{
+		errno = EINVAL;
+		return (false);
+	}
+	return (gmav_write_payload(out, payload, size));
+}
+
+bool	gmav_merge_stripes(
+	const char *const *stripePaths,
+	uint32_t count,
+	const char *filePath)
+{
+	gmavi_config_t	config;
+	gmavi_static_t	header;
+	gmavi_info_t	first;
+	gmavi_info_t	info;
+	uint64_t		frames = 0;
+
+	if (stripePaths == NULL || count == 0 || filePath == NULL
+		|| !gmav_stripe_config(stripePaths[0], &config, &header))
+		return (false);
+
+	void	**readers = (void **)calloc(count, sizeof(void *));
+	bool	merged = readers != NULL;
+
+	for (uint32_t i = 0; merged && i < count; i++) {
+		readers[i] = gmav_open_read(stripePaths[i]);
+		merged = readers[i] != NULL && gmav_get_info(readers[i], &info);
+		if (merged && i == 0)
+			first = info;
+		merged = merged && info.width == first.width && info.height == first.height
+			&& info.compression == first.compression && info.bitCount == first.bitCount;
+		/*	The merge stops at the first gap, a cut short stripe ends the recording there	*/
+		if (merged && (i == 0 || (uint64_t)info.frameCount * count + i < frames))
+			frames = (uint64_t)info.frameCount * count + i;
+	}
+	/*	Every stripe's segments may end up in the merged file	*/
+	config.maxSegments = (uint32_t)((header.superIndex.cb - 24) / sizeof(AVISUPERINDEX_ENTRY)) * count;
+	/*	The merged size is known up front, reserve it all at once	*/
+	config.expectedFrames = frames < UINT32_MAX ? (uint32_t)frames : UINT32_MAX;
+
+	gmavi_t	*out = NULL;
+
+	if (merged)
+	{
+		/*	Stripes run at count times their own scale, back to the recording's rate	*/
+		bool	whole = first.scale % count == 0;
+
+		out = (gmavi_t *)gmav_open_scaled(filePath, first.width, (uint32_t)abs(first.height),
+			whole ? first.rate : first.rate * count, whole ? first.scale / count : first.scale, &config);
+		merged = out != NULL
+			&& !memcmp(out->contents.formatExtra, header.formatExtra, STATIC_FORMAT_EXTRA_SIZE);
+	}
+	for (uint64_t frame = 0; merged && frame < frames; frame++)
+		merged = gmav_merge_frame(out, readers, count, frame);
+	if (out != NULL)
+	{
+		if (merged)
+			merged = gmav_finish(out);
+		else
+			gmav_release(out);
+	}
+	for (uint32_t i = 0; readers != NULL && i < count; i++)
+		gmav_close_read(readers[i]);
+	free(readers);
+	return (merged);
+}
@@ -0,0 +1,227 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef _WIN32
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+# endif
+# include <sched.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+#include "gmav_thread.h"
+
+#ifdef _WIN32
+
+bool	gmav_mutex_init(gmavi_mutex_t *mutex)
+{
+	InitializeSRWLock(mutex);
+	return (true);
+}
+
+void	gmav_mutex_lock(gmavi_mutex_t *mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+void	gmav_mutex_unlock(gmavi_mutex_t *mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void	gmav_mutex_destroy(gmavi_mutex_t *mutex)
+{
+	(void)mutex;
+}
+
+bool	gmav_cond_init(gmavi_cond_t *cond)
+{
+	InitializeConditionVariable(cond);
+	return (true);
+}
+
+void	gmav_cond_wait(gmavi_cond_t *cond, gmavi_mutex_t *mutex)
+{
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+void	gmav_cond_signal(gmavi_cond_t *cond)
+{
+	WakeConditionVariable(cond);
+}
+
+void	gmav_cond_broadcast(gmavi_cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+void	gmav_cond_destroy(gmavi_cond_t *cond)
+{
+	(void)cond;
+}
+
+static DWORD WINAPI	gmav_thread_entry(LPVOID arg)
+{
+	gmavi_thread_t	*thread = (gmavi_thread_t *)arg;
+
+	thread->routine(thread->arg);
+	return (0);
+}
+
+bool	gmav_thread_start(gmavi_thread_t *thread, void (*routine)(void *), void *arg, int32_t cpu)
+{
+	thread->routine = routine;
+	thread->arg = arg;
+	thread->handle = CreateThread(NULL, 0, gmav_thread_entry, thread, 0, NULL);
+	if (thread->handle == NULL)
+		return (false);
+	if (cpu >= 0 && cpu < 64)
+		SetThreadAffinityMask(thread->handle, (DWORD_PTR)1 << cpu);
+	return (true);
+}
+
+void	gmav_thread_join(gmavi_thread_t *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+uint32_t	gmav_cpu_count(void)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1);
+}
+
+uint64_t	gmav_clock_ns(void)
+{
+	LARGE_INTEGER	frequency;
+	LARGE_INTEGER	now;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	/*	Split to keep the multiplication from overflowing	*/
+	return ((uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000000u
+		+ (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000000u / (uint64_t)frequency.QuadPart);
+}
+
+#else
+
+bool	gmav_mutex_init(gmavi_mutex_t *mutex)
+{
+	return (pthread_mutex_init(mutex, NULL) == 0);
+}
+
+void	gmav_mutex_lock(gmavi_mutex_t *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void	gmav_mutex_unlock(gmavi_mutex_t *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void	gmav_mutex_destroy(gmavi_mutex_t *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+bool	gmav_cond_init(gmavi_cond_t *cond)
+{
+	return (pthread_cond_init(cond, NULL) == 0);
+}
+
+void	gmav_cond_wait(gmavi_cond_t *cond, gmavi_mutex_t *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+void	gmav_cond_signal(gmavi_cond_t *cond)
+{
+	pthread_cond_signal(cond);
+}
+
+void	gmav_cond_broadcast(gmavi_cond_t *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+void	gmav_cond_destroy(gmavi_cond_t *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+static void	*gmav_thread_entry(void *arg)
+{
+	gmavi_thread_t	*thread = (gmavi_thread_t *)arg;
+
+	thread->routine(thread->arg);
+	return (NULL);
+}
+
+bool	gmav_thread_start(gmavi_thread_t *thread, void (*routine)(void *), void *arg, int32_t cpu)
+{
+	thread->routine = routine;
+	thread->arg = arg;
+	if (pthread_create(&thread->handle, NULL, gmav_thread_entry, thread))
+		return (false);
+# ifdef __linux__
+	if (cpu >= 0 && cpu < CPU_SETSIZE)
+	{
+		cpu_set_t	set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(thread->handle, sizeof(cpu_set_t), &set);
+	}
+# else
+	(void)cpu;
+# endif
+	return (true);
+}
+
+void	gmav_thread_join(gmavi_thread_t *thread)
+{
+	pthread_join(thread->handle, NULL);
+}
+
+uint32_t	gmav_cpu_count(void)
+{
+	long	count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0 ? (uint32_t)count : 1);
+}
+
+uint64_t	gmav_clock_ns(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+*	Copyright (c) 2022 Gijs Oosterling
+*	All rights reserved.
+*	
+*		Permission is hereby granted, free of charge, to any person obtaining a copy
+*		of this software and associated documentation files (the "Software"), to deal
+*		in the Software without restriction, including without limitation the rights
+*		to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*		copies of the Software, and to permit persons to whom the Software is
+*		furnished to do so, subject to the following conditions:
+*	
+*		The above copyright notice and this permission notice shall be included in all
+*		copies or substantial portions of the Software.
+*	
+*		THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*		IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*		FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*		AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*		LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*		OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+*		SOFTWARE.
+*	
+*	Redistributions in binary form must reproduce the above copyright notice.
+*/
+
+#ifndef GMAV_THREAD_H
+# define GMAV_THREAD_H
+# include <stdint.h>
+# include <stdbool.h>
+# ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+# else
+#  include <pthread.h>
+# endif
+
+/*
+*	Minimal threading layer, Win32 primitives on Windows and pthreads elsewhere
+*/
+# ifdef _WIN32
+typedef SRWLOCK				gmavi_mutex_t;
+typedef CONDITION_VARIABLE	gmavi_cond_t;
+# else
+typedef pthread_mutex_t		gmavi_mutex_t;
+typedef pthread_cond_t		gmavi_cond_t;
+# endif
+
+/*
+*	@param	handle			-	Native thread handle
+*	@param	routine			-	Thread body
+*	@param	arg				-	Argument passed to @routine
+*/
+typedef struct	s_gmavi_thread
+{
+# ifdef _WIN32
+	HANDLE		handle;
+# else
+	pthread_t	handle;
+# endif
+	void		(*routine)(void *arg);
+	void		*arg;
+}	gmavi_thread_t;
+
+bool	gmav_mutex_init(gmavi_mutex_t *mutex);
+void	gmav_mutex_lock(gmavi_mutex_t *mutex);
+void	gmav_mutex_unlock(gmavi_mutex_t *mutex);
+void	gmav_mutex_destroy(gmavi_mutex_t *mutex);
+
+bool	gmav_cond_init(gmavi_cond_t *cond);
+void	gmav_cond_wait(gmavi_cond_t *cond, gmavi_mutex_t *mutex);
+void	gmav_cond_signal(gmavi_cond_t *cond);
+void	gmav_cond_broadcast(gmavi_cond_t *cond);
+void	gmav_cond_destroy(gmavi_cond_t *cond);
+
+/*
+*	Start @routine on a new thread, @thread must stay in place until joined
+*
+*	@param	cpu				-	Pin the thread to this CPU, negative to leave it unpinned
+*/
+bool	gmav_thread_start(gmavi_thread_t *thread, void (*routine)(void *), void *arg, int32_t cpu);
+void	gmav_thread_join(gmavi_thread_t *thread);
+
+/*
+*	Amount of online CPUs, at least 1
+*/
+uint32_t	gmav_cpu_count(void);
+
+/*
+*	Monotonic clock in nanoseconds
+*/
+uint64_t	gmav_clock_ns(void);
+
+/*
+*	Counters shared with threads that only read them
+*/
+static inline void	gmav_atomic_add(volatile uint64_t *value, uint64_t amount)
+{
+# ifdef _WIN32
+	InterlockedExchangeAdd64((volatile LONG64 *)value, (LONG64)amount);
+# else
+	__atomic_fetch_add(value, amount, __ATOMIC_RELAXED);
+# endif
+}
+
+static inline uint64_t	gmav_atomic_load(volatile uint64_t *value)
+{
+# ifdef _WIN32
+	return ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)value, 0, 0));
+# else
+	return (__atomic_load_n(value, __ATOMIC_RELAXED));
+# endif
+}
+
+/*
+*	Raise @value to @amount, a single writer only ever loses a race to itself
+*/
+static inline void	gmav_atomic_max(volatile uint64_t *value, uint64_t amount)
+{
+	if (gmav_atomic_load(value) < amount)
+	{
+# ifdef _WIN32
+		InterlockedExchange64((volatile LONG64 *)value, (LONG64)amount);
+# else
+		__atomic_store_n(value, amount, __ATOMIC_RELAXED);
+# endif
+	}
+}
+
+#endif
@@ -24,8 +24,8 @@
 */
 
 #include <stdio.h>
-#include <io.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
 #include "../include/libgmavi.h"
@@ -33,17 +33,55 @@
 #include <errno.h>
 #include <sys/stat.h>
 
+/*
+*	Release an instance and everything it owns, the writer thread must be stopped
+*/
+void	gmav_release(gmavi_t *avi)
+{
+	if (avi->mapBase != NULL)
+		avi->io->unmap(avi->ioHandle, avi->mapBase, avi->mapSize);
+	if (avi->ioHandle != NULL)
+		avi->io->close(avi->ioHandle);
+	if (avi->ix00.avixIndexEntries != NULL)
+		free(avi->ix00.avixIndexEntries);
+	if (avi->alignBuffer != NULL)
+		gmav_aligned_free(avi->alignBuffer);
+	if (avi->stageBuffer != NULL && !gmav_frames_owns(&avi->frames, avi->stageBuffer))
+		gmav_aligned_free(avi->stageBuffer);
+	if (avi->convertBuffer != NULL)
+		gmav_aligned_free(avi->convertBuffer);
+	gmav_convert_release(&avi->convert);
+	if (avi->codec != NULL)
+		gmav_codec_destroy(avi->codec);
+	free(avi->codec);
+	free(avi->encodeBuffer);
+	if (avi->lastFrame != NULL)
+		gmav_aligned_free(avi->lastFrame);
+	free(avi->indexStage);
+	free(avi->checksums);
+	free(avi->headerImage);
+	free(avi->ix01.avixIndexEntries);
+	free(avi->audioPending);
+	free(avi->audioChunk);
+	if (avi->blockAlign)
+		gmav_mutex_destroy(&avi->audioLock);
+	gmav_queue_destroy(&avi->queue);
+	gmav_frames_release(&avi->frames);
+	if (avi->proxy != NULL)
+		gmav_release(avi->proxy);
+	gmav_downscale_release(&avi->downscale);
+	free(avi->filePath);
+	free(avi);
+}
+
+/*
+*	Public entry points report failures here, which also releases the instance.
+*	Internal functions only return false and leave errno set.
+*/
 static bool	gmav_error(gmavi_t *avi, uint32_t errorCode, const char *additionalString)
 {
 	if (avi)
-	{
-		for (uint32_t i = 0; i < avi->riffChunks; i++) {
-			if (avi->ix00[i].avixIndexEntries != NULL)
-				free(avi->ix00[i].avixIndexEntries);
-		}
-		free(avi->filePath);
-		free(avi);
-	}
+		gmav_release(avi);
 	if (additionalString)
 	{
 		printf("%s\n", additionalString);
@@ -56,19 +94,372 @@ static bool	gmav_error(gmavi_t *avi, uint32_t errorCode, const char *additionalS
 	return (false);
 }
 
+/*
+*	Positional write, does not move the end of the file
+*/
+static bool	gmav_write(gmavi_t *avi, uint64_t offset, const void *data, size_t size)
+{
+	gmavi_iovec_t	iov = {data, size};
+	uint64_t		started = gmav_clock_ns();
+	bool			written = avi->io->writev(avi->ioHandle, &iov, 1, offset);
+
+	gmav_atomic_add(&avi->stats.headerNanos, gmav_clock_ns() - started);
+	gmav_atomic_add(&avi->stats.headerWrites, 1);
+	gmav_atomic_add(&avi->stats.bytesWritten, size);
+	return (written);
+}
+
+/*
+*	Gathered write at the end of the file
+*/
+static bool	gmav_append(gmavi_t *avi, const gmavi_iovec_t *iov, uint32_t count)
+{
+	uint64_t	start = avi->writeOffset;
+
+	if (!avi->io->writev(avi->ioHandle, iov, count, avi->writeOffset))
+		return (false);
+	for (uint32_t i = 0; i < count; i++)
+		avi->writeOffset += iov[i].size;
+	gmav_atomic_add(&avi->stats.bytesWritten, avi->writeOffset - start);
+	return (true);
+}
+
+/*
+*	Add [@start, @end) to the sorted patch ranges, joining it with any range it
+*	comes within @GMAV_PATCH_GAP bytes of. False when no range is left for it
+*/
+static bool	gmav_mark_patch(gmavi_t *avi, uint32_t start, uint32_t end)
+{
+	gmavi_patch_t	*patches = avi->patches;
+	uint32_t		i = 0;
+	uint32_t		j;
+
+	while (i < avi->patchCount && patches[i].end + GMAV_PATCH_GAP < start)
+		i++;
+	if (i < avi->patchCount && patches[i].start <= end + GMAV_PATCH_GAP)
+	{
+		if (start < patches[i].start)
+			patches[i].start = start;
+		if (end > patches[i].end)
+			patches[i].end = end;
+		for (j = i + 1; j < avi->patchCount && patches[j].start <= patches[i].end + GMAV_PATCH_GAP; j++) {
+			if (patches[j].end > patches[i].end)
+				patches[i].end = patches[j].end;
+		}
+		memmove(patches + i + 1, patches + j, (avi->patchCount - j) * sizeof(gmavi_patch_t));
+		avi->patchCount -= j - i - 1;
+		return (true);
+	}
+	if (avi->patchCount == GMAV_PATCH_MAX)
+		return (false);
+	memmove(patches + i + 1, patches + i, (avi->patchCount - i) * sizeof(gmavi_patch_t));
+	patches[i] = (gmavi_patch_t){start, end};
+	avi->patchCount += 1;
+	return (true);
+}
+
+/*
+*	Write every header range patched since the last batch
+*/
+static bool	gmav_flush_header(gmavi_t *avi)
+{
+	uint32_t	count = avi->patchCount;
+
+	avi->patchCount = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		gmavi_patch_t	patch = avi->patches[i];
+
+		if (!gmav_write(avi, patch.start, avi->headerImage + patch.start, patch.end - patch.start))
+			return (false);
+	}
+	return (true);
+}
+
+/*
+*	Change a header field. It only reaches the file with the next gmav_flush_header,
+*	fields past the header (in later segments) are written right away
+*/
+static bool	gmav_patch(gmavi_t *avi, uint64_t offset, const void *data, size_t size)
+{
+	if (offset + size > avi->headerSize)
+		return (gmav_write(avi, offset, data, size));
+	memcpy(avi->headerImage + offset, data, size);
+	if (gmav_mark_patch(avi, (uint32_t)offset, (uint32_t)(offset + size)))
+		return (true);
+	return (gmav_flush_header(avi) && gmav_mark_patch(avi, (uint32_t)offset, (uint32_t)(offset + size)));
+}
+
+static bool	gmav_consume_frame(void *ctx, const uint8_t *slot);
+
+/*
+*	Cut off anything the file was grown by ahead of time and close it
+*/
+static bool	gmav_close_file(gmavi_t *avi)
+{
+	void	*handle = avi->ioHandle;
+	bool	trimmed = true;
+
+	if (avi->extended && avi->io->truncate != NULL)
+		trimmed = avi->io->truncate(handle, avi->writeOffset);
+	avi->ioHandle = NULL;
+	if (!avi->io->close(handle) || !trimmed)
+		return (false);
+	return (true);
+}
+
+/*
+*	Reserve disk space for @size bytes past what is already reserved. Only a hint,
+*	once the backend refuses (no space, unsupported) nothing more is reserved
+*/
+static void	gmav_reserve(gmavi_t *avi, uint64_t size)
+{
+	if (!avi->io->allocate(avi->ioHandle, avi->allocated, size))
+	{
+		avi->allocated = 0;
+		return ;
+	}
+	avi->allocated += size;
+	avi->extended = true;
+}
+
+/*
+*	A pool buffer the backend was done with
+*/
+static void	gmav_release_held(void *ctx, const void *data)
+{
+	gmav_frames_give((gmavi_frames_t *)ctx, (uint8_t *)data);
+}
+
+/*
+*	Whether @holdable (a pool buffer) is part of the write and can be left to
+*	the backend until its write completes. A queue slot is replaced by a fresh
+*	pool buffer first
+*/
+static bool	gmav_hold_frame(gmavi_t *avi, const gmavi_iovec_t *iov, uint32_t count)
+{
+	bool	found = false;
+
+	if (avi->io->writevHeld == NULL || avi->holdable == NULL)
+		return (false);
+	for (uint32_t i = 0; i < count && !found; i++)
+		found = iov[i].base == avi->holdable && iov[i].size;
+	return (found && (avi->queue.depth == 0 || gmav_queue_keep(&avi->queue)));
+}
+
+/*
+*	Frame write at @offset, may still be in flight on return when the backend
+*	supports it. Anything else is written synchronously.
+*/
+static bool	gmav_write_frame_data(gmavi_t *avi, const gmavi_iovec_t *iov, uint32_t count, uint64_t offset)
+{
+	uint64_t	size = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+		size += iov[i].size;
+	gmav_atomic_add(&avi->stats.bytesWritten, size);
+	if (gmav_hold_frame(avi, iov, count))
+	{
+		uint8_t	*held = avi->holdable;
+
+		avi->holdable = NULL;
+		return (avi->io->writevHeld(avi->ioHandle, iov, count, offset, held, gmav_release_held, &avi->frames));
+	}
+	if (avi->io->writevAsync != NULL)
+		return (avi->io->writevAsync(avi->ioHandle, iov, count, offset));
+	return (avi->io->writev(avi->ioHandle, iov, count, offset));
+}
+
+static char	*gmav_strdup(const char *str)
+{
+	size_t	len = strlen(str) + 1;
+	char	*out = (char *)malloc(len);
+
+	if (out != NULL)
+		memcpy(out, str, len);
+	return (out);
+}
+
+void		gmav_config_default(
+	gmavi_config_t	*config)
+{
+	memset(config, 0, sizeof(gmavi_config_t));
+	config->queuePolicy = GMAV_QUEUE_BLOCK;
+	config->writerCpu = -1;
+}
+
 void		*gmav_open(
 	const char 	*filePath,
 	uint32_t	width,
 	uint32_t	height,
 	uint32_t	framesPerSec)
 {
+	return (gmav_open_ex(filePath, width, height, framesPerSec, NULL));
+}
+
+/*
+*	Aligned mode: each stride holds the bitmap (padded to an even size), a JUNK chunk
+*	and the header of the next frame, rounded up to a whole sector
+*/
+static bool	gmav_setup_aligned(gmavi_t *avi)
+{
+	avi->streamTickSize = (uint32_t)GMAV_FRAME_STRIDE(avi->bitmapSize, true);
+	avi->alignBuffer = (uint8_t *)gmav_aligned_alloc(avi->streamTickSize);
+	if (avi->alignBuffer == NULL)
+		return (false);
+	memset(avi->alignBuffer, 0, avi->streamTickSize);
+	return (true);
+}
+
+/*
+*	Offset of the first '00db' header within a movi list whose data starts at @moviData
+*/
+static uint32_t	gmav_movi_lead(gmavi_t *avi, uint64_t moviData)
+{
+	if (!(avi->flags & GMAV_FLAG_ALIGNED))
+		return (0);
+	return ((uint32_t)(GMAV_ALIGN_UP(moviData + 16, GMAV_IO_SECTOR) - 8 - moviData));
+}
+
+/*
+*	biCompression and fccHandler of a stream format, 0 for uncompressed RGB
+*/
+static uint32_t	gmav_stream_compression(uint32_t streamFormat)
+{
+	switch (streamFormat)
+	{
+		case GMAV_STREAM_UYVY:
+			return (FCC('UYVY'));
+		case GMAV_STREAM_YUY2:
+			return (FCC('YUY2'));
+		case GMAV_STREAM_V210:
+			return (FCC('v210'));
+	}
+	return (0);
+}
+
+/*
+*	Encoder and the buffer coded chunks are assembled in: header, frame and pad byte
+*/
+static bool	gmav_setup_codec(gmavi_t *avi, uint32_t width, uint32_t height, uint32_t threads)
+{
+	avi->codec = (gmavi_codec_t *)calloc(1, sizeof(gmavi_codec_t));
+	if (avi->codec == NULL)
+		return (false);
+	if (!gmav_codec_start(avi->codec, width, height, avi->bitmapSize / width / height,
+		threads ? threads : gmav_cpu_count()))
+		return (false);
+	avi->encodeBuffer = (uint8_t *)malloc(sizeof(RIFFCHUNK) + gmav_codec_bound(avi->codec) + 1);
+	return (avi->encodeBuffer != NULL);
+}
+
+/*
+*	PCM format of the audio stream, the lock guards the samples gmav_add_audio buffers
+*/
+static bool	gmav_setup_audio(gmavi_t *avi, const gmavi_config_t *config)
+{
+	uint32_t	bits = config->audioBits ? config->audioBits : 16;
+
+	if (config->audioSampleRate == 0 || bits % 8 || bits > 32 || config->audioChannels > 0xFFFF
+		|| config->audioChannels * (bits / 8) > 0xFFFF || (avi->flags & GMAV_FLAG_ALIGNED))
+	{
+		errno = EINVAL;
+		return (false);
+	}
+	avi->audio.format = (WAVEFORMATEX){
+		WAVE_FORMAT_PCM,					/*	formatTag			*/
+		(uint16_t)config->audioChannels,	/*	channels			*/
+		config->audioSampleRate,			/*	samplesPerSec		*/
+		config->audioSampleRate * config->audioChannels * (bits / 8),	/*	avgBytesPerSec	*/
+		(uint16_t)(config->audioChannels * (bits / 8)),	/*	blockAlign		*/
+		(uint16_t)bits,						/*	bitsPerSample		*/
+		0									/*	size				*/
+	};
+	if (!gmav_mutex_init(&avi->audioLock))
+		return (false);
+	avi->blockAlign = avi->audio.format.blockAlign;
+	return (true);
+}
+
+static bool	gmav_consume_proxy(void *ctx, const uint8_t *slot);
+
+/*
+*	Proxy of the same stream and timing, written by a thread of its own. Its
+*	queue takes full resolution stream frames, each followed by the main frame
+*	number, and the proxy thread downscales them into its convert buffer
+*/
+static bool	gmav_setup_proxy(gmavi_t *avi, const gmavi_config_t *config,
+	uint32_t width, uint32_t height, uint32_t framesPerSec, uint32_t scale)
+{
+	gmavi_config_t	proxyConfig;
+	uint32_t		factor = config->proxyScale ? config->proxyScale : 2;
+	uint32_t		proxyWidth = width / factor;
+
+	/*	4:2:2 pairs stay whole	*/
+	if (gmav_stream_is_yuv(config->streamFormat))
+		proxyWidth &= ~1u;
+	gmav_config_default(&proxyConfig);
+	proxyConfig.flags = avi->flags & (GMAV_FLAG_TOPDOWN | GMAV_FLAG_DEDUP);
+	proxyConfig.streamFormat = config->streamFormat;
+	proxyConfig.codec = config->codec;
+	proxyConfig.codecThreads = config->codecThreads;
+	proxyConfig.segmentSize = config->segmentSize;
+	proxyConfig.maxSegments = config->maxSegments;
+	proxyConfig.expectedFrames = config->expectedFrames;
+	if (proxyWidth == 0 || height / factor == 0 || config->streamFormat == GMAV_STREAM_V210)
+	{
+		errno = EINVAL;
+		return (false);
+	}
+	avi->proxy = (gmavi_t *)gmav_open_scaled(config->proxyPath, proxyWidth, height / factor,
+		framesPerSec, scale, &proxyConfig);
+	if (avi->proxy == NULL)
+		return (false);
+
+	gmavi_t	*proxy = avi->proxy;
+
+	/*	Never fed input frames, and frames dropped before the first show up black	*/
+	if (proxy->convertBuffer == NULL)
+		proxy->convertBuffer = (uint8_t *)gmav_aligned_alloc(proxy->bitmapSize);
+	if (proxy->convertBuffer == NULL)
+		return (false);
+	memset(proxy->convertBuffer, 0, proxy->bitmapSize);
+	return (gmav_downscale_setup(&proxy->downscale, config->streamFormat, proxyWidth,
+		height / factor, factor, avi->convert.dstStride, proxy->convert.dstStride)
+		&& gmav_queue_start(&proxy->queue, GMAV_PROXY_DEPTH, avi->bitmapSize + sizeof(uint32_t),
+			-1, NULL, gmav_consume_proxy, proxy));
+}
+
+void		*gmav_open_ex(
+	const char 	*filePath,
+	uint32_t	width,
+	uint32_t	height,
+	uint32_t	framesPerSec,
+	const gmavi_config_t	*config)
+{
+	return (gmav_open_scaled(filePath, width, height, framesPerSec, 1, config));
+}
+
+/*
+*	gmav_open_ex at @framesPerSec / @scale frames per second
+*/
+void		*gmav_open_scaled(
+	const char 	*filePath,
+	uint32_t	width,
+	uint32_t	height,
+	uint32_t	framesPerSec,
+	uint32_t	scale,
+	const gmavi_config_t	*config)
+{
+	gmavi_config_t		defaults;
 	gmavi_fileAddr_t	fileAddr;
 	gmavi_static_t		contents;
+	gmavi_odml_t		odml;
 	gmavi_t				*out;
 
 	/*	Ensure everything is zeroed	*/
 	memset(&fileAddr, 0, sizeof(gmavi_fileAddr_t));
 	memset(&contents, 0, sizeof(gmavi_static_t));
+	memset(&odml, 0, sizeof(gmavi_odml_t));
 	out = (gmavi_t *)calloc(1, sizeof(gmavi_t));
 	if (out == NULL)
 	{
@@ -76,10 +467,111 @@ void		*gmav_open(
 		return (NULL);
 	}
 
-	out->filePath = _strdup(filePath);
-	out->bitmapSize = width * height * 3;
-	out->streamTickSize = out->bitmapSize + 8;
-	out->maxFrames = 1999991696 / out->streamTickSize;
+	if (config == NULL)
+	{
+		gmav_config_default(&defaults);
+		config = &defaults;
+	}
+	out->flags = config->flags;
+	if (out->flags & GMAV_FLAG_DIRECT)
+		out->flags |= GMAV_FLAG_ALIGNED;
+
+	out->filePath = gmav_strdup(filePath);
+	bool		yuv = gmav_stream_is_yuv(config->streamFormat);
+	bool		coded = config->codec != GMAV_CODEC_NONE;
+	bool		topDown = yuv || coded || (out->flags & GMAV_FLAG_TOPDOWN);
+	bool		flip = !(out->flags & GMAV_FLAG_INPUT_TOPDOWN) != !topDown;
+	/*	A negative DIB height marks a top-down RGB bitmap, FourCC formats are top-down regardless	*/
+	int32_t		dibHeight = (topDown && !yuv && !coded) ? -(int32_t)height : (int32_t)height;
+
+	if (coded && (config->codec != GMAV_CODEC_UTVIDEO || yuv || (out->flags & GMAV_FLAG_ALIGNED)))
+	{
+		gmav_error(out, EINVAL, "Unsupported codec configuration");
+		return (NULL);
+	}
+	if (!gmav_convert_setup(&out->convert, config->inputFormat, config->streamFormat,
+		width, height, config->inputStride, flip))
+	{
+		gmav_error(out, EINVAL, "Unsupported pixel format");
+		return (NULL);
+	}
+	out->bitmapSize = (uint32_t)(out->convert.dstStride * height);
+	if (!gmav_frames_setup(&out->frames, out->convert.srcStride * height, config->hugePages))
+	{
+		gmav_error(out, errno, NULL);
+		return (NULL);
+	}
+	if (!out->convert.identity && config->queueDepth == 0)
+	{
+		out->convertBuffer = (uint8_t *)gmav_aligned_alloc(out->bitmapSize);
+		if (out->convertBuffer == NULL)
+		{
+			gmav_error(out, errno, NULL);
+			return (NULL);
+		}
+	}
+	if (coded && !gmav_setup_codec(out, width, height, config->codecThreads))
+	{
+		gmav_error(out, errno, NULL);
+		return (NULL);
+	}
+	if (out->flags & GMAV_FLAG_DEDUP)
+	{
+		out->lastFrame = (uint8_t *)gmav_aligned_alloc(out->bitmapSize);
+		if (out->lastFrame == NULL)
+		{
+			gmav_error(out, errno, NULL);
+			return (NULL);
+		}
+		out->frameDiff = gmav_select_diff();
+	}
+	if (config->audioChannels && !gmav_setup_audio(out, config))
+	{
+		gmav_error(out, EINVAL, "Unsupported audio configuration");
+		return (NULL);
+	}
+	/*	Variable size or repeated frames, or audio chunks in between, need every index entry recorded	*/
+	out->recordIndex = coded || out->lastFrame != NULL || out->blockAlign;
+	if (out->flags & GMAV_FLAG_CHECKSUM)
+		out->crc = gmav_select_crc();
+	out->checkpointFrames = config->checkpointFrames;
+	out->chunkId = coded ? FCC('00dc') : FCC('00db');
+
+	uint32_t	compression = coded ? out->codec->fourcc : gmav_stream_compression(config->streamFormat);
+
+	out->streamTickSize = (uint32_t)GMAV_FRAME_STRIDE(out->bitmapSize, false);
+	if ((out->flags & GMAV_FLAG_ALIGNED) && !gmav_setup_aligned(out))
+	{
+		gmav_error(out, errno, NULL);
+		return (NULL);
+	}
+	out->segmentSize = config->segmentSize ? config->segmentSize : RIFF_MAX_SIZE;
+	out->maxSegments = config->maxSegments ? config->maxSegments : AVI_MASTER_INDEX_SIZE;
+
+	/*	Super index room, then JUNK up to a sector boundary where movi starts	*/
+	uint64_t	superIndexRoom = sizeof(AVISUPERINDEX_ENTRY) * (uint64_t)out->maxSegments;
+	uint64_t	audioStart = sizeof(gmavi_static_t) + superIndexRoom;
+	uint64_t	odmlStart = audioStart + (out->blockAlign ? sizeof(gmavi_audio_t) + superIndexRoom : 0);
+	uint64_t	moviList = GMAV_ALIGN_UP(odmlStart + sizeof(gmavi_odml_t), GMAV_IO_SECTOR);
+
+	out->headerSize = (uint32_t)(moviList + sizeof(RIFFLIST));
+	/*	Every frame of a segment also costs its ix00 entry, and idx1 entry in the first,
+		and its checksum along with the chunk holding them	*/
+	uint64_t	segmentRoom = moviList + sizeof(RIFFLIST) + GMAV_IO_SECTOR;
+	uint64_t	frameRoom = out->streamTickSize + sizeof(AVIOLDINDEX_ENTRY) + sizeof(AVISTDINDEX_ENTRY);
+
+	if (out->crc != NULL)
+	{
+		segmentRoom += sizeof(gmavi_checksums_t) + sizeof(uint32_t);
+		frameRoom += sizeof(uint32_t);
+	}
+	if (segmentRoom < out->segmentSize)
+		out->maxFrames = (uint32_t)((out->segmentSize - segmentRoom) / frameRoom);
+	if (out->maxFrames == 0)
+	{
+		gmav_error(out, EINVAL, "Segment size too small");
+		return (NULL);
+	}
 
 	contents.main = (RIFFLIST){
 		FCC('RIFF'),						/*	fcc					*/
@@ -92,26 +584,28 @@ void		*gmav_open(
 
 	contents.hdrl = (RIFFLIST){
 		FCC('LIST'),						/*	fcc					*/
-		STATIC_HEADER_LIST_SIZE,			/*	cb					*/
+		STATIC_HEADER_LIST_SIZE(out->maxSegments),	/*	cb			*/
 		FCC('hdrl')							/*	fccListType			*/
 	};
+	if (out->blockAlign)
+		contents.hdrl.cb += sizeof(RIFFCHUNK) + STATIC_AUDIO_LIST_SIZE(out->maxSegments);
 
 	uint32_t	avihMaxBytesPerSec;
-	if ((uint32_t)0x7FFFFFFF / out->bitmapSize > framesPerSec)
-		avihMaxBytesPerSec = out->bitmapSize * framesPerSec;
+	if ((uint32_t)0x7FFFFFFF / out->bitmapSize > framesPerSec / scale)
+		avihMaxBytesPerSec = (uint32_t)((uint64_t)out->bitmapSize * framesPerSec / scale);
 	else
 		avihMaxBytesPerSec = 0x7FFFFFFF;
 
 	contents.aviHeader = (AVIMAINHEADER){
 		FCC('avih'),						/*	fcc					*/
 		STATIC_AVI_HEADER_SIZE,				/*	cb					*/
-		1000000 / framesPerSec,				/*	microSecPerFrame	*/
+		(uint32_t)(1000000ull * scale / framesPerSec),	/*	microSecPerFrame	*/
 		avihMaxBytesPerSec,					/*	maxBytesPerSec		*/
-		0,									/*	paddingGranularity	*/
-		AVIF_HASINDEX,						/*	flags				*/
+		(out->flags & GMAV_FLAG_ALIGNED) ? GMAV_IO_SECTOR : 0,	/*	paddingGranularity	*/
+		AVIF_HASINDEX | (out->blockAlign ? AVIF_ISINTERLEAVED : 0),	/*	flags	*/
 		TO_BE_DETERMINED,					/*	totalFrames			*/
 		0,									/*	initialFames		*/
-		1,									/*	streams				*/
+		out->blockAlign ? 2 : 1,			/*	streams				*/
 		0,									/*	suggestedBufferSize	*/
 		width,								/*	width				*/
 		height								/*	height				*/
@@ -121,7 +615,7 @@ void		*gmav_open(
 
 	contents.strl = (RIFFLIST){
 		FCC('LIST'),						/*	fcc					*/
-		STATIC_STREAM_LIST_SIZE,			/*	cb					*/
+		STATIC_STREAM_LIST_SIZE(out->maxSegments),	/*	cb			*/
 		FCC('strl')							/*	fccListType			*/
 	};
 
@@ -129,16 +623,16 @@ void		*gmav_open(
 		FCC('strh'),						/*	fcc					*/
 		STATIC_STREAM_HEADER_SIZE,			/*	cb					*/
 		FCC('vids'),						/*	fccType				*/
-		FCC('DIB '),						/*	fccHandler			*/
+		compression ? compression : FCC('DIB '),	/*	fccHandler		*/
 		0,									/*	flags				*/
 		0,									/*	priority			*/
 		0,									/*	language			*/
 		0,									/*	initialFrames		*/
-		1,									/*	scale				*/
+		scale,								/*	scale				*/
 		framesPerSec,						/*	rate				*/
 		0,									/*	start				*/
 		TO_BE_DETERMINED,					/*	length				*/
-		out->bitmapSize,					/*	suggestedBufferSize	*/
+		coded ? (uint32_t)gmav_codec_bound(out->codec) : out->bitmapSize,	/*	suggestedBufferSize	*/
 		0xFFFFFFFF,							/*	quality				*/
 		0,									/*	sampleSize			*/
 		(RECT){0, 0, width, height}			/*	frame				*/
@@ -148,183 +642,1169 @@ void		*gmav_open(
 
 	contents.strf = (RIFFCHUNK){
 		FCC('strf'),						/*	fcc					*/
-		STATIC_STREAM_FORMAT_SIZE			/*	cb					*/
+		STATIC_STREAM_FORMAT_SIZE + (coded ? STATIC_FORMAT_EXTRA_SIZE : 0)	/*	cb	*/
 	};
 
 	contents.bitmapHeader = (BITMAPINFOHEADER){
 		STATIC_BITMAP_HEADER_SIZE,			/*	size				*/
-		width,								/*	width				*/
-		height,								/*	height				*/
+		(int32_t)width,						/*	width				*/
+		dibHeight,							/*	height				*/
 		1,									/*	planes				*/
-		24,									/*	bitCount			*/
-		0,									/*	compression			*/
+		(uint16_t)gmav_stream_bit_count(config->streamFormat),	/*	bitCount	*/
+		compression,						/*	compression			*/
 		out->bitmapSize,					/*	sizeImage			*/
 	};
 
+	if (coded)
+		memcpy(contents.formatExtra, out->codec->extraData, STATIC_FORMAT_EXTRA_SIZE);
+	else
+	{
+		RIFFCHUNK	junk = {FCC('JUNK'), STATIC_FORMAT_EXTRA_SIZE - sizeof(RIFFCHUNK)};
+
+		memcpy(contents.formatExtra, &junk, sizeof(RIFFCHUNK));
+	}
+
 	contents.superIndex = (AVISUPERINDEX){
 		FCC('JUNK'),						/*	fcc					*/
-		STATIC_SUPER_INDEX_SIZE,			/*	cb					*/
+		STATIC_SUPER_INDEX_SIZE(out->maxSegments),	/*	cb			*/
 	};
 	
 	fileAddr.superIndex = (uint64_t)&contents.superIndex - fileAddr._fileBaseStart;
 	fileAddr.entriesInUse = (uint64_t)&contents.superIndex.entriesInUse - fileAddr._fileBaseStart;
-	fileAddr.superIndexEntries = (uint64_t)&contents.superIndex.index[0] - fileAddr._fileBaseStart;
+	fileAddr.superIndexEntries = sizeof(gmavi_static_t);
+
+	if (out->blockAlign)
+	{
+		out->audio.strl = (RIFFLIST){
+			FCC('LIST'),					/*	fcc					*/
+			STATIC_AUDIO_LIST_SIZE(out->maxSegments),	/*	cb			*/
+			FCC('strl')						/*	fccListType			*/
+		};
+
+		out->audio.streamHeader = (AVISTREAMHEADER){
+			FCC('strh'),					/*	fcc					*/
+			STATIC_STREAM_HEADER_SIZE,		/*	cb					*/
+			FCC('auds'),					/*	fccType				*/
+			0,								/*	fccHandler			*/
+			0,								/*	flags				*/
+			0,								/*	priority			*/
+			0,								/*	language			*/
+			0,								/*	initialFrames		*/
+			1,								/*	scale				*/
+			config->audioSampleRate,		/*	rate				*/
+			0,								/*	start				*/
+			TO_BE_DETERMINED,				/*	length				*/
+			(uint32_t)((uint64_t)config->audioSampleRate * scale / framesPerSec + 1) * out->blockAlign,	/*	suggestedBufferSize	*/
+			0xFFFFFFFF,						/*	quality				*/
+			out->blockAlign,				/*	sampleSize			*/
+		};
+
+		out->audio.strf = (RIFFCHUNK){
+			FCC('strf'),					/*	fcc					*/
+			STATIC_WAVE_FORMAT_SIZE			/*	cb					*/
+		};
+
+		out->audio.superIndex = (AVISUPERINDEX){
+			FCC('JUNK'),					/*	fcc					*/
+			STATIC_SUPER_INDEX_SIZE(out->maxSegments),	/*	cb			*/
+		};
+
+		fileAddr.audioLength = audioStart + offsetof(gmavi_audio_t, streamHeader.length);
+		fileAddr.audioSuperIndex = audioStart + offsetof(gmavi_audio_t, superIndex);
+		fileAddr.audioSuperIndexEntries = audioStart + sizeof(gmavi_audio_t);
+	}
 
-	contents.odml = (RIFFLIST){
+	odml.odml = (RIFFLIST){
 		FCC('LIST'),						/*	fcc					*/
 		STATIC_EXTENDED_LIST_SIZE,			/*	cb					*/
 		FCC('odml')							/*	fccListType			*/
 	};
 
-	contents.extendedHeader = (AVIEXTHEADER){
+	odml.extendedHeader = (AVIEXTHEADER){
 		FCC('dmlh'),						/*	fcc					*/
 		STATIC_EXTENDED_HEADER_SIZE,		/*	cb					*/
 		TO_BE_DETERMINED,					/*	grandFrames			*/
 		0x0									/*	future				*/
 	};
-	fileAddr.grandFrames = (uint64_t)&contents.extendedHeader.grandFrames - fileAddr._fileBaseStart;
+	fileAddr.grandFrames = odmlStart + offsetof(gmavi_odml_t, extendedHeader.grandFrames);
 
-	contents.junk = (RIFFCHUNK){
+	odml.junk = (RIFFCHUNK){
 		FCC('JUNK'),						/*	fcc					*/
-		STATIC_JUNKFILL_SIZE				/*	cb					*/
+		(uint32_t)(moviList - odmlStart - sizeof(gmavi_odml_t))	/*	cb		*/
 	};
 
-	contents.movi = (RIFFLIST){
+	RIFFLIST	movi = {
 		FCC('LIST'),						/*	fcc					*/
 		TO_BE_DETERMINED,					/*	cb					*/
 		FCC('movi')							/*	fccListType			*/
 	};
 
-	fileAddr.cbMovi = (uint64_t)&contents.movi.cb - fileAddr._fileBaseStart;
+	fileAddr.cbMovi = moviList + offsetof(RIFFLIST, cb);
 	fileAddr.moviStart = fileAddr.cbMovi + 8;
 
-	out->riffSize = sizeof(gmavi_static_t) - 8;
+	out->riffSize = out->headerSize - 8;
 	out->contents = contents;
 	out->fileAddr = fileAddr;
-	out->fileHandler = fopen(filePath, "wb+");
-	if (out->fileHandler == NULL)
+	out->moviLead = gmav_movi_lead(out, fileAddr.moviStart);
+	/*	From here on the first payload of the segment, which index offsets are relative to	*/
+	out->fileAddr.moviStart += sizeof(RIFFCHUNK) + out->moviLead;
+	out->io = gmav_io_default();
+#ifdef __linux__
+	if (config->ioEngine == GMAV_ENGINE_URING)
+		out->io = &gmav_io_uring;
+#endif
+	out->ioHandle = out->io->open(filePath, (out->flags & GMAV_FLAG_DIRECT) ? GMAV_IO_DIRECT : 0,
+		config->ioDepth);
+	if (out->ioHandle == NULL)
+	{
+		gmav_error(out, errno, NULL);
+		return (NULL);
+	}
+
+	/*	Kept for the rest of the recording, header updates are patched into it	*/
+	uint8_t	*header = (uint8_t *)calloc(1, out->headerSize);
+	bool	written = header != NULL;
+
+	out->headerImage = header;
+	if (written)
+	{
+		memcpy(header, &contents, sizeof(gmavi_static_t));
+		if (out->blockAlign)
+			memcpy(header + audioStart, &out->audio, sizeof(gmavi_audio_t));
+		memcpy(header + odmlStart, &odml, sizeof(gmavi_odml_t));
+		memcpy(header + moviList, &movi, sizeof(RIFFLIST));
+		written = gmav_write(out, 0, header, out->headerSize);
+	}
+	if (!written)
 	{
 		gmav_error(out, errno, NULL);
 		return (NULL);
 	}
+	out->writeOffset = out->headerSize;
+	if (config->expectedFrames && out->io->allocate != NULL)
+	{
+		/*	Every frame also costs its index entries, and the audio recorded alongside	*/
+		uint64_t	frameBytes = out->streamTickSize + sizeof(AVIOLDINDEX_ENTRY) + sizeof(AVISTDINDEX_ENTRY);
 
-	fwrite(&out->contents, sizeof(gmavi_static_t), 1, out->fileHandler);
+		if (out->crc != NULL)
+			frameBytes += sizeof(uint32_t);
+		if (out->blockAlign)
+			frameBytes += (uint64_t)out->blockAlign * config->audioSampleRate * scale / framesPerSec
+				+ sizeof(RIFFCHUNK) + sizeof(AVIOLDINDEX_ENTRY) + sizeof(AVISTDINDEX_ENTRY);
+		out->allocated = out->writeOffset;
+		gmav_reserve(out, frameBytes * config->expectedFrames);
+	}
 
 	out->mainIndex.fcc = FCC('idx1');
 	out->mainIndex.cb = 0;
 
+	out->telemetry = config->statsCallback;
+	out->telemetryContext = config->statsContext;
+	out->telemetryInterval = config->statsInterval;
+	out->queuePolicy = config->queuePolicy;
+	if (config->proxyPath != NULL
+		&& !gmav_setup_proxy(out, config, width, height, framesPerSec, scale))
+	{
+		gmav_error(out, errno, errno == EINVAL ? "Unsupported proxy configuration" : NULL);
+		return (NULL);
+	}
+	if (config->queueDepth
+		&& !gmav_queue_start(&out->queue, config->queueDepth, out->bitmapSize, config->writerCpu,
+			out->convert.identity ? &out->frames : NULL, gmav_consume_frame, out))
+	{
+		gmav_error(out, errno, NULL);
+		return (NULL);
+	}
+
 	return (out);
 }
 
-static bool		gmav_finish_main(
-	gmavi_t	*avi, bool finalWrite)
+/*
+*	Index entry of frame @i in the current segment: payload offset relative to the
+*	segment's first payload, and size. Uncompressed frames follow the fixed stride,
+*	coded and repeated frames were recorded as they were written
+*/
+static AVISTDINDEX_ENTRY	gmav_index_entry(gmavi_t *avi, uint32_t i)
 {
-	avi->moviSize = (avi->frameCount * avi->streamTickSize) + 4;
-	
-	avi->mainIndex.cb = STATIC_OLD_INDEX_OFFSET * avi->frameCount;
-	avi->riffSize += avi->moviSize + avi->mainIndex.cb + 4;
-	avi->mainIndexEntries = (AVIOLDINDEX_ENTRY *)calloc(1, avi->mainIndex.cb);
-	if (avi->mainIndexEntries == NULL)
-		return (gmav_error(avi, errno, NULL));
-	for (uint32_t i = 0; i < avi->frameCount; i++) {
-		avi->mainIndexEntries[i] = (AVIOLDINDEX_ENTRY){
-			FCC('00db'),					/*	chunkId				*/
-			AVIF_HASINDEX,					/*	flags				*/
-			4 + avi->streamTickSize * i,	/*	offset				*/
-			avi->bitmapSize					/*	size				*/
-		};
-	}
+	if (avi->recordIndex)
+		return (avi->ix00.avixIndexEntries[i]);
+	return ((AVISTDINDEX_ENTRY){avi->streamTickSize * i, avi->bitmapSize});
+}
 
-	_fseeki64(avi->fileHandler, 0, SEEK_END);
-	fwrite(&avi->mainIndex, sizeof(AVIOLDINDEX), 1, avi->fileHandler);
-	fwrite(avi->mainIndexEntries, sizeof(AVIOLDINDEX_ENTRY), avi->frameCount, avi->fileHandler);
-	free(avi->mainIndexEntries);
-	
-	_fseeki64(avi->fileHandler, avi->fileAddr.cbMain, SEEK_SET);
-	fwrite(&avi->riffSize, sizeof(uint32_t), 1, avi->fileHandler);
-	avi->fileSize = avi->riffSize;
-	
-	_fseeki64(avi->fileHandler, avi->fileAddr.firstFrames, SEEK_SET);
-	fwrite(&avi->frameCount, sizeof(uint32_t), 1, avi->fileHandler);
-	
-	_fseeki64(avi->fileHandler, avi->fileAddr.grandFrames, SEEK_SET);
-	fwrite(&avi->frameCount, sizeof(uint32_t), 1, avi->fileHandler);
-	
-	_fseeki64(avi->fileHandler, avi->fileAddr.cbMovi, SEEK_SET);
-	fwrite(&avi->moviSize, sizeof(uint32_t), 1, avi->fileHandler);
-	avi->fileAddr.moviStart = 0x2014;
+/*
+*	Store entry @i of a recorded index
+*/
+static bool	gmav_store_entry(t_idxList *list, uint32_t i, AVISTDINDEX_ENTRY entry)
+{
+	if (i >= list->capacity)
+	{
+		uint32_t			capacity = list->capacity ? list->capacity * 2 : 1024;
+		AVISTDINDEX_ENTRY	*entries = (AVISTDINDEX_ENTRY *)realloc(list->avixIndexEntries,
+			sizeof(AVISTDINDEX_ENTRY) * capacity);
 
-	if (finalWrite && fclose(avi->fileHandler))
-		return (gmav_error(avi, errno, NULL));
+		if (entries == NULL)
+			return (false);
+		list->avixIndexEntries = entries;
+		list->capacity = capacity;
+	}
+	list->avixIndexEntries[i] = entry;
 	return (true);
 }
 
-static bool gmav_create_index(gmavi_t *avi, size_t size)
+/*
+*	Index entry of the frame just started
+*/
+static bool	gmav_record_entry(gmavi_t *avi, AVISTDINDEX_ENTRY entry)
 {
-	avi->ix00[avi->riffChunks].avixIndex = (AVISTDINDEX){
-		FCC('ix00'),						/*	fcc					*/
-		24 + size * 8,						/*	cb					*/
-		2,									/*	wLongsPerEntry		*/
-		0,									/*	bIndexSubType		*/
-		AVI_INDEX_OF_CHUNKS,				/*	bIndexType			*/
-		size,								/*	nEntriesInUse		*/
-		FCC('00db'),						/*	dwChunkId			*/
-		avi->fileAddr.moviStart,			/*	qwBaseOffset		*/
-		0									/*	dwReserved_3		*/
+	return (gmav_store_entry(&avi->ix00, avi->segmentFrames - 1, entry));
+}
+
+/*
+*	Remember where the frame just started went
+*/
+static bool	gmav_record_frame(gmavi_t *avi, uint64_t payload, uint32_t size)
+{
+	return (gmav_record_entry(avi, (AVISTDINDEX_ENTRY){(uint32_t)(payload - avi->fileAddr.moviStart), size}));
+}
+
+/*
+*	Checksum of the frame just started
+*/
+static bool	gmav_store_checksum(gmavi_t *avi, uint32_t checksum)
+{
+	uint32_t	i = avi->segmentFrames - 1;
+
+	if (i >= avi->checksumCapacity)
+	{
+		uint32_t	capacity = avi->checksumCapacity ? avi->checksumCapacity * 2 : 1024;
+		uint32_t	*checksums = (uint32_t *)realloc(avi->checksums, sizeof(uint32_t) * capacity);
+
+		if (checksums == NULL)
+			return (false);
+		avi->checksums = checksums;
+		avi->checksumCapacity = capacity;
+	}
+	avi->checksums[i] = checksum;
+	return (true);
+}
+
+/*
+*	CRC32C of the payload of the frame just started, taken once its write was
+*	issued so it runs while an asynchronous engine is still writing it
+*/
+static bool	gmav_record_checksum(gmavi_t *avi, const uint8_t *payload, uint32_t size)
+{
+	return (avi->crc == NULL || gmav_store_checksum(avi, avi->crc(0, payload, size)));
+}
+
+/*
+*	RIFF and movi sizes of the current AVIX segment, which ends at @writeOffset.
+*	Both sit in the segment's own RIFF and LIST headers, written as one
+*/
+static bool	gmav_close_segment(gmavi_t *avi)
+{
+	uint32_t	riffSize = (uint32_t)(avi->writeOffset - avi->fileAddr.cbMain - 4);
+	uint32_t	sizes[4] = {riffSize, FCC('AVIX'), FCC('LIST'), riffSize - 12};
+
+	return (gmav_write(avi, avi->fileAddr.cbMain, sizes, sizeof(sizes)));
+}
+
+/*
+*	Writes one index entry of frame @i in the current segment to @dst
+*/
+typedef void	(*gmavi_entry_t)(gmavi_t *avi, uint32_t i, uint8_t *dst);
+
+/*
+*	idx1 lists both streams in file order, @oldCursor counts the audio chunks
+*	passed so far. Entries are generated in order, starting at 0
+*/
+static void	gmav_old_entry(gmavi_t *avi, uint32_t i, uint8_t *dst)
+{
+	uint32_t			chunkId = avi->chunkId;
+	uint32_t			frame;
+	AVISTDINDEX_ENTRY	entry;
+
+	if (i == 0)
+		avi->oldCursor = 0;
+	frame = i - avi->oldCursor;
+	if (avi->oldCursor < avi->segmentAudio && (frame == avi->segmentFrames
+		|| avi->ix01.avixIndexEntries[avi->oldCursor].dwOffset < gmav_index_entry(avi, frame).dwOffset))
+	{
+		entry = avi->ix01.avixIndexEntries[avi->oldCursor++];
+		chunkId = FCC('01wb');
+	}
+	else
+		entry = gmav_index_entry(avi, frame);
+
+	AVIOLDINDEX_ENTRY	old = {
+		chunkId,							/*	chunkId				*/
+		AVIF_HASINDEX,						/*	flags				*/
+		4 + avi->moviLead + entry.dwOffset,	/*	offset				*/
+		entry.dwSize						/*	size				*/
 	};
 
-	avi->ix00[avi->riffChunks].avixIndexEntries = (AVISTDINDEX_ENTRY *)calloc(1, sizeof(AVISTDINDEX_ENTRY) * size);
-	if (avi->ix00[avi->riffChunks].avixIndexEntries == NULL)
-		return (gmav_error(avi, errno, NULL));
+	memcpy(dst, &old, sizeof(AVIOLDINDEX_ENTRY));
+}
+
+static void	gmav_std_entry(gmavi_t *avi, uint32_t i, uint8_t *dst)
+{
+	AVISTDINDEX_ENTRY	entry = gmav_index_entry(avi, i);
+
+	memcpy(dst, &entry, sizeof(AVISTDINDEX_ENTRY));
+}
+
+static void	gmav_audio_entry(gmavi_t *avi, uint32_t i, uint8_t *dst)
+{
+	memcpy(dst, &avi->ix01.avixIndexEntries[i], sizeof(AVISTDINDEX_ENTRY));
+}
+
+static void	gmav_checksum_entry(gmavi_t *avi, uint32_t i, uint8_t *dst)
+{
+	memcpy(dst, &avi->checksums[i], sizeof(uint32_t));
+}
+
+/*
+*	Samples written so far, in the audio stream header
+*/
+static bool	gmav_write_audio_length(gmavi_t *avi)
+{
+	if (avi->blockAlign == 0)
+		return (true);
+	return (gmav_patch(avi, avi->fileAddr.audioLength, &avi->audioSamples, sizeof(uint32_t)));
+}
+
+/*
+*	Where the file ends once the staged index chunks are written
+*/
+static uint64_t	gmav_index_end(gmavi_t *avi)
+{
+	return (avi->writeOffset + avi->indexUsed);
+}
+
+/*
+*	Stage an index chunk: @header followed by @count entries of the current segment.
+*	All index chunks closing a segment are generated into @indexStage one after
+*	the other and go out as one write with gmav_flush_index. The stage grows with
+*	the index of a segment, not with the length of the recording
+*/
+static bool	gmav_stage_index(gmavi_t *avi, const void *header, size_t headerSize,
+	uint32_t count, size_t entrySize, gmavi_entry_t entry)
+{
+	size_t	needed = avi->indexUsed + headerSize + entrySize * count;
+
+	if (needed > avi->indexCapacity)
+	{
+		size_t	capacity = avi->indexCapacity ? avi->indexCapacity : GMAV_INDEX_STAGE;
+
+		while (capacity < needed)
+			capacity *= 2;
+
+		uint8_t	*stage = (uint8_t *)realloc(avi->indexStage, capacity);
+
+		if (stage == NULL)
+			return (false);
+		avi->indexStage = stage;
+		avi->indexCapacity = capacity;
+	}
+
+	uint8_t	*dst = avi->indexStage + avi->indexUsed;
+
+	memcpy(dst, header, headerSize);
+	dst += headerSize;
+	for (uint32_t i = 0; i < count; i++) {
+		entry(avi, i, dst);
+		dst += entrySize;
+	}
+	avi->indexUsed = needed;
+	return (true);
+}
+
+/*
+*	Stage the checksums of the current segment after its index chunks, the
+*	last chunk of its movi list
+*/
+static bool	gmav_stage_checksums(gmavi_t *avi)
+{
+	uint32_t			frames = avi->segmentFrames;
+	gmavi_checksums_t	header = {
+		FCC('JUNK'),						/*	fcc					*/
+		8 + frames * 4 + 4,					/*	cb					*/
+		GMAV_CHECKSUM_SIGNATURE,			/*	signature			*/
+		frames								/*	frames				*/
+	};
+
+	if (avi->crc == NULL)
+		return (true);
+	return (gmav_stage_index(avi, &header, sizeof(gmavi_checksums_t), frames,
+			sizeof(uint32_t), gmav_checksum_entry)
+		&& gmav_stage_index(avi, &header.cb, sizeof(uint32_t), 0, 0, NULL));
+}
+
+/*
+*	Append everything staged by gmav_stage_index
+*/
+static bool	gmav_flush_index(gmavi_t *avi)
+{
+	gmavi_iovec_t	iov = {avi->indexStage, avi->indexUsed};
+
+	avi->indexUsed = 0;
+	return (iov.size == 0 || gmav_append(avi, &iov, 1));
+}
+
+static bool		gmav_finish_main(
+	gmavi_t	*avi, bool finalWrite)
+{
+	/*	A single segment has no ix00 the checksums could follow	*/
+	if (finalWrite && !gmav_stage_checksums(avi))
+		return (false);
+	/*	'movi' list data runs from its fourcc up to here	*/
+	avi->moviSize = (uint32_t)(gmav_index_end(avi) - avi->fileAddr.cbMovi - 4);
 	
-	for (uint32_t i = 0; i < size; i++) {
-		avi->ix00[avi->riffChunks].avixIndexEntries[i].dwOffset = avi->streamTickSize * i;
-		avi->ix00[avi->riffChunks].avixIndexEntries[i].dwSize = avi->bitmapSize;
+	uint32_t	entries = avi->frameCount + avi->segmentAudio;
+
+	avi->mainIndex.cb = STATIC_OLD_INDEX_OFFSET * entries;
+	if (!gmav_stage_index(avi, &avi->mainIndex, sizeof(AVIOLDINDEX), entries,
+		sizeof(AVIOLDINDEX_ENTRY), gmav_old_entry))
+		return (false);
+	
+	avi->riffSize = (uint32_t)(gmav_index_end(avi) - 8);
+	if (!gmav_flush_index(avi)
+		|| !gmav_patch(avi, avi->fileAddr.cbMain, &avi->riffSize, sizeof(uint32_t))
+		|| !gmav_patch(avi, avi->fileAddr.firstFrames, &avi->frameCount, sizeof(uint32_t))
+		|| !gmav_patch(avi, avi->fileAddr.totalFrames, &avi->frameCount, sizeof(uint32_t))
+		|| !gmav_patch(avi, avi->fileAddr.grandFrames, &avi->frameCount, sizeof(uint32_t))
+		|| !gmav_patch(avi, avi->fileAddr.cbMovi, &avi->moviSize, sizeof(uint32_t))
+		|| !gmav_write_audio_length(avi))
+		return (false);
+
+	if (finalWrite)
+		return (gmav_flush_header(avi) && gmav_close_file(avi));
+	return (true);
+}
+
+/*
+*	Header of the current segment's ix00 (or ix01), the entries are only generated at finish
+*/
+static void	gmav_create_index(gmavi_t *avi, t_idxList *list, FOURCC fcc, uint32_t chunkId, size_t size)
+{
+	list->avixIndex = (AVISTDINDEX){
+		fcc,								/*	fcc					*/
+		24 + size * 8,						/*	cb					*/
+		2,									/*	wLongsPerEntry		*/
+		0,									/*	bIndexSubType		*/
+		AVI_INDEX_OF_CHUNKS,				/*	bIndexType			*/
+		size,								/*	nEntriesInUse		*/
+		chunkId,							/*	dwChunkId			*/
+		avi->fileAddr.moviStart,			/*	qwBaseOffset		*/
+		0									/*	dwReserved_3		*/
+	};
+}
+
+/*
+*	Append the ix00 of the current segment at its end, inside its movi list, and
+*	fill in the super index entry pointing at it. The entry goes straight to the
+*	header, only the room reserved there grows with the number of segments.
+*	The ix01 of the audio stream follows the same way, then the checksums
+*/
+static bool	gmav_write_segment_index(gmavi_t *avi)
+{
+	uint32_t			frames = avi->segmentFrames;
+	AVISUPERINDEX_ENTRY	entry = {
+		gmav_index_end(avi),					/*	offset				*/
+		sizeof(AVISTDINDEX) + frames * sizeof(AVISTDINDEX_ENTRY),	/*	size		*/
+		frames									/*	duration			*/
+	};
+
+	gmav_create_index(avi, &avi->ix00, FCC('ix00'), avi->chunkId, frames);
+	if (!gmav_patch(avi, avi->fileAddr.superIndexEntries + sizeof(AVISUPERINDEX_ENTRY) * avi->riffChunks,
+			&entry, sizeof(AVISUPERINDEX_ENTRY))
+		|| !gmav_stage_index(avi, &avi->ix00.avixIndex, sizeof(AVISTDINDEX), frames,
+			sizeof(AVISTDINDEX_ENTRY), gmav_std_entry))
+		return (false);
+	if (avi->blockAlign == 0)
+		return (gmav_stage_checksums(avi));
+
+	uint32_t			chunks = avi->segmentAudio;
+	AVISUPERINDEX_ENTRY	audio = {
+		gmav_index_end(avi),					/*	offset				*/
+		sizeof(AVISTDINDEX) + chunks * sizeof(AVISTDINDEX_ENTRY),	/*	size		*/
+		avi->segmentSamples						/*	duration			*/
+	};
+
+	gmav_create_index(avi, &avi->ix01, FCC('ix01'), FCC('01wb'), chunks);
+	return (gmav_patch(avi, avi->fileAddr.audioSuperIndexEntries + sizeof(AVISUPERINDEX_ENTRY) * avi->riffChunks,
+			&audio, sizeof(AVISUPERINDEX_ENTRY))
+		&& gmav_stage_index(avi, &avi->ix01.avixIndex, sizeof(AVISTDINDEX), chunks,
+			sizeof(AVISTDINDEX_ENTRY), gmav_audio_entry)
+		&& gmav_stage_checksums(avi));
+}
+
+/*
+*	Super index header, making the first @segments entries valid
+*/
+static bool	gmav_write_super_index(gmavi_t *avi, uint32_t segments)
+{
+	AVISUPERINDEX	*superIndex = &avi->contents.superIndex;
+
+	superIndex->fcc = FCC('indx');
+	superIndex->cb = STATIC_SUPER_INDEX_SIZE(avi->maxSegments);
+	superIndex->longsPerEntry = 4;
+	superIndex->indexSubType = 0;
+	superIndex->indexType = AVI_INDEX_OF_INDEXES;
+	superIndex->entriesInUse = segments;
+	superIndex->chunkId = avi->chunkId;
+	if (!gmav_patch(avi, avi->fileAddr.superIndex, superIndex, sizeof(AVISUPERINDEX)))
+		return (false);
+	if (avi->blockAlign == 0)
+		return (true);
+	avi->audio.superIndex = *superIndex;
+	avi->audio.superIndex.chunkId = FCC('01wb');
+	return (gmav_patch(avi, avi->fileAddr.audioSuperIndex, &avi->audio.superIndex, sizeof(AVISUPERINDEX)));
+}
+
+/*
+*	Leave the file readable up to the last frame written: sizes of the current
+*	segment, frame counts and the super index of all completed segments. Frames
+*	of the current segment are not indexed yet, readers find them by walking movi
+*/
+static bool	gmav_checkpoint(gmavi_t *avi)
+{
+	if (avi->riffChunks == 0)
+	{
+		uint32_t	riffSize = (uint32_t)(avi->writeOffset - 8);
+		uint32_t	moviSize = (uint32_t)(avi->writeOffset - avi->fileAddr.cbMovi - 4);
+
+		if (!gmav_patch(avi, avi->fileAddr.cbMain, &riffSize, sizeof(uint32_t))
+			|| !gmav_patch(avi, avi->fileAddr.cbMovi, &moviSize, sizeof(uint32_t))
+			|| !gmav_patch(avi, avi->fileAddr.firstFrames, &avi->frameCount, sizeof(uint32_t)))
+			return (false);
 	}
+	else if (!gmav_close_segment(avi) || !gmav_write_super_index(avi, avi->riffChunks))
+		return (false);
+	return (gmav_patch(avi, avi->fileAddr.totalFrames, &avi->frameCount, sizeof(uint32_t))
+		&& gmav_patch(avi, avi->fileAddr.grandFrames, &avi->frameCount, sizeof(uint32_t))
+		&& gmav_write_audio_length(avi)
+		&& gmav_flush_header(avi));
+}
+
+/*
+*	Periodic checkpoint after a frame went out
+*/
+static bool	gmav_end_frame(gmavi_t *avi)
+{
+	if (avi->checkpointFrames && avi->frameCount % avi->checkpointFrames == 0)
+		return (gmav_checkpoint(avi));
 	return (true);
 }
 
+/*
+*	Close the current segment with its ix00 (and idx1 for the first) and start
+*	the next. Every rollover leaves a checkpoint
+*/
 static bool	gmav_add_avix_chunk(gmavi_t *avi)
 {
+	/*	The super index has no room left for another segment	*/
+	if (avi->riffChunks + 1 >= avi->maxSegments)
+	{
+		errno = EFBIG;
+		return (false);
+	}
+	if (!gmav_write_segment_index(avi))
+		return (false);
 	if (avi->riffChunks == 0)
 	{
-		gmav_finish_main(avi, false);
-		avi->fileSize += 8;
+		if (!gmav_finish_main(avi, false))
+			return (false);
 	}
-	else
+	else if (!gmav_flush_index(avi) || !gmav_close_segment(avi))
+		return (false);
+
+	gmav_atomic_add(&avi->stats.segments, 1);
+	/*	Recorded entries are only needed until the segment is indexed	*/
+	free(avi->ix00.avixIndexEntries);
+	avi->ix00.avixIndexEntries = NULL;
+	avi->ix00.capacity = 0;
+	free(avi->ix01.avixIndexEntries);
+	avi->ix01.avixIndexEntries = NULL;
+	avi->ix01.capacity = 0;
+
+	RIFFLIST	lists[2] = {
+		{
+			FCC('RIFF'),					/*	fcc					*/
+			TO_BE_DETERMINED,				/*	cb					*/
+			FCC('AVIX')						/*	fccListType			*/
+		},
+		{
+			FCC('LIST'),					/*	fcc					*/
+			TO_BE_DETERMINED,				/*	cb					*/
+			FCC('movi')						/*	fccListType			*/
+		}
+	};
+	gmavi_iovec_t	iov = {lists, sizeof(lists)};
+
+	avi->fileAddr.cbMain = avi->writeOffset + 4;
+
+	if (!gmav_append(avi, &iov, 1))
+		return (false);
+	avi->moviSize = 0;
+
+	avi->moviLead = gmav_movi_lead(avi, avi->writeOffset);
+	avi->fileAddr.moviStart = avi->writeOffset + 8 + avi->moviLead;
+	avi->riffChunks += 1;
+	avi->segmentFrames = 0;
+	avi->segmentAudio = 0;
+	avi->segmentSamples = 0;
+	return (gmav_checkpoint(avi));
+}
+
+/*
+*	JUNK chunk and the first '00db' header, leading up to the first sector
+*	aligned payload of a segment
+*/
+static bool	gmav_write_lead(gmavi_t *avi)
+{
+	uint8_t		*lead = (uint8_t *)calloc(1, avi->moviLead + 8);
+	RIFFCHUNK	junk = {FCC('JUNK'), avi->moviLead - 8};
+	RIFFCHUNK	chunk = {avi->chunkId, avi->bitmapSize};
+	bool		written;
+
+	if (lead == NULL)
+		return (false);
+	memcpy(lead, &junk, sizeof(RIFFCHUNK));
+	memcpy(lead + avi->moviLead, &chunk, sizeof(RIFFCHUNK));
+	written = gmav_write(avi, avi->writeOffset, lead, avi->moviLead + 8);
+	free(lead);
+	if (!written)
+		return (false);
+	avi->writeOffset += avi->moviLead;
+	return (true);
+}
+
+/*
+*	Everything in an aligned stride after the bitmap: pad byte, JUNK header and,
+*	with @next, the next frame's header. The JUNK fill in between is left untouched (zero)
+*/
+static void	gmav_fill_trailer(gmavi_t *avi, uint8_t *trailer, bool next)
+{
+	uint32_t	payload = (avi->bitmapSize + 1) & ~1u;
+	RIFFCHUNK	junk = {FCC('JUNK'), avi->streamTickSize - payload - 16};
+	RIFFCHUNK	header = {avi->chunkId, avi->bitmapSize};
+
+	if (payload != avi->bitmapSize)
+		trailer[0] = 0;
+	memcpy(trailer + payload - avi->bitmapSize, &junk, sizeof(RIFFCHUNK));
+	if (next)
+		memcpy(trailer + avi->streamTickSize - avi->bitmapSize - 8, &header, sizeof(RIFFCHUNK));
+}
+
+/*
+*	Write one sector aligned stride, starting at the payload. @writeOffset stays
+*	on the '00db' header of the next frame, anything appended after the last
+*	frame simply overwrites it.
+*
+*	The bitmap goes out straight from the caller's buffer when it is sector
+*	aligned, only the unaligned tail (and padding) is staged in @alignBuffer
+*/
+static bool	gmav_add_aligned(gmavi_t *avi, const uint8_t *buffer)
+{
+	uint32_t	head = 0;
+
+	if ((uintptr_t)buffer % GMAV_IO_SECTOR == 0)
+		head = avi->bitmapSize & ~(GMAV_IO_SECTOR - 1);
+
+	uint8_t		*tail = avi->alignBuffer;
+	uint32_t	tailSize = avi->streamTickSize - head;
+
+	memcpy(tail, buffer + head, avi->bitmapSize - head);
+	gmav_fill_trailer(avi, tail + avi->bitmapSize - head, true);
+
+	gmavi_iovec_t	iov[2] = {
+		{buffer, head},
+		{tail, tailSize}
+	};
+
+	if (!gmav_write_frame_data(avi, iov, 2, avi->writeOffset + 8))
+		return (false);
+	avi->writeOffset += avi->streamTickSize;
+	return (true);
+}
+
+/*
+*	Whether a frame adding @chunkBytes to the file still fits in the current
+*	segment, along with the index the segment still needs (its ix00 and ix01,
+*	idx1 for the first, and the checksums)
+*/
+static bool	gmav_segment_full(gmavi_t *avi, uint32_t chunkBytes)
+{
+	if (avi->segmentFrames == 0)
+		return (false);
+	if (!avi->recordIndex)
+		return (avi->segmentFrames == avi->maxFrames);
+
+	uint64_t	start = avi->riffChunks ? avi->fileAddr.cbMain - 4 : 0;
+	uint32_t	audio = avi->blockAlign ? avi->segmentAudio + 1 : 0;
+	uint64_t	index = sizeof(AVISTDINDEX) + sizeof(AVISTDINDEX_ENTRY) * (avi->segmentFrames + 1);
+
+	if (avi->blockAlign)
+		index += sizeof(AVISTDINDEX) + sizeof(AVISTDINDEX_ENTRY) * audio;
+	if (avi->riffChunks == 0)
+		index += sizeof(AVIOLDINDEX) + sizeof(AVIOLDINDEX_ENTRY) * (avi->segmentFrames + 1 + audio);
+	if (avi->crc != NULL)
+		index += sizeof(gmavi_checksums_t) + sizeof(uint32_t) * (avi->segmentFrames + 2);
+
+	return (avi->writeOffset + chunkBytes + index - start > avi->segmentSize);
+}
+
+/*
+*	Segment bookkeeping shared by every way of adding a frame: AVIX rollover and,
+*	when aligned, the lead of a new segment. The audio taken for the frame has to
+*	fit in the same segment
+*/
+static bool	gmav_begin_frame(gmavi_t *avi, uint32_t chunkBytes)
+{
+	if (gmav_segment_full(avi, avi->audioBytes + chunkBytes) && !gmav_add_avix_chunk(avi))
+		return (false);
+	if ((avi->flags & GMAV_FLAG_ALIGNED) && avi->segmentFrames == 0 && !gmav_write_lead(avi))
+		return (false);
+
+	uint64_t	end = avi->writeOffset + avi->audioBytes + chunkBytes;
+
+	/*	Past the estimate, reserve half again what the file has grown to so far	*/
+	if (avi->allocated && end > avi->allocated)
 	{
-		uint32_t	moviSize = 4 + (avi->streamTickSize * avi->maxFrames);
-		uint32_t	riffSize = moviSize + 12;
+		uint64_t	step = avi->allocated / 2;
 
-		avi->fileSize += (avi->streamTickSize * avi->maxFrames);
-		_fseeki64(avi->fileHandler, avi->fileAddr.cbMain, SEEK_SET);
-		fwrite(&riffSize, sizeof(uint32_t), 1, avi->fileHandler);
-		_fseeki64(avi->fileHandler, 8, SEEK_CUR);
-		fwrite(&moviSize, sizeof(uint32_t), 1, avi->fileHandler);
+		if (step < GMAV_ALLOCATE_STEP)
+			step = GMAV_ALLOCATE_STEP;
+		gmav_reserve(avi, end - avi->allocated + step);
 	}
+	avi->frameCount += 1;
+	avi->segmentFrames += 1;
+	return (true);
+}
 
-	RIFFLIST	avix = {
-		FCC('RIFF'),						/*	fcc					*/
-		TO_BE_DETERMINED,					/*	cb					*/
-		FCC('AVIX')							/*	fccListType			*/
+/*
+*	Offset of the next frame's payload, without starting the frame
+*/
+static uint64_t	gmav_next_payload(gmavi_t *avi)
+{
+	uint64_t	offset = avi->writeOffset;
+	bool		rollover = gmav_segment_full(avi, avi->streamTickSize);
+
+	/*	Leaving a segment appends its ix00, and idx1 for the first one	*/
+	if (rollover && avi->riffChunks == 0)
+		offset += sizeof(AVIOLDINDEX) + sizeof(AVIOLDINDEX_ENTRY) * avi->segmentFrames;
+	if (rollover)
+		offset += sizeof(AVISTDINDEX) + sizeof(AVISTDINDEX_ENTRY) * avi->segmentFrames + 2 * sizeof(RIFFLIST);
+	if (rollover && avi->crc != NULL)
+		offset += sizeof(gmavi_checksums_t) + sizeof(uint32_t) * (avi->segmentFrames + 1);
+	if ((avi->flags & GMAV_FLAG_ALIGNED) && (rollover || avi->frameCount == 0))
+		offset += avi->frameCount ? gmav_movi_lead(avi, offset) : avi->moviLead;
+	return (offset + sizeof(RIFFCHUNK));
+}
+
+/*
+*	Take the audio added since the last frame, it goes out as a single chunk in
+*	front of the next one. The buffers are swapped, so gmav_add_audio only ever
+*	waits for the swap and never for a write
+*/
+static void	gmav_take_audio(gmavi_t *avi)
+{
+	uint8_t		*chunk = avi->audioChunk;
+	uint32_t	capacity = avi->audioChunkCapacity;
+
+	if (avi->blockAlign == 0)
+		return;
+	gmav_mutex_lock(&avi->audioLock);
+	avi->audioChunk = avi->audioPending;
+	avi->audioChunkSize = avi->audioPendingSize;
+	avi->audioChunkCapacity = avi->audioPendingCapacity;
+	avi->audioPending = chunk;
+	avi->audioPendingSize = 0;
+	avi->audioPendingCapacity = capacity;
+	gmav_mutex_unlock(&avi->audioLock);
+	avi->audioBytes = avi->audioChunkSize ? sizeof(RIFFCHUNK) + ((avi->audioChunkSize + 1) & ~1u) : 0;
+}
+
+/*
+*	Gathered write of a frame's chunks at the end of the file, preceded by the
+*	'01wb' chunk of the audio taken for it
+*/
+static bool	gmav_write_chunks(gmavi_t *avi, const gmavi_iovec_t *iov, uint32_t count)
+{
+	static const uint8_t	pad = 0;
+	RIFFCHUNK		header = {FCC('01wb'), avi->audioChunkSize};
+	gmavi_iovec_t	chunks[6];
+	uint32_t		used = 0;
+	uint64_t		size = 0;
+
+	if (avi->audioBytes)
+	{
+		uint32_t	samples = avi->audioChunkSize / avi->blockAlign;
+
+		if (!gmav_store_entry(&avi->ix01, avi->segmentAudio, (AVISTDINDEX_ENTRY){
+			(uint32_t)(avi->writeOffset + sizeof(RIFFCHUNK) - avi->fileAddr.moviStart), avi->audioChunkSize}))
+			return (false);
+		avi->segmentAudio += 1;
+		avi->segmentSamples += samples;
+		avi->audioSamples += samples;
+		chunks[used++] = (gmavi_iovec_t){&header, sizeof(RIFFCHUNK)};
+		chunks[used++] = (gmavi_iovec_t){avi->audioChunk, avi->audioChunkSize};
+		if (avi->audioChunkSize & 1)
+			chunks[used++] = (gmavi_iovec_t){&pad, 1};
+	}
+	for (uint32_t i = 0; i < count; i++)
+		chunks[used++] = iov[i];
+	for (uint32_t i = 0; i < used; i++)
+		size += chunks[i].size;
+	avi->audioBytes = 0;
+	if (used && !gmav_write_frame_data(avi, chunks, used, avi->writeOffset))
+		return (false);
+	avi->writeOffset += size;
+	return (true);
+}
+
+/*
+*	Audio added after the last frame, written on its own
+*/
+static bool	gmav_flush_audio(gmavi_t *avi)
+{
+	gmav_take_audio(avi);
+	if (avi->audioBytes == 0)
+		return (true);
+	if (gmav_segment_full(avi, avi->audioBytes) && !gmav_add_avix_chunk(avi))
+		return (false);
+	return (gmav_write_chunks(avi, NULL, 0));
+}
+
+/*
+*	Compress a frame and write it as one '00dc' chunk, the encoded size decides
+*	whether it still fits in the current segment
+*/
+static bool	gmav_write_coded(gmavi_t *avi, const uint8_t *buffer)
+{
+	uint8_t		*chunk = avi->encodeBuffer;
+	uint32_t	size = (uint32_t)gmav_codec_encode(avi->codec, chunk + sizeof(RIFFCHUNK), buffer);
+	uint32_t	padded = (size + 1) & ~1u;
+
+	RIFFCHUNK	header = {avi->chunkId, size};
+
+	if (!gmav_begin_frame(avi, sizeof(RIFFCHUNK) + padded))
+		return (false);
+	memcpy(chunk, &header, sizeof(RIFFCHUNK));
+	chunk[sizeof(RIFFCHUNK) + size] = 0;
+
+	gmavi_iovec_t	iov = {chunk, sizeof(RIFFCHUNK) + padded};
+
+	return (gmav_record_frame(avi, avi->writeOffset + avi->audioBytes + sizeof(RIFFCHUNK), size)
+		&& gmav_write_chunks(avi, &iov, 1)
+		&& gmav_record_checksum(avi, chunk + sizeof(RIFFCHUNK), size));
+}
+
+/*
+*	Compare @buffer with the last frame written and keep it for the next one.
+*	Everything before the first difference already matches, only the rest is copied
+*/
+static bool	gmav_same_frame(gmavi_t *avi, const uint8_t *buffer)
+{
+	size_t	diff = avi->lastValid ? avi->frameDiff(buffer, avi->lastFrame, avi->bitmapSize) : 0;
+
+	if (diff == avi->bitmapSize)
+		return (true);
+	memcpy(avi->lastFrame + diff, buffer + diff, avi->bitmapSize - diff);
+	avi->lastValid = true;
+	return (false);
+}
+
+/*
+*	Index-only frame, pointing at the chunk of the previous frame. A segment can
+*	only point into itself, so a new segment always starts with a full chunk
+*/
+static bool	gmav_write_repeat(gmavi_t *avi)
+{
+	AVISTDINDEX_ENTRY	previous = avi->ix00.avixIndexEntries[avi->segmentFrames - 1];
+
+	avi->frameCount += 1;
+	avi->segmentFrames += 1;
+	gmav_atomic_add(&avi->stats.framesRepeated, 1);
+	return (gmav_record_entry(avi, previous)
+		&& (avi->crc == NULL || gmav_store_checksum(avi, avi->checksums[avi->segmentFrames - 2])));
+}
+
+/*
+*	Store one frame the way the stream keeps it: repeat, coded or raw chunk
+*/
+static bool	gmav_store_frame(gmavi_t *avi, const uint8_t *buffer)
+{
+	gmav_take_audio(avi);
+	if (avi->lastFrame != NULL && gmav_same_frame(avi, buffer)
+		&& avi->segmentFrames && !gmav_segment_full(avi, avi->audioBytes))
+		return (gmav_write_chunks(avi, NULL, 0) && gmav_write_repeat(avi));
+	if (avi->codec != NULL)
+		return (gmav_write_coded(avi, buffer));
+	if (!gmav_begin_frame(avi, avi->streamTickSize))
+		return (false);
+	if (avi->recordIndex && !gmav_record_frame(avi,
+		avi->writeOffset + avi->audioBytes + sizeof(RIFFCHUNK), avi->bitmapSize))
+		return (false);
+
+	if (avi->flags & GMAV_FLAG_ALIGNED)
+		return (gmav_add_aligned(avi, buffer) && gmav_record_checksum(avi, buffer, avi->bitmapSize));
+
+	/*	Chunk header and bitmap go out as one gathered write	*/
+	RIFFCHUNK		chunk = {avi->chunkId, avi->bitmapSize};
+	gmavi_iovec_t	iov[2] = {
+		{&chunk, sizeof(RIFFCHUNK)},
+		{buffer, avi->bitmapSize}
 	};
-	RIFFLIST	movi = {
-		FCC('LIST'),						/*	fcc					*/
-		TO_BE_DETERMINED,					/*	cb					*/
-		FCC('movi')							/*	fccListType			*/
+
+	return (gmav_write_chunks(avi, iov, 2) && gmav_record_checksum(avi, buffer, avi->bitmapSize));
+}
+
+/*
+*	Counters of @avi, the queue is looked at as it is right now
+*/
+static void	gmav_read_stats(gmavi_t *avi, gmavi_stats_t *stats)
+{
+	uint64_t	*from = (uint64_t *)&avi->stats;
+
+	/*	All counters are 64 bit, the queue pair in between is filled in below	*/
+	for (size_t i = 0; i < sizeof(gmavi_stats_t) / sizeof(uint64_t); i++)
+		((uint64_t *)stats)[i] = gmav_atomic_load(from + i);
+	stats->queueUsed = 0;
+	stats->queueDepth = avi->queue.depth;
+	if (avi->queue.depth)
+		gmav_queue_counters(&avi->queue, &stats->queueUsed, &stats->framesDropped, &stats->queueStalls);
+	if (avi->proxy != NULL)
+	{
+		uint32_t	used;
+		uint64_t	stalls;
+
+		gmav_queue_counters(&avi->proxy->queue, &used, &stats->proxyDropped, &stalls);
+	}
+}
+
+/*
+*	Account a frame write that began at @started, and report to the telemetry
+*	callback when it is due. Only a few atomic additions when there is none
+*/
+static void	gmav_count_frame(gmavi_t *avi, uint64_t started)
+{
+	uint64_t	nanos = gmav_clock_ns() - started;
+	uint32_t	bucket = 0;
+
+	for (uint64_t micros = nanos / 1000; micros && bucket < GMAV_STATS_BUCKETS - 1; micros >>= 1)
+		bucket += 1;
+	gmav_atomic_add(&avi->stats.writeLatency[bucket], 1);
+	gmav_atomic_add(&avi->stats.writeNanos, nanos);
+	gmav_atomic_max(&avi->stats.writeMaxNanos, nanos);
+	gmav_atomic_add(&avi->stats.framesWritten, 1);
+	if (avi->telemetry != NULL
+		&& (avi->telemetryInterval <= 1 || avi->frameCount % avi->telemetryInterval == 0))
+	{
+		gmavi_stats_t	stats;
+
+		gmav_read_stats(avi, &stats);
+		avi->telemetry(avi->telemetryContext, &stats);
+	}
+}
+
+/*
+*	Copy a stream frame into a proxy slot, stamped with its main frame number
+*/
+static void	gmav_fill_proxy(void *ctx, uint8_t *slot, const uint8_t *buffer)
+{
+	gmavi_t	*proxy = (gmavi_t *)ctx;
+	size_t	size = proxy->queue.slotSize - sizeof(uint32_t);
+
+	memcpy(slot, buffer, size);
+	memcpy(slot + size, &proxy->proxyIndex, sizeof(uint32_t));
+}
+
+/*
+*	Proxy thread: repeat the previous proxy frame for every main frame that did
+*	not make it into the queue, so both files keep the same timing
+*/
+static bool	gmav_consume_proxy(void *ctx, const uint8_t *slot)
+{
+	gmavi_t		*proxy = (gmavi_t *)ctx;
+	uint32_t	index;
+
+	memcpy(&index, slot + proxy->queue.slotSize - sizeof(uint32_t), sizeof(uint32_t));
+	while (proxy->frameCount < index)
+		if (!gmav_write_frame(proxy, proxy->convertBuffer))
+			return (false);
+	gmav_downscale_frame(&proxy->downscale, proxy->convertBuffer, slot);
+	return (gmav_write_frame(proxy, proxy->convertBuffer));
+}
+
+/*
+*	Hand a stream frame, just written as frame frameCount - 1, to the proxy. It
+*	never waits for the proxy thread, a full queue drops the frame from the proxy.
+*	A failed proxy is only reported by gmav_finish
+*/
+static void	gmav_feed_proxy(gmavi_t *avi, const uint8_t *buffer)
+{
+	if (avi->proxy == NULL)
+		return ;
+	avi->proxy->proxyIndex = avi->frameCount - 1;
+	gmav_queue_push(&avi->proxy->queue, buffer, false, gmav_fill_proxy);
+}
+
+/*
+*	Drain the proxy, make up for frames dropped at the end and finish it
+*/
+static bool	gmav_finish_proxy(gmavi_t *avi, gmavi_t *proxy)
+{
+	bool	written = gmav_queue_stop(&proxy->queue);
+
+	while (written && proxy->frameCount < avi->frameCount)
+		written = gmav_write_frame(proxy, proxy->convertBuffer);
+	if (!written)
+	{
+		gmav_release(proxy);
+		return (false);
+	}
+	return (gmav_finish(proxy));
+}
+
+/*
+*	Synchronous frame write, runs on the caller's thread or the writer thread.
+*	A held @buffer may return to the pool with any later write, the proxy gets
+*	its copy before the checkpoint
+*/
+bool	gmav_write_frame(gmavi_t *avi, const uint8_t *buffer)
+{
+	uint64_t	started = gmav_clock_ns();
+
+	if (!gmav_store_frame(avi, buffer))
+		return (false);
+	gmav_feed_proxy(avi, buffer);
+	if (!gmav_end_frame(avi))
+		return (false);
+	gmav_count_frame(avi, started);
+	return (true);
+}
+
+/*
+*	Write a frame that already is a finished payload, the coded chunk of another
+*	file. Uncompressed streams take it like any other frame
+*/
+bool	gmav_write_payload(gmavi_t *avi, const uint8_t *payload, uint32_t size)
+{
+	static const uint8_t	pad = 0;
+
+	if (avi->codec == NULL)
+	{
+		if (size != avi->bitmapSize)
+		{
+			errno = EINVAL;
+			return (false);
+		}
+		return (gmav_write_frame(avi, payload));
+	}
+
+	RIFFCHUNK		header = {avi->chunkId, size};
+	gmavi_iovec_t	iov[3] = {
+		{&header, sizeof(RIFFCHUNK)},
+		{payload, size},
+		{&pad, 1}
 	};
 
-	avi->fileAddr.cbMain = avi->fileSize + 4;
+	uint64_t	started = gmav_clock_ns();
 
-	_fseeki64(avi->fileHandler, 0, SEEK_END);
-	fwrite(&avix, sizeof(RIFFLIST), 1, avi->fileHandler);
-	fwrite(&movi, sizeof(RIFFLIST), 1, avi->fileHandler);
-	avi->moviSize = 0;
-	avi->fileSize += 24;
+	gmav_take_audio(avi);
+	if (!gmav_begin_frame(avi, sizeof(RIFFCHUNK) + ((size + 1) & ~1u))
+		|| !gmav_record_frame(avi, avi->writeOffset + avi->audioBytes + sizeof(RIFFCHUNK), size)
+		|| !gmav_write_chunks(avi, iov, 2 + (size & 1))
+		|| !gmav_record_checksum(avi, payload, size)
+		|| !gmav_end_frame(avi))
+		return (false);
+	gmav_count_frame(avi, started);
+	return (true);
+}
 
-	gmav_create_index(avi, avi->maxFrames);
-	avi->fileAddr.moviStart = avi->fileSize + 8;
-	avi->riffChunks += 1;
+static bool	gmav_consume_frame(void *ctx, const uint8_t *slot)
+{
+	gmavi_t	*avi = (gmavi_t *)ctx;
+	bool	written;
+
+	/*	Pool slots can go out without a copy	*/
+	if (avi->queue.frames != NULL)
+		avi->holdable = (uint8_t *)slot;
+	written = gmav_write_frame(avi, slot);
+	avi->holdable = NULL;
+	return (written);
+}
+
+/*
+*	Converts the caller's frame straight into the queue slot
+*/
+static void	gmav_fill_frame(void *ctx, uint8_t *slot, const uint8_t *buffer)
+{
+	gmav_convert_frame(&((gmavi_t *)ctx)->convert, slot, buffer);
+}
+
+/*
+*	Queue a pool buffer that needs no conversion by swapping it into the ring,
+*	what comes back (the slot's old buffer, or @buffer itself when it was not
+*	queued) returns to the pool
+*/
+static int	gmav_swap_frame(gmavi_t *avi, uint8_t *buffer)
+{
+	int		result = gmav_queue_swap(&avi->queue, &buffer, avi->queuePolicy == GMAV_QUEUE_BLOCK);
+
+	gmav_frames_give(&avi->frames, buffer);
+	return (result);
+}
+
+/*
+*	Write or queue one frame, @convert when @buffer still is in the input format.
+*	Pool buffers are handed back once they are written or copied, or left to the
+*	backend when it writes them in place
+*/
+static bool	gmav_submit_frame(gmavi_t *avi, uint8_t *buffer, bool convert)
+{
+	bool	pooled = gmav_frames_owns(&avi->frames, buffer);
+	uint8_t	*frame = buffer;
+	int		result;
+
+	convert = convert && !avi->convert.identity;
+	if (avi->queue.depth == 0)
+	{
+		if (convert)
+		{
+			gmav_convert_frame(&avi->convert, avi->convertBuffer, buffer);
+			frame = avi->convertBuffer;
+		}
+		else if (pooled)
+			avi->holdable = buffer;
+		bool	written = gmav_write_frame(avi, frame);
+
+		/*	Still holdable when the backend did not take it	*/
+		if (pooled && (convert || avi->holdable != NULL))
+			gmav_frames_give(&avi->frames, buffer);
+		avi->holdable = NULL;
+		if (!written)
+			return (gmav_error(avi, errno, NULL));
+		return (true);
+	}
+
+	/*	Frames that do not fit under GMAV_QUEUE_DROP are simply not recorded	*/
+	if (pooled && !convert && avi->queue.frames != NULL)
+		result = gmav_swap_frame(avi, buffer);
+	else
+	{
+		result = gmav_queue_push(&avi->queue, buffer, avi->queuePolicy == GMAV_QUEUE_BLOCK,
+			convert ? gmav_fill_frame : NULL);
+		if (pooled)
+			gmav_frames_give(&avi->frames, buffer);
+	}
+	if (result == GMAV_QUEUE_FAILED)
+	{
+		gmav_queue_stop(&avi->queue);
+		return (gmav_error(avi, avi->queue.error, NULL));
+	}
 	return (true);
 }
 
@@ -333,33 +1813,273 @@ bool	gmav_add(
 	uint8_t *buffer)
 {
 	gmavi_t	*avi = (gmavi_t *)gmavi;
-	const uint32_t	fourcc_uncompressed = FCC('00db');
 
 	if (avi == NULL)
 		return (gmav_error(avi, 0, "No gmavi_t struct specified (null)"));
 	if (buffer == NULL)
 		return (gmav_error(avi, 0, "No buffer specified (null)"));
+	return (gmav_submit_frame(avi, buffer, true));
+}
 
-	if (avi->frameCount && avi->frameCount % avi->maxFrames == 0)
-		gmav_add_avix_chunk(avi);
-	
-	avi->frameCount += 1;
+bool	gmav_add_stream(
+	void *gmavi,
+	uint8_t *frame)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL)
+		return (gmav_error(avi, 0, "No gmavi_t struct specified (null)"));
+	if (frame == NULL)
+		return (gmav_error(avi, 0, "No buffer specified (null)"));
+	return (gmav_submit_frame(avi, frame, false));
+}
+
+uint8_t	*gmav_alloc_frame(
+	void *gmavi)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	/*	Like audio, a failure leaves the instance alone for the other threads	*/
+	if (avi == NULL)
+	{
+		gmav_error(NULL, 0, "No gmavi_t struct specified (null)");
+		return (NULL);
+	}
+	return (gmav_frames_take(&avi->frames));
+}
+
+bool	gmav_release_frame(
+	void *gmavi,
+	uint8_t *frame)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL)
+		return (gmav_error(NULL, 0, "No gmavi_t struct specified (null)"));
+	if (!gmav_frames_give(&avi->frames, frame))
+		return (gmav_error(NULL, 0, "Frame not handed out by this instance"));
+	return (true);
+}
+
+bool	gmav_add_audio(
+	void *gmavi,
+	const void *samples,
+	uint32_t count)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL)
+		return (gmav_error(NULL, 0, "No gmavi_t struct specified (null)"));
+	if (avi->blockAlign == 0)
+		return (gmav_error(NULL, 0, "No audio stream configured"));
+	if (samples == NULL && count)
+		return (gmav_error(NULL, 0, "No samples specified (null)"));
+
+	uint64_t	bytes = (uint64_t)count * avi->blockAlign;
+	bool		stored;
+
+	/*	A failure leaves the instance alone, the writer may be using it on another thread.
+		One chunk has to fit in a segment next to its frame	*/
+	gmav_mutex_lock(&avi->audioLock);
+	uint64_t	size = avi->audioPendingSize + bytes;
+	uint64_t	capacity = avi->audioPendingCapacity ? avi->audioPendingCapacity : 0x10000;
+
+	while (capacity < size)
+		capacity *= 2;
+	stored = size <= avi->segmentSize / 2;
+	if (stored && capacity != avi->audioPendingCapacity)
+	{
+		uint8_t	*pending = (uint8_t *)realloc(avi->audioPending, (size_t)capacity);
 
-	_fseeki64(avi->fileHandler, 0, SEEK_END);
-	if (avi->riffChunks != 0)
+		stored = pending != NULL;
+		if (stored)
+		{
+			avi->audioPending = pending;
+			avi->audioPendingCapacity = (uint32_t)capacity;
+		}
+	}
+	if (stored && bytes)
 	{
-		fwrite(&fourcc_uncompressed, sizeof(uint32_t), 1, avi->fileHandler);
-		fwrite(&avi->bitmapSize, sizeof(uint32_t), 1, avi->fileHandler);
-		fwrite(buffer, avi->bitmapSize, 1, avi->fileHandler);
+		memcpy(avi->audioPending + avi->audioPendingSize, samples, (size_t)bytes);
+		avi->audioPendingSize = (uint32_t)size;
+	}
+	gmav_mutex_unlock(&avi->audioLock);
+	return (stored);
+}
+
+/*
+*	Map the file window holding [@offset, @offset + @size)
+*/
+static bool	gmav_map_window(gmavi_t *avi, uint64_t offset, size_t size)
+{
+	if (avi->mapBase != NULL
+		&& offset >= avi->mapOffset && offset + size <= avi->mapOffset + avi->mapSize)
 		return (true);
+	if (avi->mapBase != NULL && !avi->io->unmap(avi->ioHandle, avi->mapBase, avi->mapSize))
+		return (false);
+	avi->mapBase = NULL;
+
+	uint64_t	start = offset & ~(uint64_t)(GMAV_IO_SECTOR - 1);
+	size_t		length = GMAV_ALIGN_UP(offset + size - start, GMAV_IO_SECTOR);
+
+	if (length < GMAV_MAP_WINDOW)
+		length = GMAV_MAP_WINDOW;
+	avi->mapBase = (uint8_t *)avi->io->map(avi->ioHandle, start, length);
+	if (avi->mapBase == NULL)
+		return (false);
+	avi->mapOffset = start;
+	avi->mapSize = length;
+	avi->extended = true;
+	return (true);
+}
+
+/*
+*	Frames only go straight into the file when nothing else writes it behind
+*	our back: no writer thread, no asynchronous engine and no O_DIRECT. Coded and
+*	deduplicated frames have to be looked at before their place is known
+*/
+static bool	gmav_can_map(gmavi_t *avi)
+{
+	return (avi->io->map != NULL && avi->queue.depth == 0 && !avi->recordIndex
+		&& avi->io->writevAsync == NULL && !(avi->flags & GMAV_FLAG_DIRECT));
+}
+
+/*
+*	Acquired frames come from the pool when it gets them out without a copy:
+*	swapped into the queue, or held by the backend until they are written
+*/
+static bool	gmav_pool_acquire(gmavi_t *avi)
+{
+	if (avi->queue.depth)
+		return (avi->queue.frames != NULL);
+	return (avi->convert.identity && avi->io->writevHeld != NULL);
+}
+
+uint8_t	*gmav_acquire_frame(
+	void *gmavi)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL)
+	{
+		gmav_error(avi, 0, "No gmavi_t struct specified (null)");
+		return (NULL);
 	}
+	if (avi->acquired != NULL)
+		return (avi->acquired);
 
-	fwrite(&fourcc_uncompressed, sizeof(uint32_t), 1, avi->fileHandler);
-	fwrite(&avi->bitmapSize, sizeof(uint32_t), 1, avi->fileHandler);
-	fwrite(buffer, avi->bitmapSize, 1, avi->fileHandler);
+	if (gmav_can_map(avi))
+	{
+		uint64_t	payload = gmav_next_payload(avi);
+
+		/*	The chunk header and (aligned) trailer are filled in on commit	*/
+		if (!gmav_map_window(avi, payload - sizeof(RIFFCHUNK), avi->streamTickSize + sizeof(RIFFCHUNK)))
+		{
+			gmav_error(avi, errno, NULL);
+			return (NULL);
+		}
+		avi->acquiredOffset = payload;
+		avi->acquired = avi->mapBase + (payload - avi->mapOffset);
+		return (avi->acquired);
+	}
+
+	/*	Queued by swapping it into the ring or written in place, like a
+		gmav_alloc_frame buffer	*/
+	if (avi->stageBuffer == NULL && gmav_pool_acquire(avi))
+	{
+		avi->stageBuffer = gmav_frames_take(&avi->frames);
+		if (avi->stageBuffer == NULL)
+		{
+			gmav_error(avi, errno, NULL);
+			return (NULL);
+		}
+	}
+	if (avi->stageBuffer == NULL)
+	{
+		avi->stageBuffer = (uint8_t *)gmav_aligned_alloc(avi->bitmapSize);
+		if (avi->stageBuffer == NULL)
+		{
+			gmav_error(avi, errno, NULL);
+			return (NULL);
+		}
+	}
+	avi->acquired = avi->stageBuffer;
+	return (avi->acquired);
+}
+
+bool	gmav_commit_frame(
+	void *gmavi)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL)
+		return (gmav_error(avi, 0, "No gmavi_t struct specified (null)"));
+	if (avi->acquired == NULL)
+		return (gmav_error(avi, 0, "No frame acquired"));
+
+	uint8_t		*frame = avi->acquired;
+	uint64_t	started = gmav_clock_ns();
+
+	avi->acquired = NULL;
+	if (frame == avi->stageBuffer)
+	{
+		/*	A pool buffer is given away, the next acquire takes another one	*/
+		if (gmav_frames_owns(&avi->frames, frame))
+			avi->stageBuffer = NULL;
+		return (gmav_submit_frame(avi, frame, false));
+	}
+
+	/*	Rollover and lead only touch the file before the payload	*/
+	if (!gmav_begin_frame(avi, avi->streamTickSize))
+		return (gmav_error(avi, errno, NULL));
+
+	RIFFCHUNK	chunk = {avi->chunkId, avi->bitmapSize};
+
+	memcpy(frame - sizeof(RIFFCHUNK), &chunk, sizeof(RIFFCHUNK));
+	if (!gmav_record_checksum(avi, frame, avi->bitmapSize))
+		return (gmav_error(avi, errno, NULL));
+	/*	The next header is left to its own commit, the mapped file is already
+		grown past it and a crash must not leave a frame that was never committed	*/
+	if (avi->flags & GMAV_FLAG_ALIGNED)
+		gmav_fill_trailer(avi, frame + avi->bitmapSize, false);
+	avi->writeOffset = avi->acquiredOffset - sizeof(RIFFCHUNK) + avi->streamTickSize;
+	/*	Written by the caller through the mapping	*/
+	gmav_atomic_add(&avi->stats.bytesWritten, avi->streamTickSize);
+	if (!gmav_end_frame(avi))
+		return (gmav_error(avi, errno, NULL));
+	gmav_count_frame(avi, started);
+	gmav_feed_proxy(avi, frame);
 	return (true);
 }
 
+/*
+*	Trailing index chunks go out as one write, then the header changes as one
+*	batch and the segment sizes as another
+*/
+static bool	gmav_finish_file(
+	gmavi_t *avi)
+{
+	if (!gmav_flush_audio(avi))
+		return (false);
+	if (avi->frameCount == 0)
+		avi->moviLead = 0;
+	if (avi->riffChunks == 0)
+		return (gmav_finish_main(avi, true));
+
+	if (!gmav_write_segment_index(avi)
+		|| !gmav_flush_index(avi)
+		|| !gmav_write_super_index(avi, avi->riffChunks + 1)
+		|| !gmav_patch(avi, avi->fileAddr.totalFrames, &avi->frameCount, sizeof(uint32_t))
+		|| !gmav_patch(avi, avi->fileAddr.grandFrames, &avi->frameCount, sizeof(uint32_t))
+		|| !gmav_write_audio_length(avi)
+		|| !gmav_flush_header(avi))
+		return (false);
+
+	if (!gmav_close_segment(avi))
+		return (false);
+	return (gmav_close_file(avi));
+}
+
 bool		gmav_finish(
 	void *gmavi)
 {
@@ -367,70 +2087,58 @@ bool		gmav_finish(
 		return (gmav_error(NULL, 0, "No gmavi_t struct specified (null)"));
 	gmavi_t	*avi = (gmavi_t *)gmavi;
 
-	if (avi->riffChunks == 0)
-		return (gmav_finish_main(avi, true));
+	/*	Everything still queued is written before the index work starts	*/
+	if (avi->queue.depth && !gmav_queue_stop(&avi->queue))
+		return (gmav_error(avi, avi->queue.error, NULL));
+	if (avi->mapBase != NULL)
+	{
+		bool	unmapped = avi->io->unmap(avi->ioHandle, avi->mapBase, avi->mapSize);
 
-	uint32_t	framesLeft = avi->frameCount % avi->maxFrames;
-	if (framesLeft == 0)	//	edge case
-		framesLeft = avi->maxFrames;
-
-	gmav_create_index(avi, framesLeft);
-
-	_fseeki64(avi->fileHandler, avi->fileAddr.totalFrames, SEEK_SET);
-	fwrite(&avi->frameCount, sizeof(uint32_t), 1, avi->fileHandler);
-
-	AVISUPERINDEX	superIndex = {
-		FCC('indx'),						/*	fcc					*/
-		STATIC_SUPER_INDEX_SIZE,			/*	cb					*/
-		4,									/*	longsPerEntry		*/
-		0,									/*	indexSubType		*/
-		0,									/*	indexType			*/
-		avi->riffChunks + 1,				/*	entriesInUse		*/
-		FCC('00db'),						/*	chunkId				*/
-		{0, 0, 0},							/*	reserved			*/
-		TO_BE_DETERMINED					/*	index[]				*/
-	};
-	_fseeki64(avi->fileHandler, avi->fileAddr.superIndex, SEEK_SET);
-	fwrite(&superIndex, sizeof(AVISUPERINDEX), 1, avi->fileHandler);
-	avi->fileSize += avi->streamTickSize * framesLeft;
-	
-	for (uint32_t i = 0; i < avi->riffChunks; i++) {
-
-		_fseeki64(avi->fileHandler, 0, SEEK_END);
-		fwrite(&avi->ix00[i].avixIndex, sizeof(AVISTDINDEX), 1, avi->fileHandler);
-		fwrite(avi->ix00[i].avixIndexEntries, sizeof(AVISTDINDEX_ENTRY), avi->maxFrames, avi->fileHandler);
-		
-		uint32_t	stdIndexSize = 32 + avi->maxFrames * 8;
-		_fseeki64(avi->fileHandler, avi->fileAddr.superIndexEntries, SEEK_SET);
-		fwrite(&avi->fileSize, sizeof(uint64_t), 1, avi->fileHandler);
-		fwrite(&stdIndexSize, sizeof(uint32_t), 1, avi->fileHandler);
-		fwrite(&avi->maxFrames, sizeof(uint32_t), 1, avi->fileHandler);
-
-		free(avi->ix00[i].avixIndexEntries);
-		avi->fileSize += sizeof(AVISTDINDEX_ENTRY) * avi->maxFrames;
-		avi->fileSize += sizeof(AVISTDINDEX);
-		avi->fileAddr.superIndexEntries += STATIC_SUPER_INDEX_OFFSET;
-	}
-
-	uint32_t	lastIndexSize = 32 * (avi->riffChunks + 1) + framesLeft * 8;
-	fwrite(&avi->fileSize, sizeof(uint64_t), 1, avi->fileHandler);
-	fwrite(&lastIndexSize, sizeof(uint32_t), 1, avi->fileHandler);
-	fwrite(&framesLeft, sizeof(uint32_t), 1, avi->fileHandler);
-
-	_fseeki64(avi->fileHandler, 0, SEEK_END);
-	fwrite(&avi->ix00[avi->riffChunks].avixIndex, sizeof(AVISTDINDEX), 1, avi->fileHandler);
-	fwrite(avi->ix00[avi->riffChunks].avixIndexEntries, sizeof(AVISTDINDEX_ENTRY), framesLeft, avi->fileHandler);
-
-	uint32_t	riffSize = (avi->streamTickSize * framesLeft) + 16 + sizeof(AVISTDINDEX) * (avi->riffChunks + 1);
-	riffSize += sizeof(AVISTDINDEX_ENTRY) * avi->maxFrames * avi->riffChunks;
-	riffSize += sizeof(AVISTDINDEX_ENTRY) * framesLeft;
-	uint32_t	moviSize = riffSize - 12;
-
-	_fseeki64(avi->fileHandler, avi->fileAddr.cbMain, SEEK_SET);
-	fwrite(&riffSize, sizeof(uint32_t), 1, avi->fileHandler);
-	_fseeki64(avi->fileHandler, 8, SEEK_CUR);
-	fwrite(&moviSize, sizeof(uint32_t), 1, avi->fileHandler);
-	if (fclose(avi->fileHandler))
+		avi->mapBase = NULL;
+		if (!unmapped)
+			return (gmav_error(avi, errno, NULL));
+	}
+	if (!gmav_finish_file(avi))
 		return (gmav_error(avi, errno, NULL));
+	if (avi->telemetry != NULL)
+	{
+		gmavi_stats_t	stats;
+
+		gmav_read_stats(avi, &stats);
+		avi->telemetry(avi->telemetryContext, &stats);
+	}
+
+	/*	The proxy drains its last frames while the index above was written	*/
+	gmavi_t	*proxy = avi->proxy;
+
+	avi->proxy = NULL;
+	if (proxy != NULL && !gmav_finish_proxy(avi, proxy))
+		return (gmav_error(avi, errno, "Proxy recording failed"));
+	gmav_release(avi);
+	return (true);
+}
+
+bool		gmav_get_stats(
+	void *gmavi,
+	gmavi_stats_t *stats)
+{
+	if (gmavi == NULL || stats == NULL)
+		return (false);
+	gmav_read_stats((gmavi_t *)gmavi, stats);
+	return (true);
+}
+
+bool		gmav_get_layout(
+	void *gmavi,
+	gmavi_layout_t *layout)
+{
+	gmavi_t	*avi = (gmavi_t *)gmavi;
+
+	if (avi == NULL || layout == NULL)
+		return (false);
+	layout->inputSize = (uint32_t)(avi->convert.srcStride * avi->convert.height);
+	layout->streamSize = avi->bitmapSize;
+	layout->chunkSize = avi->streamTickSize;
+	layout->passthrough = avi->convert.identity;
 	return (true);
 }
@@ -10,9 +10,11 @@
 #ifndef MSAVIRIFF_H
 # define MSAVIRIFF_H
 # define DWORD  unsigned int
-#pragma warning(disable: 4097 4511 4512 4514 4705)
-#pragma warning(disable: 4996)
-#pragma warning(disable: 4200)
+# ifdef _MSC_VER
+#  pragma warning(disable: 4097 4511 4512 4514 4705)
+#  pragma warning(disable: 4996)
+#  pragma warning(disable: 4200)
+# endif
 # define FCC(ch4) ((((DWORD)(ch4) & 0xFF) << 24) |     \
                   (((DWORD)(ch4) & 0xFF00) << 8) |    \
                   (((DWORD)(ch4) & 0xFF0000) >> 8) |  \